@@ -0,0 +1,108 @@
+#ifndef darma_bench_util_h
+#define darma_bench_util_h
+
+#include <mpi.h>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/**
+ * Shared helpers for the runtime microbenchmarks. Every benchmark writes one
+ * JSON document from rank 0 so results can be diffed across commits, e.g.
+ *   {"benchmark":"comm","ranks":4,"results":[
+ *     {"name":"ghost_latency","param":"bytes","value":64,"result":12.5,"unit":"us"}, ...]}
+ */
+namespace bench {
+
+/**
+ * @brief Run f niter times between barriers
+ * @param niter The number of repetitions
+ * @param f     The operation to time
+ * @param comm  The ranks taking part
+ * @return      The mean time per repetition in seconds, max over all ranks
+ */
+template <class Fxn>
+double time_op(int niter, Fxn&& f, MPI_Comm comm = MPI_COMM_WORLD){
+  MPI_Barrier(comm);
+  double t_start = MPI_Wtime();
+  for (int i=0; i < niter; ++i){
+    f();
+  }
+  double t = (MPI_Wtime() - t_start) / niter;
+  MPI_Allreduce(MPI_IN_PLACE, &t, 1, MPI_DOUBLE, MPI_MAX, comm);
+  return t;
+}
+
+class report {
+ public:
+  report(const std::string& benchmark, MPI_Comm comm = MPI_COMM_WORLD) :
+    benchmark_(benchmark)
+  {
+    MPI_Comm_rank(comm, &rank_);
+    MPI_Comm_size(comm, &size_);
+  }
+
+  /**
+   * @brief Record one measurement
+   * @param name   The quantity measured, e.g. ghost_latency
+   * @param param  The name of the swept parameter, e.g. bytes
+   * @param value  The value of the swept parameter
+   * @param result The measured value
+   * @param unit   The unit of result
+   */
+  void add(const std::string& name, const std::string& param, long value,
+           double result, const std::string& unit){
+    entries_.push_back({name, param, value, result, unit});
+    if (rank_ == 0){
+      std::cerr << name << " " << param << "=" << value
+                << " " << result << " " << unit << std::endl;
+    }
+  }
+
+  /**
+   * @brief Write the collected results on rank 0
+   * @param path The file to write, or empty for stdout
+   */
+  void write(const std::string& path) const {
+    if (rank_ != 0) return;
+
+    if (path.empty()){
+      write(std::cout);
+    } else {
+      std::ofstream ofs(path);
+      write(ofs);
+    }
+  }
+
+  void write(std::ostream& os) const {
+    os << "{\"benchmark\":\"" << benchmark_ << "\",\"ranks\":" << size_
+       << ",\"results\":[";
+    for (int i=0; i < entries_.size(); ++i){
+      const entry& e = entries_[i];
+      if (i != 0) os << ",";
+      os << "\n  {\"name\":\"" << e.name << "\",\"param\":\"" << e.param
+         << "\",\"value\":" << e.value << ",\"result\":" << e.result
+         << ",\"unit\":\"" << e.unit << "\"}";
+    }
+    os << "\n]}" << std::endl;
+  }
+
+ private:
+  struct entry {
+    std::string name;
+    std::string param;
+    long value;
+    double result;
+    std::string unit;
+  };
+
+  std::string benchmark_;
+  std::vector<entry> entries_;
+  int rank_;
+  int size_;
+};
+
+}
+
+#endif
@@ -0,0 +1,105 @@
+#include "mpi_backend.h"
+#include "hierarchy.h"
+#include <iostream>
+#include <iomanip>
+
+/**
+ * Compare flat and hierarchical (node-aware) reduce, gather and broadcast.
+ * Run with oversubscribed local ranks and a non-zero ranks_per_node to
+ * emulate a multi-node machine, e.g.
+ *   mpirun -np 8 --oversubscribe ./collectives 100 2
+ */
+
+void usage(std::ostream& os){
+  os << "Usage: ./collectives <niter> [ranks_per_node]";
+}
+
+template <class Fxn>
+double time_op(int niter, Fxn&& f){
+  MPI_Barrier(MPI_COMM_WORLD);
+  double t_start = MPI_Wtime();
+  for (int i=0; i < niter; ++i){
+    f();
+  }
+  double t_us = (MPI_Wtime() - t_start) / niter * 1e6;
+  MPI_Allreduce(MPI_IN_PLACE, &t_us, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+  return t_us;
+}
+
+void report(int rank, const char* name, std::size_t bytes, double flat_us, double hier_us){
+  if (rank == 0){
+    std::cout << std::setw(10) << name
+              << std::setw(12) << bytes
+              << std::setw(14) << std::setprecision(4) << flat_us
+              << std::setw(14) << std::setprecision(4) << hier_us
+              << std::endl;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  MPI_Init(&argc, &argv);
+  int rank; MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  int size; MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+  if (argc < 2){
+    if (rank == 0){
+      usage(std::cerr);
+      std::cerr << std::endl;
+    }
+    MPI_Finalize();
+    return 1;
+  }
+
+  int niter = atoi(argv[1]);
+  int ranks_per_node = argc > 2 ? atoi(argv[2]) : 0;
+
+  {
+    darma_backend::node_topology topo(MPI_COMM_WORLD, ranks_per_node);
+    if (rank == 0){
+      std::cout << "ranks=" << size << " nodes=" << topo.num_nodes << "\n"
+                << std::setw(10) << "op"
+                << std::setw(12) << "bytes"
+                << std::setw(14) << "flat(us)"
+                << std::setw(14) << "hier(us)"
+                << std::endl;
+    }
+
+    for (std::size_t bytes = 8; bytes <= (1<<20); bytes *= 16){
+      int count = bytes / sizeof(double);
+      std::vector<double> vals(count, rank);
+      double flat = time_op(niter, [&]{
+        MPI_Allreduce(MPI_IN_PLACE, vals.data(), count, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+      });
+      double hier = time_op(niter, [&]{
+        darma_backend::allreduce(vals.data(), count, MPI_DOUBLE, MPI_SUM, topo);
+      });
+      report(rank, "reduce", bytes, flat, hier);
+    }
+
+    for (std::size_t bytes = 8; bytes <= (1<<20); bytes *= 16){
+      darma_backend::serialization_buffer buff(bytes);
+      double flat = time_op(niter, [&]{
+        darma_backend::detail::gather_internal(buff, 0, MPI_COMM_WORLD);
+      });
+      double hier = time_op(niter, [&]{
+        darma_backend::detail::gather_internal(buff, 0, topo);
+      });
+      report(rank, "gather", bytes, flat, hier);
+    }
+
+    for (std::size_t bytes = 8; bytes <= (1<<20); bytes *= 16){
+      darma_backend::serialization_buffer buff(bytes);
+      double flat = time_op(niter, [&]{
+        darma_backend::detail::broadcast_internal(buff, 0, MPI_COMM_WORLD);
+      });
+      double hier = time_op(niter, [&]{
+        darma_backend::detail::broadcast_internal(buff, 0, topo);
+      });
+      report(rank, "broadcast", bytes, flat, hier);
+    }
+  }
+
+  MPI_Finalize();
+  return 0;
+}
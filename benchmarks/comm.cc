@@ -0,0 +1,396 @@
+#include "mpi_backend.h"
+#include "bench_util.h"
+#include <array>
+
+/**
+ * Measure the communication paths of the runtime:
+ *   ghost_latency/ghost_bandwidth - a ring exchange through send/recv accessors
+ *   ghost_zero_copy_bandwidth     - the same exchange sent straight out of the
+ *                                   element through accessor regions
+ *   stencil_p2p/stencil_exchange  - both ring neighbors at once, by send/recv
+ *                                   or as one neighborhood collective
+ *   put_task_rate                 - active messages delivered to a neighbor element
+ *   put_task_dispatch             - the same with more elements per rank, where
+ *                                   finding the target element dominates
+ *   fanout_loop/fanout_many       - one 64 KB payload put to several elements,
+ *                                   packed per target or once with put_task_many
+ *   reduce_latency                - reduce of one double per element
+ * Run as
+ *   mpirun -np 4 ./bench_comm <niter> [out.json] -- <backend args>
+ */
+
+using Context=Frontend<MpiBackend>;
+
+struct Buffer {
+  std::vector<char> data;
+};
+
+struct Halo {
+  //separate, so receiving never writes what is still being sent
+  std::vector<char> out;
+  std::vector<char> in;
+};
+
+struct Counter {
+  int received = 0;
+};
+
+//the number of active messages unpacked on this rank
+static long g_received = 0;
+
+struct Ghost {
+  struct Accessor {
+    template <class Archive>
+    static void pack(Buffer& b, int local, int remote, Archive& ar){
+      ar | b.data;
+    }
+
+    template <class Archive>
+    static void unpack(Context* ctx, Buffer& b, Archive& ar){
+      ar | b.data;
+    }
+
+    template <class Archive>
+    static void compute_size(Buffer& b, int local, int remote, Archive& ar){
+      pack(b,local,remote,ar);
+    }
+  };
+
+  void operator()(Context* ctx, int index, int nelems, int bytes,
+                  async_ref_mm<Buffer> buf){
+    buf->data.resize(bytes);
+    int left = (index - 1 + nelems) % nelems;
+    int right = (index + 1) % nelems;
+    auto sent = ctx->to_send(std::move(buf));
+    sent = ctx->send<Accessor>(index, right, std::move(sent));
+    auto recvd = ctx->to_recv(std::move(sent));
+    recvd = ctx->recv<Accessor>(index, left, std::move(recvd));
+  }
+};
+
+struct ZeroCopyGhost {
+  struct Accessor {
+    static void send_regions(Halo& h, int local, int remote, darma_backend::region_list& r){
+      r.add(h.out.data(), h.out.size());
+    }
+
+    static void recv_regions(Halo& h, int local, int remote, darma_backend::region_list& r){
+      r.add(h.in.data(), h.in.size());
+    }
+  };
+
+  void operator()(Context* ctx, int index, int nelems, int bytes,
+                  async_ref_mm<Halo> h){
+    h->out.resize(bytes);
+    h->in.resize(bytes);
+    int left = (index - 1 + nelems) % nelems;
+    int right = (index + 1) % nelems;
+    auto sent = ctx->to_send(std::move(h));
+    sent = ctx->send<Accessor>(index, right, std::move(sent));
+    auto recvd = ctx->to_recv(std::move(sent));
+    recvd = ctx->recv<Accessor>(index, left, std::move(recvd));
+  }
+};
+
+struct Hit {
+  template <class Archive>
+  static void pack(Counter& c, Archive& ar){
+    ar | c.received;
+  }
+
+  template <class Archive>
+  static void compute_size(Counter& c, Archive& ar){
+    pack(c,ar);
+  }
+
+  template <class Archive>
+  static void unpack(Context* ctx, async_ref_ii<Counter> c, Archive& ar){
+    int ignored;
+    ar | ignored;
+    ++c->received;
+    ++g_received;
+  }
+};
+
+struct Fire {
+  void operator()(Context* ctx, int index, int nelems, int count,
+                  async_ref_ii<Counter> c){
+    int right = (index + 1) % nelems;
+    for (int i=0; i < count; ++i){
+      c = ctx->put_task<Hit>(right, std::move(c));
+    }
+  }
+};
+
+struct Stencil {
+  struct Accessor {
+    template <class Archive>
+    static void pack(Buffer& b, int local, int remote, Archive& ar){
+      ar | b.data;
+    }
+
+    template <class Archive>
+    static void compute_size(Buffer& b, int local, int remote, Archive& ar){
+      pack(b,local,remote,ar);
+    }
+
+    template <class Archive>
+    static void unpack(Context* ctx, Buffer& b, Archive& ar){
+      ar | b.data;
+    }
+
+    template <class Archive>
+    static void unpack(Buffer& b, int local, int remote, Archive& ar){
+      ar | b.data;
+    }
+  };
+
+  struct Neighbors {
+    int nelems;
+
+    std::array<int,2> operator()(int index) const {
+      return {{(index - 1 + nelems) % nelems, (index + 1) % nelems}};
+    }
+  };
+
+  //fill only, for the exchange
+  struct Fill {
+    void operator()(Context* ctx, int index, int bytes, async_ref_mm<Buffer> buf){
+      buf->data.resize(bytes);
+    }
+  };
+
+  void operator()(Context* ctx, int index, int nelems, int bytes,
+                  async_ref_mm<Buffer> buf){
+    buf->data.resize(bytes);
+    auto nbrs = Neighbors{nelems}(index);
+    auto sent = ctx->to_send(std::move(buf));
+    sent = ctx->send<Accessor>(index, nbrs[0], std::move(sent));
+    sent = ctx->send<Accessor>(index, nbrs[1], std::move(sent));
+    auto recvd = ctx->to_recv(std::move(sent));
+    recvd = ctx->recv<Accessor>(index, nbrs[0], std::move(recvd));
+    recvd = ctx->recv<Accessor>(index, nbrs[1], std::move(recvd));
+  }
+};
+
+struct Blast {
+  template <class Archive>
+  static void pack(Counter& c, Archive& ar, std::vector<double>& payload){
+    ar | payload;
+  }
+
+  template <class Archive>
+  static void compute_size(Counter& c, Archive& ar, std::vector<double>& payload){
+    pack(c, ar, payload);
+  }
+
+  template <class Archive>
+  static void unpack(Context* ctx, async_ref_ii<Counter> c, Archive& ar){
+    std::vector<double> payload;
+    ar | payload;
+    ++c->received;
+    ++g_received;
+  }
+};
+
+//registered up front, so every rank knows the ids before any message arrives
+static auto hit_task = recv_task_id<Hit,Counter,int>();
+static auto blast_task = recv_task_id<Blast,Counter,int>();
+
+struct Fanout {
+  void operator()(Context* ctx, int index, int nelems, int fanout, bool many,
+                  async_ref_ii<Counter> c){
+    std::vector<double> payload(8192, double(index));
+    std::vector<int> targets;
+    for (int k=1; k <= fanout; ++k) targets.push_back((index + k) % nelems);
+    if (many){
+      c = ctx->put_task_many<Blast>(targets, std::move(c), payload);
+    } else {
+      for (int target : targets){
+        c = ctx->put_task<Blast>(target, std::move(c), payload);
+      }
+    }
+  }
+};
+
+struct Fill {
+  void operator()(Context* ctx, int index, async_ref_mm<double> d){
+    *d = index;
+  }
+};
+
+template <class T>
+struct Add {
+  static T identity(){
+    return 0;
+  }
+
+  static T* mpiBuffer(T& t){
+    return &t;
+  }
+
+  static int mpiSize(T& t){
+    return 1;
+  }
+
+  static MPI_Datatype mpiType(double& i){ return MPI_DOUBLE; }
+  static MPI_Op mpiOp(double& i){ return MPI_SUM; }
+
+  void operator()(const T& in, T& out){
+    out += in;
+  }
+};
+
+void usage(std::ostream& os){
+  os << "Usage: ./bench_comm <niter> [out.json] [-- backend args]";
+}
+
+int run(int argc, char** argv)
+{
+  int rank; MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  int size; MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+  auto dc = allocate_context(MPI_COMM_WORLD, argc, argv);
+  int app_argc = dc->split_argv(argc, argv);
+  if (app_argc < 2){
+    if (rank == 0){
+      usage(std::cerr);
+      std::cerr << std::endl;
+    }
+    return 1;
+  }
+
+  int niter = atoi(argv[1]);
+  std::string out = app_argc > 2 ? argv[2] : "";
+  bench::report rep("comm");
+
+  {
+    //one element per rank so every exchange crosses ranks
+    int nelems = size;
+    auto phase = dc->make_phase(nelems);
+    auto coll = dc->make_collection<Buffer>(nelems);
+    for (int bytes = 8; bytes <= (1<<22); bytes *= 8){
+      double t = bench::time_op(niter, [&]{
+        std::tie(coll) = dc->create_phase_work<Ghost>(phase, nelems, bytes, std::move(coll));
+        dc->flush();
+      });
+      rep.add("ghost_latency", "bytes", bytes, t * 1e6, "us");
+      rep.add("ghost_bandwidth", "bytes", bytes, bytes / t / 1e6, "MB/s");
+    }
+
+    auto halos = dc->make_collection<Halo>(nelems);
+    for (int bytes = 8; bytes <= (1<<22); bytes *= 8){
+      double t = bench::time_op(niter, [&]{
+        std::tie(halos) = dc->create_phase_work<ZeroCopyGhost>(phase, nelems, bytes, std::move(halos));
+        dc->flush();
+      });
+      rep.add("ghost_zero_copy_bandwidth", "bytes", bytes, bytes / t / 1e6, "MB/s");
+    }
+  }
+
+  {
+    int per_rank = 4;
+    int nelems = per_rank * size;
+    auto phase = dc->make_phase(nelems);
+    auto coll = dc->make_collection<Buffer>(nelems);
+    Stencil::Neighbors nbrs{nelems};
+    for (int bytes = 8; bytes <= (1<<18); bytes *= 8){
+      double t = bench::time_op(niter, [&]{
+        std::tie(coll) = dc->create_phase_work<Stencil>(phase, nelems, bytes, std::move(coll));
+        dc->flush();
+      });
+      rep.add("stencil_p2p", "bytes", bytes, t * 1e6, "us");
+      t = bench::time_op(niter, [&]{
+        std::tie(coll) = dc->create_phase_work<Stencil::Fill>(phase, bytes, std::move(coll));
+        coll = dc->exchange<Stencil::Accessor>(phase, std::move(coll), nbrs);
+        dc->flush();
+      });
+      rep.add("stencil_exchange", "bytes", bytes, t * 1e6, "us");
+    }
+  }
+
+  {
+    int per_rank = 4;
+    int nelems = per_rank * size;
+    auto phase = dc->make_phase(nelems);
+    auto coll = dc->make_collection<Counter>(nelems);
+    long expected = 0;
+    for (int count = 1; count <= 256; count *= 4){
+      double t = bench::time_op(niter, [&]{
+        expected += long(count) * per_rank;
+        std::tie(coll) = dc->create_phase_work<Fire>(phase, nelems, count, std::move(coll));
+        //nothing tells us when the messages have landed - count them
+        do {
+          dc->flush();
+        } while (g_received < expected);
+      });
+      rep.add("put_task_rate", "messages", count * nelems,
+              count * nelems / t / 1e6, "Mmsg/s");
+    }
+  }
+
+  {
+    //the tags only have room for 64 elements per rank
+    long expected = g_received;
+    int count = 16;
+    for (int per_rank = 4; per_rank <= 64; per_rank *= 2){
+      int nelems = per_rank * size;
+      auto phase = dc->make_phase(nelems);
+      auto coll = dc->make_collection<Counter>(nelems);
+      double t = bench::time_op(niter, [&]{
+        expected += long(count) * per_rank;
+        std::tie(coll) = dc->create_phase_work<Fire>(phase, nelems, count, std::move(coll));
+        do {
+          dc->flush();
+        } while (g_received < expected);
+      });
+      rep.add("put_task_dispatch", "elements_per_rank", per_rank,
+              count * nelems / t / 1e6, "Mmsg/s");
+    }
+  }
+
+  {
+    int per_rank = 4;
+    int nelems = per_rank * size;
+    auto phase = dc->make_phase(nelems);
+    auto coll = dc->make_collection<Counter>(nelems);
+    long expected = g_received;
+    for (int fanout = 2; fanout <= 8; fanout *= 2){
+      for (bool many : {false, true}){
+        double t = bench::time_op(niter, [&]{
+          expected += long(fanout) * per_rank;
+          std::tie(coll) = dc->create_phase_work<Fanout>(phase, nelems, fanout, many,
+                                                         std::move(coll));
+          do {
+            dc->flush();
+          } while (g_received < expected);
+        });
+        rep.add(many ? "fanout_many" : "fanout_loop", "targets", fanout,
+                fanout * nelems / t / 1e3, "Kmsg/s");
+      }
+    }
+  }
+
+  {
+    auto phase = dc->make_phase(size);
+    auto vals = dc->make_collection<double>(size);
+    std::tie(vals) = dc->create_phase_work<Fill>(phase, std::move(vals));
+    auto sum = dc->make_async_ref<double>();
+    double t = bench::time_op(niter, [&]{
+      std::tie(sum,vals) = dc->reduce<Add<double>>(std::move(vals));
+    });
+    rep.add("reduce_latency", "elements", size, t * 1e6, "us");
+  }
+
+  rep.write(out);
+  return 0;
+}
+
+int main(int argc, char** argv)
+{
+  MPI_Init(&argc, &argv);
+  //the context must be gone before MPI is finalized
+  int rc = run(argc, argv);
+  MPI_Finalize();
+  return rc;
+}
@@ -0,0 +1,79 @@
+#include "mpi_backend.h"
+#include "bench_util.h"
+
+/**
+ * Measure the load balancing support paths:
+ *   migration_bandwidth - every rank migrates objects to its right neighbor
+ *   global_mapping      - building the index->rank mapping of a phase from
+ *                         the locally owned indices (make_global_mapping_from_local)
+ * Run as
+ *   mpirun -np 4 ./bench_lb <niter> [out.json] -- <backend args>
+ */
+
+void usage(std::ostream& os){
+  os << "Usage: ./bench_lb <niter> [out.json] [-- backend args]";
+}
+
+int run(int argc, char** argv)
+{
+  int rank; MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  int size; MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+  auto dc = allocate_context(MPI_COMM_WORLD, argc, argv);
+  int app_argc = dc->split_argv(argc, argv);
+  if (app_argc < 2){
+    if (rank == 0){
+      usage(std::cerr);
+      std::cerr << std::endl;
+    }
+    return 1;
+  }
+
+  int niter = atoi(argv[1]);
+  std::string out = app_argc > 2 ? argv[2] : "";
+  bench::report rep("lb");
+
+  int nobj = 8;
+  int right = (rank + 1) % size;
+  int left = (rank - 1 + size) % size;
+  for (int bytes = 64; bytes <= (1<<20); bytes *= 8){
+    std::vector<std::vector<char>> objs(nobj, std::vector<char>(bytes));
+    double t = bench::time_op(niter, [&]{
+      std::vector<MpiBackend::migration> toSend;
+      std::vector<MpiBackend::migration> toRecv;
+      for (int i=0; i < nobj; ++i){
+        toSend.emplace_back(rank*nobj + i, objs[i].data(), nullptr, bytes, right, rank);
+        toRecv.emplace_back(left*nobj + i, nullptr, nullptr, 0, left, -1);
+      }
+      dc->rebalance(toSend, toRecv);
+      for (auto& m : toRecv){
+        dc->free_temp_buffer(m.buf, m.size);
+      }
+    });
+    rep.add("migration_bandwidth", "bytes", bytes, double(nobj) * bytes / t / 1e6, "MB/s");
+  }
+
+  for (int per_rank = 1; per_rank <= (1<<14); per_rank *= 8){
+    int nelems = per_rank * size;
+    auto mpi_coll = dc->make_local_collection<int>(nelems);
+    for (int i=0; i < per_rank; ++i){
+      mpi_coll->emplaceLocal(rank*per_rank + i);
+    }
+    double t = bench::time_op(niter, [&]{
+      auto phase = dc->make_phase(mpi_coll);
+    });
+    rep.add("global_mapping", "elements", nelems, t * 1e6, "us");
+  }
+
+  rep.write(out);
+  return 0;
+}
+
+int main(int argc, char** argv)
+{
+  MPI_Init(&argc, &argv);
+  //the context must be gone before MPI is finalized
+  int rc = run(argc, argv);
+  MPI_Finalize();
+  return rc;
+}
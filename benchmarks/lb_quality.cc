@@ -0,0 +1,240 @@
+#include "mpi_backend.h"
+#include "bench_util.h"
+#include <algorithm>
+#include <cmath>
+#include <set>
+
+/**
+ * Feed synthetic load distributions straight into balance() for every
+ * compiled load balancer and report how well and how cheaply each one
+ * balances. The sweep runs on 2, 4, 8, ... ranks up to the launch size, e.g.
+ *   mpirun -np 16 --oversubscribe ./bench_lb_quality 64 10 lb.json
+ * For every strategy, distribution and rank count it reports, per step:
+ *   imbalance_before/after - max/avg rank load
+ *   migrated               - elements that changed rank
+ *   migrated_inter_node    - of those, elements that changed node (see --ranks-per-node)
+ *   bytes_moved            - the size of the migrated elements
+ *   lb_time                - wall time of balance(), max over ranks
+ *   rounds                 - pairwise exchange rounds balance() needed to converge
+ */
+
+enum distribution_t {
+  Uniform,     //every element costs between 0.5 and 1.5 units
+  HeavyTailed, //Pareto costs, a few elements dominate
+  Hotspot,     //a contiguous 5% of the elements cost 10x
+  Drifting,    //a 10x bump that moves through the index space every step
+  Skewed,      //costs grow 64x along the index space, so the last ranks start overloaded
+  NumDistributions
+};
+
+static const char* distribution_names[] = {
+  "uniform", "heavy_tailed", "hotspot", "drifting", "skewed"
+};
+
+static const double base_weight = 1e6;
+
+/** A random value in [0,1) that only depends on x */
+static double hash_unit(uint64_t x){
+  //splitmix64 finalizer
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  x = x ^ (x >> 31);
+  return (x >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static uint64_t weight(distribution_t dist, uint64_t idx, uint64_t nelems,
+                       int step, int nsteps){
+  double u = hash_unit(idx);
+  double w = base_weight;
+  switch(dist){
+    case Uniform:
+      w *= 0.5 + u;
+      break;
+    case HeavyTailed:
+      w *= std::min(100.0, std::pow(1.0 - u, -1.0/1.5));
+      break;
+    case Hotspot: {
+      uint64_t start = nelems / 3;
+      uint64_t width = std::max<uint64_t>(1, nelems / 20);
+      w *= (idx >= start && idx < start + width) ? 10 : 1;
+      w *= 0.9 + 0.2*u;
+      break;
+    }
+    case Drifting: {
+      double center = nelems * (0.25 + 0.5 * step / double(std::max(1, nsteps - 1)));
+      double width = std::max(1.0, nelems / 20.0);
+      double d = (idx - center) / width;
+      w *= 1.0 + 9.0*std::exp(-d*d);
+      w *= 0.9 + 0.2*u;
+      break;
+    }
+    case Skewed:
+      w *= std::pow(64.0, idx / double(nelems));
+      w *= 0.9 + 0.2*u;
+      break;
+    default:
+      break;
+  }
+  return std::max<uint64_t>(1, w);
+}
+
+static uint64_t object_bytes(uint64_t idx){
+  return 1024 * (1 + uint64_t(hash_unit(idx ^ 0x5bd1e995) * 64));
+}
+
+struct step_result {
+  double imbalance_before = 0;
+  double imbalance_after = 0;
+  double migrated = 0;
+  double migrated_inter = 0;
+  double bytes = 0;
+  double lb_time = 0;
+  double rounds = 0;
+};
+
+static double imbalance(uint64_t localLoad, MPI_Comm comm){
+  int nranks; MPI_Comm_size(comm, &nranks);
+  uint64_t maxLoad, totalLoad;
+  MPI_Allreduce(&localLoad, &maxLoad, 1, MPI_UINT64_T, MPI_MAX, comm);
+  MPI_Allreduce(&localLoad, &totalLoad, 1, MPI_UINT64_T, MPI_SUM, comm);
+  return maxLoad / (double(totalLoad) / nranks);
+}
+
+static step_result run_strategy(MpiBackend& be, MPI_Comm comm, distribution_t dist,
+                                int per_rank, int nsteps){
+  int rank; MPI_Comm_rank(comm, &rank);
+  int nranks; MPI_Comm_size(comm, &nranks);
+  uint64_t nelems = uint64_t(per_rank) * nranks;
+
+  std::vector<uint64_t> local(per_rank);
+  std::vector<int> owner(nelems);
+  for (int i=0; i < per_rank; ++i){
+    local[i] = uint64_t(rank) * per_rank + i;
+  }
+  for (uint64_t idx=0; idx < nelems; ++idx){
+    owner[idx] = idx / per_rank;
+  }
+  darma_backend::node_topology& topo = be.lb_topology();
+
+  step_result avg;
+  for (int step=0; step < nsteps; ++step){
+    std::vector<MpiBackend::pair64> config;
+    darma_backend::lb::object_sizes sizes;
+    uint64_t loadBefore = 0;
+    for (uint64_t idx : local){
+      uint64_t w = weight(dist, idx, nelems, step, nsteps);
+      config.emplace_back(w, idx);
+      sizes[idx] = object_bytes(idx);
+      loadBefore += w;
+    }
+    std::set<uint64_t> before(local.begin(), local.end());
+
+    MPI_Barrier(comm);
+    double t_start = MPI_Wtime();
+    auto newConfig = be.balance(std::move(config), sizes);
+    double t_lb = MPI_Wtime() - t_start;
+
+    uint64_t loadAfter = 0;
+    uint64_t migrated[3] = {0, 0, 0}; //elements, bytes, elements between nodes
+    std::vector<int> newOwner(nelems, 0);
+    local.clear();
+    for (auto& pair : newConfig){
+      uint64_t idx = pair.second;
+      local.push_back(idx);
+      newOwner[idx] = rank;
+      loadAfter += weight(dist, idx, nelems, step, nsteps);
+      if (before.find(idx) == before.end()){
+        migrated[0] += 1;
+        migrated[1] += object_bytes(idx);
+        if (topo.node_of_rank[owner[idx]] != topo.node_id){
+          migrated[2] += 1;
+        }
+      }
+    }
+    MPI_Allreduce(newOwner.data(), owner.data(), nelems, MPI_INT, MPI_SUM, comm);
+
+    uint64_t count = local.size();
+    uint64_t totalCount;
+    MPI_Allreduce(&count, &totalCount, 1, MPI_UINT64_T, MPI_SUM, comm);
+    if (totalCount != nelems){
+      std::cerr << "load balancer lost elements: have " << totalCount
+                << " of " << nelems << std::endl;
+      MPI_Abort(comm, 1);
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, migrated, 3, MPI_UINT64_T, MPI_SUM, comm);
+    MPI_Allreduce(MPI_IN_PLACE, &t_lb, 1, MPI_DOUBLE, MPI_MAX, comm);
+
+    avg.imbalance_before += imbalance(loadBefore, comm) / nsteps;
+    avg.imbalance_after += imbalance(loadAfter, comm) / nsteps;
+    avg.migrated += double(migrated[0]) / nsteps;
+    avg.bytes += double(migrated[1]) / nsteps;
+    avg.migrated_inter += double(migrated[2]) / nsteps;
+    avg.lb_time += t_lb / nsteps;
+    avg.rounds += double(be.last_balance_rounds()) / nsteps;
+  }
+  return avg;
+}
+
+void usage(std::ostream& os){
+  os << "Usage: ./bench_lb_quality <elements_per_rank> <nsteps> [out.json] [-- backend args]";
+}
+
+int main(int argc, char** argv)
+{
+  MPI_Init(&argc, &argv);
+  int rank; MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  int size; MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+  int app_argc = argc;
+  for (int i=1; i < argc; ++i){
+    if (std::string(argv[i]) == "--"){
+      app_argc = i;
+      break;
+    }
+  }
+  if (app_argc < 3){
+    if (rank == 0){
+      usage(std::cerr);
+      std::cerr << std::endl;
+    }
+    MPI_Finalize();
+    return 1;
+  }
+
+  int per_rank = atoi(argv[1]);
+  int nsteps = atoi(argv[2]);
+  std::string out = app_argc > 3 ? argv[3] : "";
+  bench::report rep("lb_quality");
+
+  for (int nranks = std::min(2, size); nranks <= size; nranks *= 2){
+    MPI_Comm comm;
+    MPI_Comm_split(MPI_COMM_WORLD, rank < nranks ? 0 : MPI_UNDEFINED, rank, &comm);
+    if (comm == MPI_COMM_NULL) continue;
+
+    {
+      auto dc = allocate_context(comm, argc, argv);
+      for (auto& lb : MpiBackend::load_balancers()){
+        dc->set_load_balancer(lb);
+        for (int d=0; d < NumDistributions; ++d){
+          auto dist = distribution_t(d);
+          step_result res = run_strategy(*dc, comm, dist, per_rank, nsteps);
+          std::string prefix = lb + "." + distribution_names[d] + ".";
+          rep.add(prefix + "imbalance_before", "ranks", nranks, res.imbalance_before, "max/avg");
+          rep.add(prefix + "imbalance_after", "ranks", nranks, res.imbalance_after, "max/avg");
+          rep.add(prefix + "migrated", "ranks", nranks, res.migrated, "elements/step");
+          rep.add(prefix + "migrated_inter_node", "ranks", nranks, res.migrated_inter, "elements/step");
+          rep.add(prefix + "bytes_moved", "ranks", nranks, res.bytes, "bytes/step");
+          rep.add(prefix + "lb_time", "ranks", nranks, res.lb_time * 1e3, "ms/step");
+          rep.add(prefix + "rounds", "ranks", nranks, res.rounds, "rounds/step");
+        }
+      }
+    }
+    MPI_Comm_free(&comm);
+  }
+
+  rep.write(out);
+  MPI_Finalize();
+  return 0;
+}
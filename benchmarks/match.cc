@@ -0,0 +1,153 @@
+#include "match_table.h"
+#include "bench_util.h"
+#include <list>
+#include <map>
+
+/**
+ * Rate of matching point-to-point messages against receives, comparing the
+ * flat match table with the tree-of-lists layout it replaced:
+ *   match_expected_{table,map}   - receives wait, then their messages arrive
+ *   match_unexpected_{table,map} - messages arrive, then their receives
+ * swept over the number of matches outstanding at once. Each rank runs
+ * alone, no messages are sent.
+ * Run as
+ *   ./bench_match <niter> [out.json]
+ */
+
+struct Entry {
+  void* pending = nullptr;
+  int id = -1;
+  Entry* next = nullptr;
+};
+
+using table_t = darma_backend::match_table<Entry>;
+
+//sources and tags laid out like the runtime's collection/element tags
+static void make_key(int i, int& source, int& tag){
+  source = i % 8;
+  int j = i / 8;
+  tag = (j % 16) << 16 | ((j / 16) % 64) << 10 | ((j / 1024) % 64) << 4;
+}
+
+struct table_matcher {
+  table_t t;
+
+  void expect(int source, int tag, void* pending){
+    Entry* e = t.allocate();
+    e->pending = pending;
+    t.push_back(t.key(source, tag), e);
+  }
+
+  void* arrive(int source, int tag){
+    uint64_t k = t.key(source, tag);
+    Entry* e = t.front(k);
+    if (e && e->pending){
+      void* ret = e->pending;
+      t.release(t.pop_front(k));
+      return ret;
+    }
+    e = t.allocate();
+    e->id = tag;
+    t.push_back(k, e);
+    return nullptr;
+  }
+
+  int match_posted(int source, int tag){
+    uint64_t k = t.key(source, tag);
+    Entry* e = t.pop_front(k);
+    int id = e->id;
+    t.release(e);
+    return id;
+  }
+};
+
+struct map_matcher {
+  struct posted {
+    int id;
+  };
+  std::map<int,std::list<posted>> queued;
+  std::map<int,std::map<int,std::list<void*>>> pending;
+
+  void expect(int source, int tag, void* p){
+    pending[source][tag].push_back(p);
+  }
+
+  void* arrive(int source, int tag){
+    auto& rankMap = pending[source];
+    auto iter = rankMap.find(tag);
+    if (iter != rankMap.end()){
+      void* ret = iter->second.front();
+      iter->second.pop_front();
+      if (iter->second.empty()) rankMap.erase(iter);
+      return ret;
+    }
+    queued[tag].push_back(posted{tag});
+    return nullptr;
+  }
+
+  int match_posted(int source, int tag){
+    auto iter = queued.find(tag);
+    int id = iter->second.front().id;
+    iter->second.pop_front();
+    if (iter->second.empty()) queued.erase(iter);
+    return id;
+  }
+};
+
+static long g_sink = 0;
+
+template <class Matcher>
+void run_expected(Matcher& m, int n){
+  int source, tag;
+  for (int i=0; i < n; ++i){
+    make_key(i, source, tag);
+    m.expect(source, tag, &g_sink);
+  }
+  for (int i=0; i < n; ++i){
+    make_key(i, source, tag);
+    g_sink += m.arrive(source, tag) != nullptr;
+  }
+}
+
+template <class Matcher>
+void run_unexpected(Matcher& m, int n){
+  int source, tag;
+  for (int i=0; i < n; ++i){
+    make_key(i, source, tag);
+    g_sink += m.arrive(source, tag) != nullptr;
+  }
+  for (int i=0; i < n; ++i){
+    make_key(i, source, tag);
+    g_sink += m.match_posted(source, tag);
+  }
+}
+
+int main(int argc, char** argv)
+{
+  MPI_Init(&argc, &argv);
+  if (argc < 2){
+    std::cerr << "Usage: ./bench_match <niter> [out.json]" << std::endl;
+    MPI_Finalize();
+    return 1;
+  }
+  int niter = atoi(argv[1]);
+  std::string out = argc > 2 ? argv[2] : "";
+  bench::report rep("match");
+
+  for (int n = 64; n <= 16384; n *= 4){
+    table_matcher table;
+    map_matcher tree;
+    double t = bench::time_op(niter, [&]{ run_expected(table, n); });
+    rep.add("match_expected_table", "outstanding", n, n / t / 1e6, "Mmatch/s");
+    t = bench::time_op(niter, [&]{ run_expected(tree, n); });
+    rep.add("match_expected_map", "outstanding", n, n / t / 1e6, "Mmatch/s");
+    t = bench::time_op(niter, [&]{ run_unexpected(table, n); });
+    rep.add("match_unexpected_table", "outstanding", n, n / t / 1e6, "Mmatch/s");
+    t = bench::time_op(niter, [&]{ run_unexpected(tree, n); });
+    rep.add("match_unexpected_map", "outstanding", n, n / t / 1e6, "Mmatch/s");
+  }
+
+  rep.write(out);
+  MPI_Finalize();
+  return 0;
+}
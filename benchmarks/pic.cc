@@ -0,0 +1,207 @@
+#include "mpi_backend.h"
+#include "bench_util.h"
+#include <cmath>
+
+/**
+ * Particle push on a periodic 1D domain cut into patches. Particles that
+ * leave a patch are sent to the neighbor in their direction of travel with
+ * put_task, and a patch forwards whatever only passes through it, so fast
+ * particles set off chains of messages no receiver can anticipate. Every
+ * step is an idempotent phase that ends by termination detection.
+ *   pic_step_time     - one push and all the migration it causes
+ *   pic_particle_rate - particles pushed per second
+ *   pic_messages      - put_task messages per step
+ *   pic_peak_unexpected - most unexpected message bytes on any rank, which
+ *                         --unexpected-mem-cap bounds
+ * Run as
+ *   mpirun -np 4 ./bench_pic <patches_per_rank> <particles_per_patch> <nsteps> [out.json] -- <backend args>
+ */
+
+using Context=Frontend<MpiBackend>;
+
+//most particles stay put, a tenth cross up to this many patches per step
+static const double max_fast_patches = 4.0;
+
+struct Patch {
+  int index = -1;
+  int npatches = 0;
+  std::vector<double> x;
+  std::vector<double> v;
+  //leaving to the left (0) and to the right (1)
+  std::vector<double> outX[2];
+  std::vector<double> outV[2];
+
+  bool contains(double pos) const {
+    return int(pos * npatches) == index;
+  }
+};
+
+//particles owned and messages unpacked on this rank
+static long g_particles = 0;
+static long g_messages = 0;
+
+static double hash_unit(uint64_t x){
+  //splitmix64 finalizer
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  x = x ^ (x >> 31);
+  return (x >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static int neighbor(const Patch& p, int dir){
+  return dir == 1 ? (p.index + 1) % p.npatches
+                  : (p.index - 1 + p.npatches) % p.npatches;
+}
+
+struct Migrate {
+  template <class Archive>
+  static void pack(Patch& p, Archive& ar, int dir){
+    ar | p.outX[dir];
+    ar | p.outV[dir];
+    ar | dir;
+  }
+
+  template <class Archive>
+  static void compute_size(Patch& p, Archive& ar, int dir){
+    pack(p, ar, dir);
+  }
+
+  static void send(Context* ctx, async_ref_ii<Patch>& p, int dir){
+    if (p->outX[dir].empty()) return;
+    int nbr = neighbor(*p, dir);
+    p = ctx->put_task<Migrate>(nbr, std::move(p), dir);
+    p->outX[dir].clear();
+    p->outV[dir].clear();
+  }
+
+  template <class Archive>
+  static void unpack(Context* ctx, async_ref_ii<Patch> p, Archive& ar){
+    std::vector<double> x, v;
+    int dir;
+    ar | x;
+    ar | v;
+    ar | dir;
+    ++g_messages;
+    for (int i=0; i < x.size(); ++i){
+      if (p->contains(x[i])){
+        p->x.push_back(x[i]);
+        p->v.push_back(v[i]);
+        ++g_particles;
+      } else {
+        //only passing through
+        p->outX[dir].push_back(x[i]);
+        p->outV[dir].push_back(v[i]);
+      }
+    }
+    send(ctx, p, dir);
+  }
+};
+
+struct Push {
+  void operator()(Context* ctx, int index, int npatches, int per_patch,
+                  async_ref_ii<Patch> p){
+    double width = 1.0 / npatches;
+    if (p->index < 0){
+      p->index = index;
+      p->npatches = npatches;
+      for (int i=0; i < per_patch; ++i){
+        uint64_t id = uint64_t(index) * per_patch + i;
+        double u = hash_unit(id);
+        double speed = u < 0.1 ? max_fast_patches * width * hash_unit(~id)
+                               : 0.5 * width * hash_unit(~id);
+        p->x.push_back((index + hash_unit(id ^ 0x5bd1e995)) * width);
+        p->v.push_back(u < 0.05 || (u >= 0.1 && u < 0.55) ? -speed : speed);
+      }
+      g_particles += per_patch;
+    }
+
+    int kept = 0;
+    for (int i=0; i < p->x.size(); ++i){
+      double x = p->x[i] + p->v[i];
+      x -= std::floor(x);
+      if (x >= 1.0) x = 0; //rounding of tiny negative positions
+      if (p->contains(x)){
+        p->x[kept] = x;
+        p->v[kept] = p->v[i];
+        ++kept;
+      } else {
+        int dir = p->v[i] > 0 ? 1 : 0;
+        p->outX[dir].push_back(x);
+        p->outV[dir].push_back(p->v[i]);
+        --g_particles;
+      }
+    }
+    p->x.resize(kept);
+    p->v.resize(kept);
+
+    Migrate::send(ctx, p, 0);
+    Migrate::send(ctx, p, 1);
+  }
+};
+
+static auto migrate_task = recv_task_id<Migrate,Patch,int>();
+
+void usage(std::ostream& os){
+  os << "Usage: ./bench_pic <patches_per_rank> <particles_per_patch> <nsteps> [out.json] [-- backend args]";
+}
+
+int run(int argc, char** argv)
+{
+  int rank; MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  int size; MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+  auto dc = allocate_context(MPI_COMM_WORLD, argc, argv);
+  int app_argc = dc->split_argv(argc, argv);
+  if (app_argc < 4){
+    if (rank == 0){
+      usage(std::cerr);
+      std::cerr << std::endl;
+    }
+    return 1;
+  }
+
+  int per_rank = atoi(argv[1]);
+  int per_patch = atoi(argv[2]);
+  int nsteps = atoi(argv[3]);
+  std::string out = app_argc > 4 ? argv[4] : "";
+  bench::report rep("pic");
+
+  int npatches = per_rank * size;
+  long nparticles = long(npatches) * per_patch;
+  auto phase = dc->make_phase(npatches);
+  auto patches = dc->make_collection<Patch>(npatches);
+
+  double t = bench::time_op(nsteps, [&]{
+    std::tie(patches) = dc->create_phase_idempotent_work<Push>(phase, npatches, per_patch,
+                                                               std::move(patches));
+  });
+
+  long counts[2] = {g_particles, g_messages};
+  MPI_Allreduce(MPI_IN_PLACE, counts, 2, MPI_LONG, MPI_SUM, MPI_COMM_WORLD);
+  if (counts[0] != nparticles){
+    std::cerr << "particles lost in migration: have " << counts[0]
+              << " of " << nparticles << std::endl;
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+
+  rep.add("pic_step_time", "particles", nparticles, t * 1e3, "ms");
+  rep.add("pic_particle_rate", "particles", nparticles, nparticles / t / 1e6, "Mparticles/s");
+  rep.add("pic_messages", "particles", nparticles, double(counts[1]) / nsteps, "messages/step");
+  uint64_t peak = dc->peak_unexpected_bytes();
+  MPI_Allreduce(MPI_IN_PLACE, &peak, 1, MPI_UINT64_T, MPI_MAX, MPI_COMM_WORLD);
+  rep.add("pic_peak_unexpected", "particles", nparticles, peak / 1024.0, "KB");
+
+  rep.write(out);
+  dc->flush();
+  return 0;
+}
+
+int main(int argc, char** argv)
+{
+  MPI_Init(&argc, &argv);
+  //the context must be gone before MPI is finalized
+  int rc = run(argc, argv);
+  MPI_Finalize();
+  return rc;
+}
@@ -0,0 +1,93 @@
+#include "mpi_backend.h"
+#include "bench_util.h"
+
+/**
+ * Measure the cost of creating and running tasks:
+ *   create_work      - empty single tasks, created then flushed
+ *   phase_generation - one empty phase task per element of a collection
+ *   concurrent_work  - a rank-local loop, on as many threads as --threads gives
+ * Run as
+ *   mpirun -np 4 ./bench_tasks <niter> [out.json] -- <backend args>
+ */
+
+using Context=Frontend<MpiBackend>;
+
+//tasks need at least one async_ref to be scheduled
+struct Empty {
+  void operator()(Context* ctx, async_ref_mm<int> ref){}
+};
+
+struct EmptyPhase {
+  void operator()(Context* ctx, int index, async_ref_mm<int> elem){}
+};
+
+struct Touch {
+  void operator()(Context* ctx, int index, async_ref_base<std::vector<double>>& data){
+    (*data)[index] += 1.0;
+  }
+};
+
+void usage(std::ostream& os){
+  os << "Usage: ./bench_tasks <niter> [out.json] [-- backend args]";
+}
+
+int run(int argc, char** argv)
+{
+  int rank; MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  int size; MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+  auto dc = allocate_context(MPI_COMM_WORLD, argc, argv);
+  int app_argc = dc->split_argv(argc, argv);
+  if (app_argc < 2){
+    if (rank == 0){
+      usage(std::cerr);
+      std::cerr << std::endl;
+    }
+    return 1;
+  }
+
+  int niter = atoi(argv[1]);
+  std::string out = app_argc > 2 ? argv[2] : "";
+  bench::report rep("tasks");
+
+  for (int ntasks = 1; ntasks <= 4096; ntasks *= 8){
+    double t = bench::time_op(niter, [&]{
+      for (int i=0; i < ntasks; ++i){
+        dc->create_work<Empty>(dc->make_async_ref<int>());
+      }
+      dc->flush();
+    });
+    rep.add("create_work", "tasks", ntasks, t / ntasks * 1e9, "ns/task");
+  }
+
+  for (int per_rank = 1; per_rank <= 1024; per_rank *= 4){
+    int nelems = per_rank * size;
+    auto phase = dc->make_phase(nelems);
+    auto coll = dc->make_collection<int>(nelems);
+    double t = bench::time_op(niter, [&]{
+      std::tie(coll) = dc->create_phase_work<EmptyPhase>(phase, std::move(coll));
+      dc->flush();
+    });
+    rep.add("phase_generation", "elements", nelems, t * 1e6, "us/phase");
+  }
+
+  for (int n = 1; n <= (1<<20); n *= 16){
+    auto data = dc->make_async_ref<std::vector<double>>(n, 0.0);
+    double t = bench::time_op(niter, [&]{
+      std::tie(data) = dc->create_concurrent_work<Touch>(n, std::move(data));
+    });
+    rep.add("concurrent_work", "indices", n, t / n * 1e9, "ns/index");
+  }
+
+  rep.write(out);
+  return 0;
+}
+
+int main(int argc, char** argv)
+{
+  MPI_Init(&argc, &argv);
+  //the context must be gone before MPI is finalized
+  int rc = run(argc, argv);
+  MPI_Finalize();
+  return rc;
+}
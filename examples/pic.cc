@@ -43,7 +43,10 @@ struct DarmaSwarm {
    static auto sendMigrants(Context* ctx, async_ref_ii<Swarm> swarm){
      auto& bounds = swarm->boundaries();
      for (int b=0; b < bounds.size(); ++b){
+       //only forward what is still moving, or the exchange never settles
+       if (swarm->migrants_[b].empty()) continue;
        swarm = ctx->put_task<DarmaSwarm::Migrate>(bounds[b],std::move(swarm),b);
+       swarm->migrants_[b].clear();
      }
      return std::make_tuple(std::move(swarm));
    }
@@ -115,7 +118,8 @@ int main(int argc, char** argv)
     // overdecompose(rank,mainPatch,idx,patch);
     //}
     auto part_coll = dc->from_mpi<DarmaSwarm::MpiIn>(std::move(mpi_swarm));
-    std::tie(part_coll) = dc->create_phase_window<DarmaSwarm::Move>(ph, std::move(part_coll));
+    //ends once no rank has migrants in flight
+    std::tie(part_coll) = dc->create_phase_idempotent_work<DarmaSwarm::Move>(ph, std::move(part_coll));
     mpi_swarm = dc->to_mpi<DarmaSwarm::MpiOut>(std::move(part_coll));
     //un-overdecompose
     //for (auto& pair : coll){
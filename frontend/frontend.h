@@ -31,6 +31,23 @@ struct Frontend : public Backend {
     return ret;
   }
 
+  /**
+   * Send the same payload from local to every index in remotes. The accessor
+   * packs it once, without a remote index, and every receiver posts an
+   * ordinary recv for it.
+   * @param remotes A container of the receiving indices
+   */
+  template <class Accessor, class LocalIndex, class Remotes,
+            class T, class Imm, class Sched, class... Args>
+  auto send_many(LocalIndex&& local, const Remotes& remotes, async_ref<T,Imm,Sched>&& input, Args&&... args){
+    using retType = typename DefaultSequencer::NewPermissions<ReadOnly,T,Imm,Sched>::type_t;
+    auto ret = retType::clone(&input);
+    auto op = Backend::template make_send_many_op<Accessor>(std::move(input),
+      std::forward<LocalIndex>(local), remotes, std::forward<Args>(args)...);
+    Backend::register_send_op(std::move(op));
+    return ret;
+  }
+
   /**
    * Given a static accessor, perform the necessary sequencing operation,
    * post a recv (or recv descriptor)
@@ -63,6 +80,21 @@ struct Frontend : public Backend {
     return ret;
   }
 
+  /**
+   * A put_task of the same payload to every index in targets, packed once
+   * @param targets A container of the target indices
+   */
+  template <class Accessor, class Indices,
+            class T, class Imm, class Sched,
+            class... Args>
+  auto put_task_many(const Indices& targets, async_ref<T,Imm,Sched>&& input, Args&&... args){
+    auto ret = async_ref<T,typename min_permissions<Idempotent,Imm>::type_t,Sched>::clone(&input);
+    auto op = Backend::template make_active_send_many_op<Accessor>
+        (std::move(input), targets, std::forward<Args>(args)...);
+    Backend::register_active_send_op(std::move(op));
+    return ret;
+  }
+
   template <class T, class Imm, class Sched>
   auto modify(async_ref<T,Imm,Sched>&& in){
     //recv is forcibly deferred
@@ -159,7 +191,7 @@ struct Frontend : public Backend {
    * @param ph      The phase object of type Phase
    * @param root    The root rank used for the gather operation
    * @param coll    The collection to gather
-   * @return        A tuple containing a vector of all elements in the collection, in rank order
+   * @return        A tuple containing a vector of all elements in the collection, in index order
    */
   template <class Phase, class Idx, class T>
   auto phase_gather(Phase& ph, int root, async_ref<collection<T, Idx>, None, Modify>&& coll) {
@@ -170,6 +202,27 @@ struct Frontend : public Backend {
     
     return std::make_tuple(async_ref<std::vector<T>, None, Modify>::make(std::move(registered)));
   }
+
+  /**
+   * Perform a streaming gather operation with the current phase on the specified collection.
+   * Instead of building the whole collection on root, each element is handed to consume
+   * as it arrives. Use this when the collection does not fit in the memory of one rank.
+   *
+   * @tparam Phase    The type of phase (deduced)
+   * @tparam Idx      The index type used in the collection (deduced)
+   * @tparam T        The type stored in the collection (deduced)
+   * @tparam Consumer Callable as consume(int index, T&& value) (deduced)
+   * @param ph        The phase object of type Phase
+   * @param root      The root rank used for the gather operation
+   * @param coll      The collection to gather
+   * @param consume   Invoked on root for every element, grouped by rank in rank order
+   */
+  template <class Phase, class Idx, class T, class Consumer>
+  void phase_gather_stream(Phase& ph, int root, async_ref<collection<T, Idx>, None, Modify>&& coll,
+                           Consumer&& consume) {
+    Backend::template register_phase_gather_stream(ph, root, std::move(coll),
+                                                   std::forward<Consumer>(consume));
+  }
   
   /**
    * Perform a broadcast operation from the root onto all ranks in a phase.
@@ -254,17 +307,33 @@ struct Frontend : public Backend {
     return out;
   }
 
-  template <class Functor, class Idx, class Imm, class Sched, class... Args>
-  auto create_concurrent_work(Idx sizes, Args&&... args){
+  /**
+   * Run Functor()(ctx, index, args...) for every index in [0,size) on this rank,
+   * spread over the backend threads if there are any. Unlike phase work this
+   * needs no phase or global mapping and creates no tasks, which suits short
+   * loops between phases. The indices may run concurrently, so the functor
+   * must not create work or send messages.
+   *
+   * @tparam Functor The loop body. It takes an async_ref<T,...> argument as async_ref_base<T>&.
+   * @tparam Idx     An integral index type (deduced)
+   * @param size     The number of indices
+   * @param args     The arguments shared by all indices, at least one of them an async_ref
+   * @return         The async_ref arguments for use after the loop
+   */
+  template <class Functor, class Idx, class... Args>
+  auto create_concurrent_work(Idx size, Args&&... args){
     auto out = output_tuple_selector<mod_return_type_selector,sizeof...(Args),
                                      std::remove_reference_t<Args>...>()(args...);
 
-    using fe_task_t = GeneratorTask<Context,Functor,std::remove_reference_t<Args>...>;
+    using fe_task_t = typename task_type_selector<
+        GeneratorTask, Context, Functor,
+        sizeof...(Args),
+        std::remove_reference_t<Args>...>::type_t;
 
     fe_task_t fe_task(std::forward<Args>(args)...);
     tuple_sequencer<sizeof...(Args),0,0,fe_task_t,decltype(out)>()(this,fe_task,out);
 
-    //some sort of registration
+    Backend::register_concurrent_work(size, fe_task);
 
     return out;
   }
@@ -320,11 +389,11 @@ struct Frontend : public Backend {
     fe_task_t fe_task(std::forward<Args>(args)...);
     tuple_sequencer<sizeof...(Args),0,0,fe_task_t,decltype(out)>()(this,fe_task,out);
 
-    //auto terminator = Backend::make_termination_detection();
-    //add the termination detection info to all elements in the task tuple
+    tuple_apply_all_collection<sizeof...(Args), 0>()(fe_task.getArgs(), InitIndexing<Phase>(ph));
 
-    //some sort of registration
-    //Backend::register_phase_idempotent_collection(ph, std::move(terminator), std::move(fe_task));
+    //the phase ends once every put_task it set off, directly or not, was delivered
+    auto terminator = Backend::make_termination_detection();
+    Backend::register_phase_idempotent_collection(ph, std::move(terminator), std::move(fe_task));
 
     return out;
   }
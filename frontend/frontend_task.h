@@ -128,6 +128,16 @@ struct GeneratorTask : public FrontendTaskBase<Context,Functor,Args...> {
       ctx, arg, std::make_index_sequence<size>{}); 
   }
 
+  /**
+   * @brief Run the functor for one index right away, without making a task.
+   *        Every index shares the arguments, which are passed as l-values.
+   */
+  template <class GeneratorArg>
+  void invoke(Context* ctx, GeneratorArg& arg){
+    static constexpr auto size = sizeof...(Args);
+    Parent::callWithArg(Functor(), ctx, arg, std::make_index_sequence<size>{});
+  }
+
 };
 
 #endif
@@ -1,5 +1,9 @@
 #include <mpi.h>
 #include "mpi_helpers.h"
+#include "broadcast.h"
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
 
 namespace darma_backend {
   namespace detail {
@@ -13,5 +17,107 @@ namespace darma_backend {
       
       MPI_Bcast(buff.data(), local_size, MPI_BYTE, root, comm);
     }
+
+    static int
+    chunk_bytes(std::size_t total, std::size_t chunk) {
+      return static_cast< int >(std::min(broadcast_chunk_size, total - chunk*broadcast_chunk_size));
+    }
+
+    static void
+    broadcast_chunked(char* data, std::size_t bytes, int root, MPI_Comm comm) {
+      std::size_t nchunks = (bytes + broadcast_chunk_size - 1) / broadcast_chunk_size;
+      std::vector<MPI_Request> reqs(nchunks);
+      for (std::size_t c = 0; c < nchunks; ++c){
+        if (c >= broadcast_pipeline_depth){
+          MPI_Wait(&reqs[c - broadcast_pipeline_depth], MPI_STATUS_IGNORE);
+        }
+        MPI_Ibcast(data + c*broadcast_chunk_size, chunk_bytes(bytes, c), MPI_BYTE,
+                   root, comm, &reqs[c]);
+      }
+      MPI_Waitall(reqs.size(), reqs.data(), MPI_STATUSES_IGNORE);
+    }
+
+    static void
+    broadcast_chunked(char* data, std::size_t bytes, int root, node_topology& topo) {
+      std::size_t nchunks = (bytes + broadcast_chunk_size - 1) / broadcast_chunk_size;
+      int root_node = topo.node_of_rank[root];
+      int root_node_rank = topo.node_rank_of[root];
+
+      static const int forward_tag = 2;
+      if (root_node_rank != 0 && topo.node_id == root_node){
+        std::vector<MPI_Request> reqs(nchunks);
+        for (std::size_t c = 0; c < nchunks; ++c){
+          char* chunk = data + c*broadcast_chunk_size;
+          if (topo.rank == root){
+            MPI_Isend(chunk, chunk_bytes(bytes, c), MPI_BYTE, 0, forward_tag, topo.node, &reqs[c]);
+          } else if (topo.is_leader()){
+            MPI_Irecv(chunk, chunk_bytes(bytes, c), MPI_BYTE, root_node_rank, forward_tag,
+                      topo.node, &reqs[c]);
+          } else {
+            reqs[c] = MPI_REQUEST_NULL;
+          }
+        }
+        MPI_Waitall(reqs.size(), reqs.data(), MPI_STATUSES_IGNORE);
+      }
+
+      // Leaders broadcast chunk c+1 while their nodes are broadcasting chunk c
+      std::vector<MPI_Request> leader_reqs(nchunks, MPI_REQUEST_NULL);
+      if (topo.is_leader() && topo.num_nodes > 1){
+        for (std::size_t c = 0; c < nchunks; ++c){
+          MPI_Ibcast(data + c*broadcast_chunk_size, chunk_bytes(bytes, c), MPI_BYTE,
+                     root_node, topo.leaders, &leader_reqs[c]);
+        }
+      }
+      std::vector<MPI_Request> node_reqs(nchunks);
+      for (std::size_t c = 0; c < nchunks; ++c){
+        MPI_Wait(&leader_reqs[c], MPI_STATUS_IGNORE);
+        MPI_Ibcast(data + c*broadcast_chunk_size, chunk_bytes(bytes, c), MPI_BYTE,
+                   0, topo.node, &node_reqs[c]);
+      }
+      MPI_Waitall(node_reqs.size(), node_reqs.data(), MPI_STATUSES_IGNORE);
+    }
+
+    template <class Comm>
+    static serialization_buffer
+    broadcast_eager(serialization_buffer &&buff, int root, Comm &comm) {
+      static constexpr std::size_t eager_data_size = broadcast_eager_size - sizeof(std::uint64_t);
+
+      int rank = comm_rank(comm);
+
+      serialization_buffer eager(broadcast_eager_size);
+      std::uint64_t total_size = 0;
+      if (rank == root){
+        total_size = buff.capacity();
+        ::memcpy(eager.data(), &total_size, sizeof(std::uint64_t));
+        ::memcpy(eager.data() + sizeof(std::uint64_t), buff.data(),
+                 std::min<std::size_t>(total_size, eager_data_size));
+      }
+
+      broadcast_internal(eager, root, comm);
+
+      ::memcpy(&total_size, eager.data(), sizeof(std::uint64_t));
+      std::size_t eager_bytes = std::min<std::size_t>(total_size, eager_data_size);
+      if (rank != root){
+        buff = serialization_buffer(static_cast< std::size_t >(total_size));
+        ::memcpy(buff.data(), eager.data() + sizeof(std::uint64_t), eager_bytes);
+      }
+
+      // Only large buffers need a second round
+      if (total_size > eager_bytes){
+        broadcast_chunked(buff.data() + eager_bytes, total_size - eager_bytes, root, comm);
+      }
+
+      return std::move(buff);
+    }
+
+    serialization_buffer
+    broadcast_serialized(serialization_buffer &&buff, int root, MPI_Comm comm) {
+      return broadcast_eager(std::move(buff), root, comm);
+    }
+
+    serialization_buffer
+    broadcast_serialized(serialization_buffer &&buff, int root, node_topology& topo) {
+      return broadcast_eager(std::move(buff), root, topo);
+    }
   }
-}
\ No newline at end of file
+}
@@ -3,10 +3,19 @@
 
 #include <async_ref.h>
 #include "mpi_helpers.h"
+#include "hierarchy.h"
 #include <mpi.h>
+#include <vector>
 
 namespace darma_backend {
   namespace detail {
+    /** Size of the first broadcast round, which carries the data size plus as much data as fits */
+    static constexpr std::size_t broadcast_eager_size = 4096;
+    /** Data beyond the eager round is broadcast in chunks of this size */
+    static constexpr std::size_t broadcast_chunk_size = 1 << 20;
+    /** Max number of chunks in flight at once */
+    static constexpr int broadcast_pipeline_depth = 4;
+
     /**
      * Broadcast contents of buff from root to other processes, writing to buff.
      * After this operation, buff will contain a copy of the data in buff from root.
@@ -18,59 +27,77 @@ namespace darma_backend {
      * @param comm The MPI communicator
      */
     void broadcast_internal(serialization_buffer &buff, int root, MPI_Comm comm = MPI_COMM_WORLD);
+
+    /**
+     * Broadcast a buffer whose size is only known on root. The size travels with
+     * the first broadcast_eager_size bytes, so small buffers take a single round.
+     * Larger buffers follow in a second round, pipelined in chunks.
+     *
+     * @param buff The data on root. Ignored on all other ranks.
+     * @param root The rank to broadcast from
+     * @param comm The MPI communicator
+     * @return     A copy of root's buffer on every rank (root's own buffer on root)
+     */
+    serialization_buffer
+    broadcast_serialized(serialization_buffer &&buff, int root, MPI_Comm comm = MPI_COMM_WORLD);
+
+    serialization_buffer
+    broadcast_serialized(serialization_buffer &&buff, int root, node_topology& topo);
   }
   
   /**
    * Perform a broadcast operation. Data broadcast by the root rank will be vailable on
    * all ranks in the communicator. This yields a collection which represents data
-   * that may not be on-rank.
+   * that may not be on-rank. Each rank deserializes a single copy, which every
+   * local index references. The copy is shared, so it should be treated as immutable.
+   *
    * @tparam    IndexType   The index type for the resulting collection
    * @tparam    T           The type of the data to broadcast
+   * @tparam    Comm        MPI_Comm for a flat broadcast or node_topology for a hierarchical one
    * @param     ref         The data to broadcast
    * @param     root        The rank of the broadcasting process
    * @param     comm        The MPI communicator to use for the broadcast
+   * @param     size        The size of the resulting collection
+   * @param     local       The indices of the resulting collection local to this rank
    * @return                The collection containing the broadcasted data
    */
-  template<typename IndexType, typename T>
+  template<typename IndexType, typename T, typename Comm>
   async_ref_base<collection<T, IndexType>>
-  broadcast(async_ref_base<T> &&ref, int root, MPI_Comm comm = MPI_COMM_WORLD) {
-    int nranks;
-    MPI_Comm_size(comm, &nranks);
-    
-    int rank;
-    MPI_Comm_rank(comm, &rank);
+  broadcast(async_ref_base<T> &&ref, int root, Comm &&comm,
+            IndexType size, const std::vector<int> &local) {
+    int rank = comm_rank(comm);
   
-    collection<T, IndexType> ret(static_cast<IndexType>(nranks));
+    collection<T, IndexType> ret(size);
     
+    std::shared_ptr<T> value;
     if (rank == root) {
-      auto buff = serializer::serialize(*ref);
-      auto datasizebuff = serializer::serialize(buff.capacity());
-      
-      // Broadcast size of data
-      detail::broadcast_internal(datasizebuff, root, comm);
-      
-      // Broadcast actual data buffer
-      detail::broadcast_internal(buff, root, comm);
-      
-      // TODO: figure out how collection should store things to avoid a memory leak here
-      ret.setElement(rank, std::make_shared<T>(std::move(*ref)));
+      detail::broadcast_serialized(serializer::serialize(*ref), root, comm);
+      // Root keeps the object it broadcast rather than a copy of it
+      value = ref.sharedPtr();
     } else {
-      auto datasizebuff = serialization_buffer(sizeof(std::size_t));
-  
-      detail::broadcast_internal(datasizebuff, root, comm);
-      auto data_size = serializer::deserialize<std::size_t>(datasizebuff);
-      
-      auto buff = serialization_buffer(data_size);
-      
-      // Get data buffer
-      detail::broadcast_internal(buff, root, comm);
-  
-      // TODO: figure out how collection should store things to avoid a memory leak here
-      ret.setElement(rank, std::make_shared<T>(serializer::deserialize<T>(buff)));
+      auto buff = detail::broadcast_serialized(serialization_buffer(0), root, comm);
+      value = std::make_shared<T>(serializer::deserialize<T>(buff));
+    }
+
+    for (int idx : local) {
+      ret.setElement(idx, value);
     }
   
     return async_ref_base<collection<T, IndexType>>::make(std::move(ret));
-  };
+  }
+
+  /**
+   * Perform a broadcast operation into a collection with one index per rank.
+   * @see broadcast
+   */
+  template<typename IndexType, typename T, typename Comm = MPI_Comm>
+  async_ref_base<collection<T, IndexType>>
+  broadcast(async_ref_base<T> &&ref, int root, Comm &&comm = MPI_COMM_WORLD) {
+    int nranks = comm_size(comm);
+    int rank = comm_rank(comm);
+    return broadcast<IndexType>(std::move(ref), root, comm,
+                                static_cast<IndexType>(nranks), std::vector<int>{rank});
+  }
 }
 
 #endif  // DARMA_BACKEND_BROADCAST_H
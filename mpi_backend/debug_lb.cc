@@ -3,27 +3,24 @@
 std::vector<MpiBackend::pair64>
 MpiBackend::debugBalance(std::vector<pair64>&& localConfig)
 {
-  int partner = getTradingPartner(rank_);
+  int partner = darma_backend::lb::trading_partner(rank_, size_);
   if (partner == rank_) return localConfig;
 
 
   int toSend = localConfig.empty() ? -1 : localConfig.back().second;
   int toRecv;
   int tag = 278;
+  //not on comm_, where a rank still probing for active messages would take it
   MPI_Sendrecv(&toSend, 1, MPI_INT, partner, tag,
                &toRecv, 1, MPI_INT, partner, tag,
-               comm_, MPI_STATUS_IGNORE);
+               migrateComm_, MPI_STATUS_IGNORE);
 
-  if (localConfig.empty()){
-    if (toRecv != -1){
-      localConfig.emplace_back(0,toRecv);
-    }
-  } else {
-    if (toRecv != -1){
-      auto& pair = localConfig.back();
-      pair.first = 0;
-      pair.second = toRecv;
-    }
+  //what was sent is gone even if nothing came back
+  if (toSend != -1){
+    localConfig.pop_back();
+  }
+  if (toRecv != -1){
+    localConfig.emplace_back(0,toRecv);
   }
   darmaDebug(LB, "Rank {} trading tasks {},{} with rank {}",
              rank_, toSend, toRecv, partner);
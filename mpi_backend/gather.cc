@@ -1,15 +1,98 @@
 #include <mpi.h>
 #include "mpi_helpers.h"
+#include "gather.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
 #include <vector>
 #include <numeric>
 #include <iostream>
 
 namespace darma_backend {
   namespace detail {
+    static const int gather_tag = 0;
+
+    static void
+    send_chunked(const char* data, std::size_t bytes, int dest, MPI_Comm comm, std::size_t max_count) {
+      std::size_t offset = 0;
+      do {
+        auto count = static_cast< int >(std::min(max_count, bytes - offset));
+        MPI_Send(data + offset, count, MPI_BYTE, dest, gather_tag, comm);
+        offset += count;
+      } while (offset < bytes);
+    }
+
+    static void
+    irecv_chunked(char* data, std::size_t bytes, int src, MPI_Comm comm, std::size_t max_count,
+                  std::vector<MPI_Request> &reqs) {
+      std::size_t offset = 0;
+      do {
+        auto count = static_cast< int >(std::min(max_count, bytes - offset));
+        reqs.emplace_back();
+        MPI_Irecv(data + offset, count, MPI_BYTE, src, gather_tag, comm, &reqs.back());
+        offset += count;
+      } while (offset < bytes);
+    }
+
+    void
+    gather_stream_internal(const serialization_buffer &buff, int root,
+                           const gather_consumer &consume, MPI_Comm comm,
+                           std::size_t max_count, MPI_Comm p2p) {
+      int size = comm_size(comm);
+      int rank = comm_rank(comm);
+
+      std::uint64_t local_size = buff.capacity();
+      std::vector<std::uint64_t> sizes;
+      if (rank == root) {
+        sizes.resize(static_cast< std::size_t >(size));
+      }
+      MPI_Gather(&local_size, 1, MPI_UINT64_T, sizes.data(), 1, MPI_UINT64_T, root, comm);
+
+      // Point-to-point messages go on a private communicator so they
+      // cannot be mistaken for task messages on comm
+      bool own_p2p = p2p == MPI_COMM_NULL;
+      if (own_p2p) {
+        MPI_Comm_dup(comm, &p2p);
+      }
+
+      if (rank != root) {
+        send_chunked(buff.data(), local_size, root, p2p, max_count);
+      } else {
+        serialization_buffer current(0);
+        serialization_buffer next(0);
+        std::vector<MPI_Request> reqs;
+        auto post = [&](int src) {
+          next = serialization_buffer(static_cast< std::size_t >(sizes[src]));
+          if (src == root) {
+            ::memcpy(next.data(), buff.data(), local_size);
+          } else {
+            irecv_chunked(next.data(), sizes[src], src, p2p, max_count, reqs);
+          }
+        };
+
+        post(0);
+        for (int src = 0; src < size; ++src) {
+          MPI_Waitall(reqs.size(), reqs.data(), MPI_STATUSES_IGNORE);
+          reqs.clear();
+          current = std::move(next);
+          // Receive the next rank while this one is consumed
+          if (src + 1 < size) {
+            post(src + 1);
+          }
+          consume(src, current);
+        }
+      }
+
+      if (own_p2p) {
+        MPI_Comm_free(&p2p);
+      }
+    }
+
     serialization_buffer
-    gather_internal(const serialization_buffer &buff, int root, MPI_Comm comm) {
+    gather_internal(const serialization_buffer &buff, int root, MPI_Comm comm,
+                    std::size_t max_count, MPI_Comm p2p) {
       // Get size of all data being transferred, in bytes
-      auto local_size = static_cast< int >( buff.capacity());
+      std::uint64_t local_size = buff.capacity();
     
       int size;
       MPI_Comm_size(comm, &size);
@@ -18,18 +101,18 @@ namespace darma_backend {
       MPI_Comm_rank(comm, &rank);
     
       // Size and offsets used by root and ignored by everything else
-      std::vector<int> sizes;
-      std::vector<int> offsets;
+      std::vector<std::uint64_t> sizes;
+      std::vector<std::uint64_t> offsets;
       if (rank == root) {
         sizes.resize(static_cast< std::size_t >(size));
         offsets.resize(static_cast< std::size_t >(size), 0ULL);
       }
     
       // Transfer all the sizes to the root
-      MPI_Gather(&local_size, 1, get_mpi_type(local_size), &sizes[0],
-                 1, get_mpi_type(local_size), root, comm);
+      MPI_Gather(&local_size, 1, MPI_UINT64_T, sizes.data(),
+                 1, MPI_UINT64_T, root, comm);
   
-      int total_size = 0;
+      std::uint64_t total_size = 0;
       if ( rank == root ) {
         for (std::size_t i = 0; i < offsets.size(); ++i) {
           // sizes and offsets have the same lengths
@@ -37,11 +120,53 @@ namespace darma_backend {
           total_size += sizes[i];
         }
       }
-      
-      serialization_buffer recvbuff(static_cast< std::size_t >(total_size));
-      MPI_Gatherv(buff.data(), static_cast< int >( buff.capacity()), MPI_BYTE,
+
+#if MPI_VERSION >= 4
+      // Large counts need no chunking unless the caller asked for smaller messages
+      if (max_count >= gather_max_count) {
+        std::vector<MPI_Count> counts(sizes.begin(), sizes.end());
+        std::vector<MPI_Aint> displs(offsets.begin(), offsets.end());
+        serialization_buffer recvbuff(static_cast< std::size_t >(total_size));
+        MPI_Gatherv_c(buff.data(), static_cast< MPI_Count >(local_size), MPI_BYTE,
+                      recvbuff.data(), counts.data(), displs.data(), MPI_BYTE, root, comm);
+        return recvbuff;
+      }
+#endif
+      // Everyone needs to agree on whether int counts suffice
+      MPI_Bcast(&total_size, 1, MPI_UINT64_T, root, comm);
+
+      if (total_size > max_count) {
+        // Too large for int displacements, receive each rank directly into place
+        serialization_buffer recvbuff(rank == root ? static_cast< std::size_t >(total_size) : 0);
+        bool own_p2p = p2p == MPI_COMM_NULL;
+        if (own_p2p) {
+          MPI_Comm_dup(comm, &p2p);
+        }
+        if (rank != root) {
+          send_chunked(buff.data(), local_size, root, p2p, max_count);
+        } else {
+          std::vector<MPI_Request> reqs;
+          for (int src = 0; src < size; ++src) {
+            if (src == root) {
+              ::memcpy(recvbuff.data() + offsets[src], buff.data(), local_size);
+            } else {
+              irecv_chunked(recvbuff.data() + offsets[src], sizes[src], src, p2p, max_count, reqs);
+            }
+          }
+          MPI_Waitall(reqs.size(), reqs.data(), MPI_STATUSES_IGNORE);
+        }
+        if (own_p2p) {
+          MPI_Comm_free(&p2p);
+        }
+        return recvbuff;
+      }
+
+      std::vector<int> int_sizes(sizes.begin(), sizes.end());
+      std::vector<int> int_offsets(offsets.begin(), offsets.end());
+      serialization_buffer recvbuff(rank == root ? static_cast< std::size_t >(total_size) : 0);
+      MPI_Gatherv(buff.data(), static_cast< int >(local_size), MPI_BYTE,
                   recvbuff.data(),
-                  sizes.data(), offsets.data(), MPI_BYTE, root, comm);
+                  int_sizes.data(), int_offsets.data(), MPI_BYTE, root, comm);
     
       return recvbuff;
     }
@@ -3,70 +3,197 @@
 
 #include <async_ref.h>
 #include "mpi_helpers.h"
+#include "hierarchy.h"
 #include <mpi.h>
+#include <functional>
+#include <limits>
 #include <vector>
 
 namespace darma_backend {
   namespace detail {
+    /** The largest message a single MPI call can describe with int counts */
+    static constexpr std::size_t gather_max_count = std::numeric_limits<int>::max();
+
+    /**
+     * Gather the buffers of all ranks onto root, concatenated in rank order.
+     * Sizes and offsets are 64-bit. Totals that do not fit an int count use
+     * MPI_Gatherv_c where available and chunked point-to-point messages otherwise.
+     *
+     * @param buff      The local contribution
+     * @param root      The rank receiving the data
+     * @param comm      The MPI communicator
+     * @param max_count The largest count to hand to a single MPI call
+     * @param p2p       A duplicate of comm for the chunked messages, or
+     *                  MPI_COMM_NULL to duplicate one for this call
+     * @return          The concatenated buffers on root, an empty buffer elsewhere
+     */
     serialization_buffer
     gather_internal(const serialization_buffer &buff,
-                    int root, MPI_Comm comm = MPI_COMM_WORLD);
+                    int root, MPI_Comm comm = MPI_COMM_WORLD,
+                    std::size_t max_count = gather_max_count,
+                    MPI_Comm p2p = MPI_COMM_NULL);
+
+    /**
+     * Gather through the leaders of each node. Totals beyond max_count
+     * go flat over topo.comm instead.
+     */
+    serialization_buffer
+    gather_internal(const serialization_buffer &buff, int root, node_topology& topo,
+                    std::size_t max_count = gather_max_count,
+                    MPI_Comm p2p = MPI_COMM_NULL);
+
+    /** Called on root with the buffer of each rank, in rank order */
+    using gather_consumer = std::function<void(int rank, serialization_buffer &buff)>;
+
+    /**
+     * Gather the buffers of all ranks onto root without materializing them all at once.
+     * Root holds at most two rank buffers at a time, receiving the next while consume
+     * runs on the current one.
+     *
+     * @param buff      The local contribution
+     * @param root      The rank receiving the data
+     * @param consume   Invoked on root once per rank, in rank order
+     * @param comm      The MPI communicator
+     * @param max_count The largest count to hand to a single MPI call
+     * @param p2p       A duplicate of comm for the messages to root, or
+     *                  MPI_COMM_NULL to duplicate one for this call
+     */
+    void
+    gather_stream_internal(const serialization_buffer &buff, int root,
+                           const gather_consumer &consume,
+                           MPI_Comm comm = MPI_COMM_WORLD,
+                           std::size_t max_count = gather_max_count,
+                           MPI_Comm p2p = MPI_COMM_NULL);
+
+    inline void
+    gather_stream_internal(const serialization_buffer &buff, int root,
+                           const gather_consumer &consume, node_topology &topo,
+                           std::size_t max_count = gather_max_count,
+                           MPI_Comm p2p = MPI_COMM_NULL) {
+      // Root consumes one rank at a time, so there is nothing to combine on the node
+      gather_stream_internal(buff, root, consume, topo.comm, max_count, p2p);
+    }
+
+    /**
+     * Pack the local elements of a collection along with their global indices
+     */
+    template<typename T, typename IndexType>
+    serialization_buffer
+    pack_indexed(const collection<T, IndexType> &coll) {
+      auto size_archive = serializer::make_sizing_archive();
+      size_archive % coll.local_elements_.size();
+      for (auto &&kv : coll.local_elements_) {
+        size_archive % kv.first;
+        size_archive % *kv.second;
+      }
+
+      auto sar = serializer::make_packing_archive(serializer::get_size(size_archive));
+      sar << coll.local_elements_.size();
+      for (auto &&kv : coll.local_elements_) {
+        sar << kv.first;
+        sar << *kv.second;
+      }
+
+      return serializer::extract_buffer(std::move(sar));
+    }
+
+    /**
+     * Unpack one rank's worth of elements packed by pack_indexed,
+     * handing each to consume(index, value)
+     */
+    template<typename T, typename Archive, typename Consumer>
+    void
+    unpack_indexed(Archive &ar, Consumer &&consume) {
+      auto sz = ar.template unpack_next_item_as<std::size_t>();
+      for (std::size_t j = 0; j < sz; ++j) {
+        auto idx = ar.template unpack_next_item_as<int>();
+        consume(idx, ar.template unpack_next_item_as<T>());
+      }
+    }
   }
   
-  // TODO: order elements by index
   /**
    * Perform a gather operation. This operation gathers all elements of a collection
-   * and yields a vector containing those elements, ordered by rank.
+   * and yields a vector containing those elements, ordered by index.
    * 
    * @tparam    T               The type of data stored in the collection
    * @tparam    IndexType       The index type of the collection
+   * @tparam    Comm            MPI_Comm for a flat gather or node_topology for a hierarchical one
    * @param     collection      The collection to gather from
    * @param     root            The rank of the process that receives the data
    * @param     comm            The MPI communicator used for the gather operation
-   * @return                    A vector containing all the elements in the collection in rank order.
+   * @param     p2p             A duplicate of the communicator for point-to-point messages,
+   *                            or MPI_COMM_NULL to duplicate one if they are needed
+   * @return                    A vector containing all the elements in the collection in index order.
    */
-  template<typename T, typename IndexType>
+  template<typename T, typename IndexType, typename Comm = MPI_Comm>
   async_ref_base<std::vector<T>>
   gather(async_ref_base<collection<T, IndexType>> &&collection, int root,
-         MPI_Comm comm = MPI_COMM_WORLD) {
+         Comm &&comm = MPI_COMM_WORLD, MPI_Comm p2p = MPI_COMM_NULL) {
     auto &outcoll = *collection;
     
-    auto size_archive = serializer::make_sizing_archive();
-    size_archive % outcoll.local_elements_.size();
-    for (auto &&kv : outcoll.local_elements_)
-      size_archive % *kv.second;
-    
-    auto sar = serializer::make_packing_archive(serializer::get_size(size_archive));
-    sar << outcoll.local_elements_.size();
-    for (auto &&kv : outcoll.local_elements_)
-      sar << *kv.second;
+    auto sendbuff = detail::pack_indexed(outcoll);
     
-    auto sendbuff = serializer::extract_buffer(std::move(sar));
+    auto retbuff = detail::gather_internal(sendbuff, root, comm, detail::gather_max_count, p2p);
     
-    auto retbuff = detail::gather_internal(sendbuff, root, comm);
-    
-    int nranks;
-    MPI_Comm_size(comm, &nranks);
-  
-    int rank;
-    MPI_Comm_rank(comm, &rank);
+    int nranks = comm_size(comm);
+    int rank = comm_rank(comm);
   
     std::vector<T> retvec;
     if ( rank == root ) {
       auto ar = serializer::make_unpacking_archive(retbuff);
   
+      std::vector<std::pair<int, T>> elements;
+      elements.reserve(outcoll.size());
       for (int i = 0; i < nranks; ++i) {
-        auto sz = ar.template unpack_next_item_as<std::size_t>();
-    
-        retvec.reserve(retvec.size() + sz);
-    
-        for (std::size_t j = 0; j < sz; ++j)
-          retvec.emplace_back(ar.template unpack_next_item_as<T>());
+        detail::unpack_indexed<T>(ar, [&](int idx, T &&t) {
+          elements.emplace_back(idx, std::move(t));
+        });
+      }
+
+      // Place elements by their global index
+      std::vector<int> slots(outcoll.size(), -1);
+      for (int i = 0; i < static_cast< int >(elements.size()); ++i)
+        slots[elements[i].first] = i;
+
+      retvec.reserve(elements.size());
+      for (int slot : slots) {
+        if (slot >= 0)
+          retvec.emplace_back(std::move(elements[slot].second));
       }
     }
     
     return async_ref_base<std::vector<T>>::make(std::move(retvec));
   }
+
+  /**
+   * Perform a streaming gather operation. Rather than building a vector of the whole
+   * collection, root hands each element to consume as the data from its rank arrives.
+   *
+   * @tparam    T               The type of data stored in the collection
+   * @tparam    IndexType       The index type of the collection
+   * @tparam    Consumer        Callable as consume(int index, T&& value)
+   * @tparam    Comm            MPI_Comm or node_topology
+   * @param     collection      The collection to gather from
+   * @param     root            The rank of the process that receives the data
+   * @param     consume         Invoked on root for every element, grouped by rank in rank order
+   * @param     comm            The MPI communicator used for the gather operation
+   * @param     p2p             A duplicate of the communicator for point-to-point messages,
+   *                            or MPI_COMM_NULL to duplicate one per call
+   */
+  template<typename T, typename IndexType, typename Consumer, typename Comm = MPI_Comm>
+  void
+  gather_stream(async_ref_base<collection<T, IndexType>> &&collection, int root,
+                Consumer &&consume, Comm &&comm = MPI_COMM_WORLD,
+                MPI_Comm p2p = MPI_COMM_NULL) {
+    auto sendbuff = detail::pack_indexed(*collection);
+
+    detail::gather_stream_internal(sendbuff, root,
+      [&](int, serialization_buffer &buff) {
+        auto ar = serializer::make_unpacking_archive(buff);
+        detail::unpack_indexed<T>(ar, consume);
+      }, comm, detail::gather_max_count, p2p);
+  }
 }
 
 #endif  // DARMA_BACKEND_GATHER_H
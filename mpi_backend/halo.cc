@@ -0,0 +1,65 @@
+#include "halo.h"
+#include <algorithm>
+
+namespace darma_backend {
+
+halo_graph::~halo_graph()
+{
+  int finalized;
+  MPI_Finalized(&finalized);
+  if (comm != MPI_COMM_NULL && !finalized){
+    MPI_Comm_free(&comm);
+  }
+}
+
+bool
+halo_graph::build(MPI_Comm parent, int rank, const std::vector<edge>& edges,
+                  const std::vector<int>& edgeRanks)
+{
+  ranks.clear();
+  for (int r : edgeRanks){
+    if (r != rank) ranks.push_back(r);
+  }
+  std::sort(ranks.begin(), ranks.end());
+  ranks.erase(std::unique(ranks.begin(), ranks.end()), ranks.end());
+
+  int n = ranks.size();
+  sends.assign(n, {});
+  recvs.assign(n, {});
+  local.clear();
+  for (std::size_t i=0; i < edges.size(); ++i){
+    if (edgeRanks[i] == rank){
+      local.push_back(edges[i]);
+    } else {
+      int k = std::lower_bound(ranks.begin(), ranks.end(), edgeRanks[i]) - ranks.begin();
+      sends[k].push_back(edges[i]);
+      recvs[k].push_back(edges[i]);
+    }
+  }
+
+  //both sides of a rank pair must agree on the order of the pieces
+  for (int k=0; k < n; ++k){
+    std::sort(sends[k].begin(), sends[k].end(), [](const edge& a, const edge& b){
+      return a.local != b.local ? a.local < b.local : a.remote < b.remote;
+    });
+    std::sort(recvs[k].begin(), recvs[k].end(), [](const edge& a, const edge& b){
+      return a.remote != b.remote ? a.remote < b.remote : a.local < b.local;
+    });
+  }
+
+  if (comm != MPI_COMM_NULL) MPI_Comm_free(&comm);
+  MPI_Dist_graph_create_adjacent(parent, n, ranks.data(), MPI_UNWEIGHTED,
+                                 n, ranks.data(), MPI_UNWEIGHTED,
+                                 MPI_INFO_NULL, 0, &comm);
+
+  std::vector<int> numSent(n), numRecvd(n);
+  for (int k=0; k < n; ++k) numSent[k] = sends[k].size();
+  MPI_Neighbor_alltoall(numSent.data(), 1, MPI_INT, numRecvd.data(), 1, MPI_INT, comm);
+  bool symmetric = true;
+  for (int k=0; k < n; ++k){
+    if (numRecvd[k] != int(recvs[k].size())) symmetric = false;
+  }
+  return symmetric;
+}
+
+}
@@ -0,0 +1,47 @@
+#ifndef DARMA_BACKEND_HALO_H
+#define DARMA_BACKEND_HALO_H
+
+#include <mpi.h>
+#include <vector>
+
+namespace darma_backend {
+  /**
+   * The element pairs of a halo exchange grouped by the rank on the other
+   * side, and a distributed graph communicator over exactly those ranks, so
+   * the whole exchange is one neighborhood collective. The neighbor relation
+   * must be symmetric: every element receives one piece from each neighbor
+   * it sends one to.
+   */
+  struct halo_graph {
+    struct edge {
+      int local;   //the element on this rank
+      int remote;  //one of its neighbors
+    };
+
+    halo_graph() = default;
+    halo_graph(const halo_graph&) = delete;
+    halo_graph& operator=(const halo_graph&) = delete;
+    ~halo_graph();
+
+    /**
+     * @brief Group the edges by rank and create the graph communicator,
+     *        collective over parent
+     * @param edges Every local element paired with each of its neighbors
+     * @param edgeRanks The rank each edge's neighbor lives on
+     * @return Whether every neighbor rank sends as many pieces as expected
+     */
+    bool build(MPI_Comm parent, int rank, const std::vector<edge>& edges,
+               const std::vector<int>& edgeRanks);
+
+    //the other ranks exchanged with, in the graph's neighbor order
+    std::vector<int> ranks;
+    //per neighbor rank, edges in the order their pieces travel: by sender, then receiver
+    std::vector<std::vector<edge>> sends;
+    std::vector<std::vector<edge>> recvs;
+    //edges between two elements of this rank, which never touch MPI
+    std::vector<edge> local;
+    MPI_Comm comm = MPI_COMM_NULL;
+  };
+}
+
+#endif  // DARMA_BACKEND_HALO_H
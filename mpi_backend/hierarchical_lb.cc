@@ -0,0 +1,184 @@
+#include "mpi_backend.h"
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+using darma_backend::lb::object_sizes;
+using darma_backend::lb::rank_configs;
+
+/**
+ * Commsplit-style pairwise exchange among the node leaders, each trading
+ * on behalf of all the elements of its node
+ */
+static std::vector<MpiBackend::pair64>
+balance_across_nodes(std::vector<MpiBackend::pair64> nodeConfig, object_sizes& sizes,
+                     const darma_backend::lb::comm_split_params& params, MPI_Comm leaders)
+{
+  using pair64 = MpiBackend::pair64;
+  int nodeId, numNodes;
+  MPI_Comm_rank(leaders, &nodeId);
+  MPI_Comm_size(leaders, &numNodes);
+
+  uint64_t lastImbalance = std::numeric_limits<uint64_t>::max();
+  bool allowGiveTake = false;
+  for (int tryNum=0; tryNum < params.maxNumTries; ++tryNum){
+    uint64_t nodeWork = 0;
+    for (auto& pair : nodeConfig) nodeWork += pair.first;
+
+    uint64_t mine[2] = {nodeWork, nodeConfig.size()};
+    std::vector<uint64_t> all(2*numNodes);
+    MPI_Allgather(mine, 2, MPI_UINT64_T, all.data(), 2, MPI_UINT64_T, leaders);
+    uint64_t minWork = std::numeric_limits<uint64_t>::max();
+    uint64_t maxWork = 0, totalWork = 0;
+    int maxNumTasks = 0;
+    for (int n=0; n < numNodes; ++n){
+      minWork = std::min(minWork, all[2*n]);
+      maxWork = std::max(maxWork, all[2*n]);
+      totalWork += all[2*n];
+      maxNumTasks = std::max<int>(maxNumTasks, all[2*n+1]);
+    }
+
+    if (darma_backend::lb::comm_split_done(params, minWork, maxWork, totalWork,
+                                           numNodes, lastImbalance)){
+      break;
+    }
+    allowGiveTake = allowGiveTake || tryNum >= 4;
+
+    //pair nodes by work, same as the split communicator does for ranks
+    std::vector<int> byWork(numNodes);
+    std::iota(byWork.begin(), byWork.end(), 0);
+    std::stable_sort(byWork.begin(), byWork.end(), [&](int a, int b){
+      return all[2*a]/1000 < all[2*b]/1000;
+    });
+    int position = std::find(byWork.begin(), byWork.end(), nodeId) - byWork.begin();
+    int partner = byWork[darma_backend::lb::trading_partner(position, numNodes)];
+    if (partner == nodeId) continue;
+
+    std::sort(nodeConfig.begin(), nodeConfig.end(), darma_backend::lb::sort_by_weight());
+    std::vector<uint64_t> outgoing(3*nodeConfig.size());
+    for (std::size_t i=0; i < nodeConfig.size(); ++i){
+      outgoing[3*i] = nodeConfig[i].first;
+      outgoing[3*i+1] = nodeConfig[i].second;
+      outgoing[3*i+2] = darma_backend::lb::object_size(sizes, nodeConfig[i].second);
+    }
+    std::vector<uint64_t> incoming(3*maxNumTasks);
+    int tag = 452;
+    MPI_Status stat;
+    MPI_Sendrecv(outgoing.data(), outgoing.size(), MPI_UINT64_T, partner, tag,
+                 incoming.data(), incoming.size(), MPI_UINT64_T, partner, tag,
+                 leaders, &stat);
+    int numIncoming;
+    MPI_Get_count(&stat, MPI_UINT64_T, &numIncoming);
+    numIncoming /= 3;
+
+    std::vector<pair64> incomingConfig(numIncoming);
+    for (int i=0; i < numIncoming; ++i){
+      incomingConfig[i] = pair64(incoming[3*i], incoming[3*i+1]);
+      if (incoming[3*i+2]) sizes[incoming[3*i+1]] = incoming[3*i+2];
+    }
+
+    darma_backend::lb::comm_split_exchange(nodeConfig, incomingConfig, nodeWork,
+                                           totalWork / numNodes, maxNumTasks,
+                                           true, allowGiveTake, sizes, params);
+  }
+  return nodeConfig;
+}
+
+std::vector<MpiBackend::pair64>
+MpiBackend::hierarchicalBalance(std::vector<pair64>&& localConfig,
+                                darma_backend::lb::object_sizes sizes)
+{
+  darma_backend::node_topology& topo = lb_topology();
+
+  //the leader holds every element of the node for the duration
+  std::vector<uint64_t> mine(3*localConfig.size());
+  for (std::size_t i=0; i < localConfig.size(); ++i){
+    mine[3*i] = localConfig[i].first;
+    mine[3*i+1] = localConfig[i].second;
+    mine[3*i+2] = darma_backend::lb::object_size(sizes, localConfig[i].second);
+  }
+  int myCount = mine.size();
+  std::vector<int> counts(topo.node_size), displs(topo.node_size);
+  MPI_Gather(&myCount, 1, MPI_INT, counts.data(), 1, MPI_INT, 0, topo.node);
+  std::vector<uint64_t> nodeElems;
+  if (topo.is_leader()){
+    std::partial_sum(counts.begin(), counts.end() - 1, displs.begin() + 1);
+    nodeElems.resize(displs.back() + counts.back());
+  }
+  MPI_Gatherv(mine.data(), myCount, MPI_UINT64_T, nodeElems.data(), counts.data(),
+              displs.data(), MPI_UINT64_T, 0, topo.node);
+
+  rank_configs nodeConfigs(topo.node_size);
+  if (topo.is_leader()){
+    for (int r=0; r < topo.node_size; ++r){
+      for (int i=displs[r]; i < displs[r] + counts[r]; i += 3){
+        nodeConfigs[r].emplace_back(nodeElems[i], nodeElems[i+1]);
+        if (nodeElems[i+2]) sizes[nodeElems[i+1]] = nodeElems[i+2];
+      }
+    }
+
+    //1) balance inside the node, which never touches the network
+    nodeConfigs = darma_backend::lb::simulate_comm_split(std::move(nodeConfigs),
+                                                         commSplitParams_, sizes);
+
+    //2) balance whole nodes against each other
+    if (topo.num_nodes > 1){
+      std::unordered_map<uint64_t,int> nodeRankOf;
+      std::vector<pair64> nodeConfig;
+      for (int r=0; r < topo.node_size; ++r){
+        for (auto& pair : nodeConfigs[r]){
+          nodeRankOf[pair.second] = r;
+          nodeConfig.push_back(pair);
+        }
+      }
+
+      nodeConfig = balance_across_nodes(std::move(nodeConfig), sizes,
+                                        commSplitParams_, topo.leaders);
+
+      //3) what stayed keeps its rank, arrivals go to the least loaded rank first
+      rank_configs redistributed(topo.node_size);
+      std::vector<uint64_t> rankWork(topo.node_size, 0);
+      std::vector<pair64> arrivals;
+      for (auto& pair : nodeConfig){
+        auto iter = nodeRankOf.find(pair.second);
+        if (iter == nodeRankOf.end()){
+          arrivals.push_back(pair);
+        } else {
+          redistributed[iter->second].push_back(pair);
+          rankWork[iter->second] += pair.first;
+        }
+      }
+      std::sort(arrivals.rbegin(), arrivals.rend(), sortByWeight());
+      for (auto& pair : arrivals){
+        int r = std::min_element(rankWork.begin(), rankWork.end()) - rankWork.begin();
+        redistributed[r].push_back(pair);
+        rankWork[r] += pair.first;
+      }
+      nodeConfigs = darma_backend::lb::simulate_comm_split(std::move(redistributed),
+                                                           commSplitParams_, sizes);
+    }
+
+    nodeElems.clear();
+    for (int r=0; r < topo.node_size; ++r){
+      displs[r] = nodeElems.size();
+      for (auto& pair : nodeConfigs[r]){
+        nodeElems.push_back(pair.first);
+        nodeElems.push_back(pair.second);
+      }
+      counts[r] = nodeElems.size() - displs[r];
+    }
+  }
+
+  MPI_Scatter(counts.data(), 1, MPI_INT, &myCount, 1, MPI_INT, 0, topo.node);
+  std::vector<uint64_t> result(myCount);
+  MPI_Scatterv(nodeElems.data(), counts.data(), displs.data(), MPI_UINT64_T,
+               result.data(), myCount, MPI_UINT64_T, 0, topo.node);
+
+  std::vector<pair64> newConfig(myCount / 2);
+  for (std::size_t i=0; i < newConfig.size(); ++i){
+    newConfig[i] = pair64(result[2*i], result[2*i+1]);
+  }
+  darmaDebug(LB, "Rank {} on node {} has {} elements after hierarchical balancing",
+             rank_, topo.node_id, newConfig.size());
+  return newConfig;
+}
@@ -0,0 +1,281 @@
+#include "hierarchy.h"
+#include "gather.h"
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+
+namespace darma_backend {
+
+  node_topology::node_topology(MPI_Comm c, int ranks_per_node) :
+    comm(c),
+    node(MPI_COMM_NULL),
+    leaders(MPI_COMM_NULL),
+    win_(MPI_WIN_NULL),
+    slot_bytes_(0)
+  {
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    MPI_Comm shared;
+    MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &shared);
+    if (ranks_per_node > 0){
+      int shared_rank;
+      MPI_Comm_rank(shared, &shared_rank);
+      MPI_Comm_split(shared, shared_rank / ranks_per_node, rank, &node);
+      MPI_Comm_free(&shared);
+    } else {
+      node = shared;
+    }
+    MPI_Comm_rank(node, &node_rank);
+    MPI_Comm_size(node, &node_size);
+
+    MPI_Comm_split(comm, is_leader() ? 0 : MPI_UNDEFINED, rank, &leaders);
+    if (is_leader()){
+      MPI_Comm_rank(leaders, &node_id);
+      MPI_Comm_size(leaders, &num_nodes);
+    }
+    int ids[2] = {node_id, num_nodes};
+    MPI_Bcast(ids, 2, MPI_INT, 0, node);
+    node_id = ids[0];
+    num_nodes = ids[1];
+
+    std::vector<int> all(2*size);
+    int mine[2] = {node_id, node_rank};
+    MPI_Allgather(mine, 2, MPI_INT, all.data(), 2, MPI_INT, comm);
+    node_of_rank.resize(size);
+    node_rank_of.resize(size);
+    node_sizes.resize(num_nodes);
+    for (int r=0; r < size; ++r){
+      node_of_rank[r] = all[2*r];
+      node_rank_of[r] = all[2*r+1];
+      ++node_sizes[node_of_rank[r]];
+    }
+
+    std::vector<int> node_offsets(num_nodes, 0);
+    std::partial_sum(node_sizes.begin(), node_sizes.end() - 1, node_offsets.begin() + 1);
+    node_order.resize(size);
+    for (int r=0; r < size; ++r){
+      node_order[node_offsets[node_of_rank[r]] + node_rank_of[r]] = r;
+    }
+  }
+
+  node_topology::~node_topology()
+  {
+    free_shared();
+    if (leaders != MPI_COMM_NULL) MPI_Comm_free(&leaders);
+    MPI_Comm_free(&node);
+  }
+
+  void
+  node_topology::free_shared()
+  {
+    if (win_ != MPI_WIN_NULL){
+      MPI_Win_unlock_all(win_);
+      MPI_Win_free(&win_);
+    }
+    slots_.clear();
+    slot_bytes_ = 0;
+  }
+
+  void
+  node_topology::reserve_shared(std::size_t bytes)
+  {
+    if (bytes <= slot_bytes_) return;
+
+    free_shared();
+
+    //one slot per node rank, plus one for the node result on the leader
+    int my_slots = is_leader() ? 2 : 1;
+    char* base;
+    MPI_Win_allocate_shared(my_slots*bytes, 1, MPI_INFO_NULL, node, &base, &win_);
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, win_);
+
+    slots_.resize(node_size + 1);
+    for (int i=0; i < node_size; ++i){
+      MPI_Aint win_size;
+      int disp_unit;
+      MPI_Win_shared_query(win_, i, &win_size, &disp_unit, &slots_[i]);
+    }
+    slots_[node_size] = slots_[0] + bytes;
+    slot_bytes_ = bytes;
+  }
+
+  char*
+  node_topology::shared_slot(int slot) const
+  {
+    return slots_[slot];
+  }
+
+  void
+  node_topology::shared_fence() const
+  {
+    MPI_Win_sync(win_);
+    MPI_Barrier(node);
+    MPI_Win_sync(win_);
+  }
+
+  void
+  allreduce(void* buf, int count, MPI_Datatype type, MPI_Op op, node_topology& topo)
+  {
+    MPI_Aint lb, extent;
+    MPI_Type_get_extent(type, &lb, &extent);
+    std::size_t bytes = count * extent;
+
+    topo.reserve_shared(bytes);
+    char* result = topo.shared_slot(topo.node_size);
+
+    ::memcpy(topo.shared_slot(topo.node_rank), buf, bytes);
+    topo.shared_fence();
+
+    if (topo.is_leader()){
+      ::memcpy(result, topo.shared_slot(0), bytes);
+      for (int i=1; i < topo.node_size; ++i){
+        MPI_Reduce_local(topo.shared_slot(i), result, count, type, op);
+      }
+      if (topo.num_nodes > 1){
+        MPI_Allreduce(MPI_IN_PLACE, result, count, type, op, topo.leaders);
+      }
+    }
+    //the result slot is only rewritten after the first fence of the next
+    //allreduce, by which point everyone has finished reading it
+    topo.shared_fence();
+
+    ::memcpy(buf, result, bytes);
+  }
+
+  namespace detail {
+    serialization_buffer
+    gather_internal(const serialization_buffer &buff, int root, node_topology& topo,
+                    std::size_t max_count, MPI_Comm p2p) {
+      // The node and leader steps use int counts, so large gathers go flat
+      std::uint64_t total = buff.capacity();
+      allreduce(&total, 1, MPI_UINT64_T, MPI_SUM, topo);
+      if (total > max_count){
+        return gather_internal(buff, root, topo.comm, max_count, p2p);
+      }
+
+      int local_size = static_cast< int >(buff.capacity());
+
+      // Step 1: leaders collect the sizes and data of their node
+      std::vector<int> node_sizes;
+      std::vector<int> node_offsets;
+      if (topo.is_leader()){
+        node_sizes.resize(topo.node_size);
+        node_offsets.resize(topo.node_size);
+      }
+      MPI_Gather(&local_size, 1, MPI_INT, node_sizes.data(), 1, MPI_INT, 0, topo.node);
+
+      int node_total = 0;
+      for (std::size_t i=0; i < node_sizes.size(); ++i){
+        node_offsets[i] = node_total;
+        node_total += node_sizes[i];
+      }
+
+      serialization_buffer node_buff(static_cast< std::size_t >(node_total));
+      MPI_Gatherv(buff.data(), local_size, MPI_BYTE,
+                  node_buff.data(), node_sizes.data(), node_offsets.data(), MPI_BYTE,
+                  0, topo.node);
+
+      // Step 2: the leader of root's node collects from all the other leaders,
+      // ordered by node rather than by rank
+      int root_node = topo.node_of_rank[root];
+      int root_node_rank = topo.node_rank_of[root];
+      bool root_leader = topo.is_leader() && topo.node_id == root_node;
+
+      std::vector<int> rank_sizes; //in node order
+      serialization_buffer all_buff;
+      if (topo.is_leader()){
+        std::vector<int> node_totals;
+        std::vector<int> total_offsets;
+        std::vector<int> size_offsets;
+        if (root_leader){
+          rank_sizes.resize(topo.size);
+          node_totals.resize(topo.num_nodes);
+          total_offsets.resize(topo.num_nodes, 0);
+          size_offsets.resize(topo.num_nodes, 0);
+          std::partial_sum(topo.node_sizes.begin(), topo.node_sizes.end() - 1,
+                           size_offsets.begin() + 1);
+        }
+        MPI_Gather(&node_total, 1, MPI_INT, node_totals.data(), 1, MPI_INT,
+                   root_node, topo.leaders);
+        MPI_Gatherv(node_sizes.data(), topo.node_size, MPI_INT,
+                    rank_sizes.data(), topo.node_sizes.data(), size_offsets.data(), MPI_INT,
+                    root_node, topo.leaders);
+
+        int total_size = 0;
+        for (std::size_t i=0; i < node_totals.size(); ++i){
+          total_offsets[i] = total_size;
+          total_size += node_totals[i];
+        }
+        all_buff = serialization_buffer(static_cast< std::size_t >(total_size));
+        MPI_Gatherv(node_buff.data(), node_total, MPI_BYTE,
+                    all_buff.data(), node_totals.data(), total_offsets.data(), MPI_BYTE,
+                    root_node, topo.leaders);
+      }
+
+      // Step 3: hand the data to root if it is not itself a leader
+      static const int forward_tag = 0;
+      if (root_node_rank != 0 && topo.node_id == root_node){
+        if (root_leader){
+          int total_size = static_cast< int >(all_buff.capacity());
+          MPI_Send(rank_sizes.data(), topo.size, MPI_INT, root_node_rank, forward_tag, topo.node);
+          MPI_Send(&total_size, 1, MPI_INT, root_node_rank, forward_tag, topo.node);
+          MPI_Send(all_buff.data(), total_size, MPI_BYTE, root_node_rank, forward_tag, topo.node);
+        } else if (topo.rank == root){
+          int total_size;
+          rank_sizes.resize(topo.size);
+          MPI_Recv(rank_sizes.data(), topo.size, MPI_INT, 0, forward_tag, topo.node, MPI_STATUS_IGNORE);
+          MPI_Recv(&total_size, 1, MPI_INT, 0, forward_tag, topo.node, MPI_STATUS_IGNORE);
+          all_buff = serialization_buffer(static_cast< std::size_t >(total_size));
+          MPI_Recv(all_buff.data(), total_size, MPI_BYTE, 0, forward_tag, topo.node, MPI_STATUS_IGNORE);
+        }
+      }
+
+      if (topo.rank != root){
+        return serialization_buffer(0);
+      }
+
+      // Put the node-ordered data back into rank order
+      std::vector<int> rank_offsets(topo.size, 0);
+      std::vector<int> sizes_by_rank(topo.size);
+      for (int k=0; k < topo.size; ++k){
+        sizes_by_rank[topo.node_order[k]] = rank_sizes[k];
+      }
+      std::partial_sum(sizes_by_rank.begin(), sizes_by_rank.end() - 1, rank_offsets.begin() + 1);
+
+      serialization_buffer recvbuff(all_buff.capacity());
+      std::size_t offset = 0;
+      for (int k=0; k < topo.size; ++k){
+        int r = topo.node_order[k];
+        ::memcpy(recvbuff.data() + rank_offsets[r], all_buff.data() + offset, rank_sizes[k]);
+        offset += rank_sizes[k];
+      }
+      return recvbuff;
+    }
+
+    void
+    broadcast_internal(serialization_buffer &buff, int root, node_topology& topo) {
+      auto local_size = static_cast< int >( buff.capacity() );
+
+      int root_node = topo.node_of_rank[root];
+      int root_node_rank = topo.node_rank_of[root];
+
+      // Only leaders take part in the inter-node broadcast
+      static const int forward_tag = 1;
+      if (root_node_rank != 0 && topo.node_id == root_node){
+        if (topo.rank == root){
+          MPI_Send(buff.data(), local_size, MPI_BYTE, 0, forward_tag, topo.node);
+        } else if (topo.is_leader()){
+          MPI_Recv(buff.data(), local_size, MPI_BYTE, root_node_rank, forward_tag,
+                   topo.node, MPI_STATUS_IGNORE);
+        }
+      }
+
+      if (topo.is_leader() && topo.num_nodes > 1){
+        MPI_Bcast(buff.data(), local_size, MPI_BYTE, root_node, topo.leaders);
+      }
+
+      MPI_Bcast(buff.data(), local_size, MPI_BYTE, 0, topo.node);
+    }
+  }
+}
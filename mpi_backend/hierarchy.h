@@ -0,0 +1,100 @@
+#ifndef DARMA_BACKEND_HIERARCHY_H
+#define DARMA_BACKEND_HIERARCHY_H
+
+#include "mpi_helpers.h"
+#include <mpi.h>
+#include <vector>
+
+namespace darma_backend {
+  /**
+   * The two-level structure of a communicator. Ranks that share memory
+   * (MPI_COMM_TYPE_SHARED) form a node, node rank 0 is the node leader,
+   * and the leaders form their own communicator. Collectives built on this
+   * combine on the node first and only communicate among the leaders.
+   */
+  struct node_topology {
+    /**
+     * @param comm           The communicator to split. Must outlive the topology.
+     * @param ranks_per_node If non-zero, split each shared-memory node further into
+     *                       groups of this many ranks. This emulates a multi-node
+     *                       machine with oversubscribed local ranks.
+     */
+    node_topology(MPI_Comm comm, int ranks_per_node = 0);
+
+    ~node_topology();
+
+    node_topology(const node_topology&) = delete;
+    node_topology& operator=(const node_topology&) = delete;
+
+    bool is_leader() const {
+      return node_rank == 0;
+    }
+
+    /**
+     * @brief Get the slot of a node-local rank in the node's shared scratch space.
+     * Slot node_size is reserved for the node result.
+     */
+    char* shared_slot(int slot) const;
+
+    /**
+     * @brief Make sure every slot of the shared scratch space holds at least bytes.
+     * Collective over the node; every node rank must pass the same value.
+     */
+    void reserve_shared(std::size_t bytes);
+
+    /**
+     * @brief Complete all writes to the shared scratch space on the node.
+     * Collective over the node.
+     */
+    void shared_fence() const;
+
+    MPI_Comm comm;
+    MPI_Comm node;
+    MPI_Comm leaders; //MPI_COMM_NULL on non-leaders
+    int rank;
+    int size;
+    int node_rank;
+    int node_size;
+    int node_id;
+    int num_nodes;
+    /** Global rank -> id of its node (its leader's rank in leaders) */
+    std::vector<int> node_of_rank;
+    /** Global rank -> its rank in its node */
+    std::vector<int> node_rank_of;
+    /** Number of ranks in each node */
+    std::vector<int> node_sizes;
+    /** Global ranks in node-major order, i.e. the order leaders gather in */
+    std::vector<int> node_order;
+
+   private:
+    void free_shared();
+
+    MPI_Win win_;
+    std::size_t slot_bytes_;
+    std::vector<char*> slots_;
+  };
+
+  inline int comm_rank(const node_topology& topo){
+    return topo.rank;
+  }
+
+  inline int comm_size(const node_topology& topo){
+    return topo.size;
+  }
+
+  /**
+   * Allreduce in place. Node ranks combine their contributions through
+   * shared memory, the leaders allreduce the node results, and every rank
+   * reads the final result back out of shared memory.
+   *
+   * \pre op is commutative
+   */
+  void allreduce(void* buf, int count, MPI_Datatype type, MPI_Op op,
+                 node_topology& topo);
+
+  namespace detail {
+    void broadcast_internal(serialization_buffer &buff, int root, node_topology& topo);
+  }
+}
+
+#endif  // DARMA_BACKEND_HIERARCHY_H
@@ -0,0 +1,72 @@
+#include "hw_counters.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+#endif
+
+namespace darma_backend {
+
+#ifdef __linux__
+  static int open_counter(uint64_t config, int group)
+  {
+    perf_event_attr attr;
+    ::memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, group, 0));
+  }
+#endif
+
+  hw_counters::hw_counters() :
+    cycles_fd_(-1),
+    instructions_fd_(-1)
+  {
+  }
+
+  hw_counters::~hw_counters()
+  {
+#ifdef __linux__
+    if (instructions_fd_ >= 0) close(instructions_fd_);
+    if (cycles_fd_ >= 0) close(cycles_fd_);
+#endif
+  }
+
+  bool
+  hw_counters::open()
+  {
+#ifdef __linux__
+    cycles_fd_ = open_counter(PERF_COUNT_HW_CPU_CYCLES, -1);
+    if (cycles_fd_ < 0) return false;
+    instructions_fd_ = open_counter(PERF_COUNT_HW_INSTRUCTIONS, cycles_fd_);
+    if (instructions_fd_ < 0){
+      close(cycles_fd_);
+      cycles_fd_ = -1;
+      return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  void
+  hw_counters::read(uint64_t& cycles, uint64_t& instructions) const
+  {
+    cycles = 0;
+    instructions = 0;
+#ifdef __linux__
+    if (cycles_fd_ < 0) return;
+    if (::read(cycles_fd_, &cycles, sizeof(cycles)) != sizeof(cycles)) cycles = 0;
+    if (::read(instructions_fd_, &instructions, sizeof(instructions)) != sizeof(instructions)){
+      instructions = 0;
+    }
+#endif
+  }
+
+}
@@ -0,0 +1,42 @@
+#ifndef DARMA_BACKEND_HW_COUNTERS_H
+#define DARMA_BACKEND_HW_COUNTERS_H
+
+#include <cstdint>
+
+namespace darma_backend {
+  /**
+   * Cycle and instruction counts of the calling thread, read from Linux
+   * perf_event. On other platforms, or when the kernel does not permit
+   * counting (see perf_event_paranoid), open fails and the counts stay zero.
+   */
+  class hw_counters {
+   public:
+    hw_counters();
+
+    ~hw_counters();
+
+    hw_counters(const hw_counters&) = delete;
+    hw_counters& operator=(const hw_counters&) = delete;
+
+    /**
+     * @brief Start counting
+     * @return Whether the counters are available
+     */
+    bool open();
+
+    bool available() const {
+      return cycles_fd_ >= 0;
+    }
+
+    /**
+     * @brief Read the running totals since open
+     */
+    void read(uint64_t& cycles, uint64_t& instructions) const;
+
+   private:
+    int cycles_fd_;
+    int instructions_fd_;
+  };
+}
+
+#endif  // DARMA_BACKEND_HW_COUNTERS_H
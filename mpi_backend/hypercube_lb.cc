@@ -0,0 +1,75 @@
+#include "mpi_backend.h"
+#include <algorithm>
+#include <limits>
+
+std::vector<MpiBackend::pair64>
+MpiBackend::hypercubeBalance(std::vector<pair64>&& localConfig,
+                             darma_backend::lb::object_sizes sizes)
+{
+  int dims = 0;
+  while ((1 << dims) < size_) ++dims;
+
+  uint64_t lastImbalance = std::numeric_limits<uint64_t>::max();
+  int rounds = 0;
+  for (int sweep=0; sweep < commSplitParams_.maxNumTries; ++sweep){
+    PerfCtrReduce ctr;
+    ctr.total = 0;
+    for (auto& pair : localConfig) ctr.total += pair.first;
+    ctr.max = ctr.min = ctr.total;
+    ctr.maxTask = ctr.minTask = 0;
+    ctr.maxLocalTasks = localConfig.size();
+    PerfCtrReduce global;
+    MPI_Allreduce(&ctr, &global, 1, perfCtrType_, perfCtrOp_, comm_);
+
+    if (rank_ == 0){
+      darmaDebug(LB, "Sweep {} has global={} with minWork={} and maxWork={}",
+                 sweep, global.total, global.min, global.max);
+    }
+
+    if (darma_backend::lb::comm_split_done(commSplitParams_, global.min, global.max,
+                                           global.total, size_, lastImbalance)){
+      break;
+    }
+
+    //one round per dimension, the partner differs from this rank in one bit
+    for (int d=0; d < dims; ++d, ++rounds){
+      int partner = rank_ ^ (1 << d);
+      if (partner >= size_) continue;
+
+      std::vector<uint64_t> outgoing(3*localConfig.size());
+      for (std::size_t i=0; i < localConfig.size(); ++i){
+        outgoing[3*i] = localConfig[i].first;
+        outgoing[3*i+1] = localConfig[i].second;
+        outgoing[3*i+2] = darma_backend::lb::object_size(sizes, localConfig[i].second);
+      }
+      //give and take change the counts, so the partner cannot know a bound
+      int tag = 453;
+      int numOutgoing = outgoing.size();
+      int numIncoming;
+      MPI_Sendrecv(&numOutgoing, 1, MPI_INT, partner, tag,
+                   &numIncoming, 1, MPI_INT, partner, tag,
+                   migrateComm_, MPI_STATUS_IGNORE);
+      std::vector<uint64_t> incoming(numIncoming);
+      MPI_Sendrecv(outgoing.data(), numOutgoing, MPI_UINT64_T, partner, tag,
+                   incoming.data(), numIncoming, MPI_UINT64_T, partner, tag,
+                   migrateComm_, MPI_STATUS_IGNORE);
+
+      std::vector<pair64> incomingConfig(numIncoming / 3);
+      for (std::size_t i=0; i < incomingConfig.size(); ++i){
+        incomingConfig[i] = pair64(incoming[3*i], incoming[3*i+1]);
+        if (incoming[3*i+2]) sizes[incoming[3*i+1]] = incoming[3*i+2];
+      }
+
+      //both partners must see the same order to reach the same split
+      if (rank_ < partner){
+        darma_backend::lb::dimension_exchange(localConfig, incomingConfig, sizes, commSplitParams_);
+      } else {
+        darma_backend::lb::dimension_exchange(incomingConfig, localConfig, sizes, commSplitParams_);
+      }
+      darmaDebug(LB, "Rank {} has {} elements after exchanging with {} in dimension {}",
+                 rank_, localConfig.size(), partner, d);
+    }
+  }
+  lastBalanceRounds_ = rounds;
+  return std::move(localConfig);
+}
@@ -0,0 +1,70 @@
+#include "large_count.h"
+
+namespace darma_backend {
+
+/**
+ * Describe size bytes as count elements of type. Small transfers stay plain
+ * bytes, the rest need a derived type the caller must free once posted.
+ */
+static bool
+byte_type(std::size_t size, std::size_t chunk, MPI_Datatype& type, int& count)
+{
+  if (chunk == 0 || chunk > max_message_chunk) chunk = max_message_chunk;
+  if (size <= chunk){
+    type = MPI_BYTE;
+    count = int(size);
+    return false;
+  }
+
+  std::size_t numChunks = size / chunk;
+  std::size_t remainder = size % chunk;
+  MPI_Datatype block, body;
+  MPI_Type_contiguous(int(chunk), MPI_BYTE, &block);
+  MPI_Type_contiguous(int(numChunks), block, &body);
+  MPI_Type_free(&block);
+  if (remainder == 0){
+    type = body;
+  } else {
+    int lengths[2] = {1, int(remainder)};
+    MPI_Aint displs[2] = {0, MPI_Aint(numChunks * chunk)};
+    MPI_Datatype types[2] = {body, MPI_BYTE};
+    MPI_Type_create_struct(2, lengths, displs, types, &type);
+    MPI_Type_free(&body);
+  }
+  MPI_Type_commit(&type);
+  count = 1;
+  return true;
+}
+
+void
+isend_bytes(const void* data, std::size_t size, std::size_t chunk,
+            int dest, int tag, MPI_Comm comm, MPI_Request* req)
+{
+  MPI_Datatype type;
+  int count;
+  bool derived = byte_type(size, chunk, type, count);
+  MPI_Isend(data, count, type, dest, tag, comm, req);
+  //a type may be freed once the operations using it are posted
+  if (derived) MPI_Type_free(&type);
+}
+
+void
+irecv_bytes(void* data, std::size_t size, std::size_t chunk,
+            int src, int tag, MPI_Comm comm, MPI_Request* req)
+{
+  MPI_Datatype type;
+  int count;
+  bool derived = byte_type(size, chunk, type, count);
+  MPI_Irecv(data, count, type, src, tag, comm, req);
+  if (derived) MPI_Type_free(&type);
+}
+
+std::size_t
+probed_bytes(const MPI_Status& stat)
+{
+  MPI_Count count;
+  MPI_Get_elements_x(&stat, MPI_BYTE, &count);
+  return std::size_t(count);
+}
+
+}
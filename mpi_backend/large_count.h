@@ -0,0 +1,37 @@
+#ifndef DARMA_BACKEND_LARGE_COUNT_H
+#define DARMA_BACKEND_LARGE_COUNT_H
+
+#include <mpi.h>
+#include <cstddef>
+
+namespace darma_backend {
+  /**
+   * Point-to-point byte transfers of any size. MPI counts are int, so a
+   * message of more than chunk bytes is described as one element of a
+   * derived type: whole chunks followed by the remainder. Sender and
+   * receiver may use different chunks, since the type signature is the
+   * same run of bytes either way.
+   */
+
+  /** @brief The largest chunk a transfer may use, the most an int count can describe */
+  static const std::size_t max_message_chunk = std::size_t(1) << 30;
+
+  /**
+   * @brief Start a nonblocking send of size bytes
+   * @param chunk The largest run of bytes described by a single count
+   */
+  void isend_bytes(const void* data, std::size_t size, std::size_t chunk,
+                   int dest, int tag, MPI_Comm comm, MPI_Request* req);
+
+  /**
+   * @brief Start a nonblocking receive of exactly size bytes
+   * @param chunk The largest run of bytes described by a single count
+   */
+  void irecv_bytes(void* data, std::size_t size, std::size_t chunk,
+                   int src, int tag, MPI_Comm comm, MPI_Request* req);
+
+  /** @brief The size in bytes of a probed message, which may not fit an int */
+  std::size_t probed_bytes(const MPI_Status& stat);
+}
+
+#endif  // DARMA_BACKEND_LARGE_COUNT_H
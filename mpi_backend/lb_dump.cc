@@ -0,0 +1,75 @@
+#include "lb_dump.h"
+#include <cstring>
+
+namespace darma_backend {
+
+  static const char lb_dump_magic[8] = {'D','A','R','M','A','L','B','D'};
+
+  bool
+  lb_dump::open(const std::string& path)
+  {
+    close();
+    f_ = fopen(path.c_str(), "wb");
+    if (!f_){
+      fprintf(stderr, "Unable to open load balancer dump %s\n", path.c_str());
+    }
+    phase_ = 0;
+    return is_open();
+  }
+
+  void
+  lb_dump::close()
+  {
+    if (f_){
+      fclose(f_);
+      f_ = nullptr;
+    }
+  }
+
+  void
+  lb_dump::write(int nranks, const std::vector<lb_record>& records)
+  {
+    if (!f_) return;
+
+    lb_phase_header header;
+    ::memcpy(header.magic, lb_dump_magic, sizeof(lb_dump_magic));
+    header.version = version;
+    header.phase = phase_++;
+    header.nranks = nranks;
+    header.unused = 0;
+    header.num_records = records.size();
+    fwrite(&header, sizeof(header), 1, f_);
+    fwrite(records.data(), sizeof(lb_record), records.size(), f_);
+    //the application may not exit cleanly - keep what we have
+    fflush(f_);
+  }
+
+  bool
+  lb_dump::read(const std::string& path, std::vector<lb_phase>& phases)
+  {
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) return false;
+
+    bool ok = true;
+    lb_phase_header header;
+    while (fread(&header, sizeof(header), 1, f) == 1){
+      if (::memcmp(header.magic, lb_dump_magic, sizeof(lb_dump_magic)) != 0
+          || header.version != version){
+        ok = false;
+        break;
+      }
+      lb_phase ph;
+      ph.phase = header.phase;
+      ph.nranks = header.nranks;
+      ph.records.resize(header.num_records);
+      if (fread(ph.records.data(), sizeof(lb_record), ph.records.size(), f) != ph.records.size()){
+        ok = false;
+        break;
+      }
+      phases.push_back(std::move(ph));
+    }
+    fclose(f);
+    return ok;
+  }
+
+}
@@ -0,0 +1,83 @@
+#ifndef DARMA_BACKEND_LB_DUMP_H
+#define DARMA_BACKEND_LB_DUMP_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace darma_backend {
+
+  /** The measured state of one element when the load balancer ran */
+  struct lb_record {
+    uint64_t index;
+    uint64_t load;  //wall time of its tasks in the phase, ns
+    uint64_t bytes; //packed size when last measured, 0 if never migrated
+    int32_t rank;
+    int32_t unused;
+  };
+
+  struct lb_phase_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t phase;
+    uint32_t nranks;
+    uint32_t unused;
+    uint64_t num_records;
+  };
+
+  /** Every element of one phase, as read back from a dump */
+  struct lb_phase {
+    int phase;
+    int nranks;
+    std::vector<lb_record> records;
+  };
+
+  /**
+   * Append-only binary file of load balancer inputs, one block per
+   * rebalance. Written on one rank with records gathered from all of them,
+   * and read back by tools/lb_simulator.
+   */
+  class lb_dump {
+   public:
+    static constexpr uint32_t version = 1;
+
+    lb_dump() : f_(nullptr), phase_(0) {}
+
+    ~lb_dump(){
+      close();
+    }
+
+    /**
+     * @brief Start a new dump file, truncating any old one
+     * @return Whether the file could be opened
+     */
+    bool open(const std::string& path);
+
+    bool is_open() const {
+      return f_ != nullptr;
+    }
+
+    void close();
+
+    /**
+     * @brief Append one phase worth of records
+     * @param nranks  The number of ranks the records are spread over
+     * @param records The records of all ranks
+     */
+    void write(int nranks, const std::vector<lb_record>& records);
+
+    /**
+     * @brief Read every phase from a file written by write
+     * @return Whether the whole file could be read
+     */
+    static bool read(const std::string& path, std::vector<lb_phase>& phases);
+
+   private:
+    FILE* f_;
+    uint32_t phase_;
+  };
+
+}
+
+#endif  // DARMA_BACKEND_LB_DUMP_H
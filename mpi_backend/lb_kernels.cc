@@ -0,0 +1,540 @@
+#include "lb_kernels.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <list>
+#include <numeric>
+#include <random>
+
+namespace darma_backend {
+namespace lb {
+
+bool
+comm_split_done(const comm_split_params& params,
+                uint64_t minWork, uint64_t maxWork, uint64_t totalWork,
+                int nranks, uint64_t& lastImbalance)
+{
+  uint64_t perfBalance = totalWork / nranks;
+
+  uint64_t newImbalance = maxWork - perfBalance;
+  double improvement = double(lastImbalance) / double(newImbalance);
+  if (improvement < params.minImprovement){
+    return true;
+  }
+  lastImbalance = newImbalance;
+
+  double imbalanceRatio = double(maxWork) / double(perfBalance);
+  if (imbalanceRatio < params.maxImbalance){
+    return true;
+  }
+
+  uint64_t maxDiff = maxWork - minWork;
+  double maxDiffFraction = double(maxDiff) / double(perfBalance);
+  return maxDiffFraction < params.diffCutoff;
+}
+
+int
+trading_partner(int rank, int size)
+{
+  int halfSize = size  / 2;
+  int partner;
+  if (rank < halfSize){
+    //there is less work here
+    if (size%2){
+      //odd number of ranks
+      int rankDelta = halfSize - rank;
+      partner = halfSize + rankDelta;
+    } else {
+      //even number of ranks
+      int rankDelta = halfSize - rank;
+      partner = halfSize + (rankDelta-1);
+    }
+  } else {
+    if (size%2){
+      //odd number of ranks
+      int rankDelta = rank - halfSize;
+      partner = halfSize - rankDelta;
+    } else {
+      //even number of ranks
+      int rankDelta =  rank - halfSize + 1;
+      partner = halfSize - rankDelta;
+    }
+  }
+  return partner;
+}
+
+void
+prefer_small_objects(const std::vector<pair64>& config, std::vector<int>& chosen,
+                     const object_sizes& sizes, double tolerance)
+{
+  if (sizes.empty() || tolerance <= 0) return;
+
+  std::vector<bool> taken(config.size(), false);
+  for (int idx : chosen) taken[idx] = true;
+
+  for (int& idx : chosen){
+    uint64_t load = config[idx].first;
+    uint64_t slack = uint64_t(load * tolerance);
+    int best = idx;
+    uint64_t bestSize = object_size(sizes, config[idx].second);
+    //config is sorted by weight, so similar loads are neighbors
+    int lo = idx, hi = idx;
+    while (lo > 0 && load - config[lo-1].first <= slack) --lo;
+    while (hi + 1 < int(config.size()) && config[hi+1].first - load <= slack) ++hi;
+    for (int j=lo; j <= hi; ++j){
+      if (taken[j]) continue;
+      uint64_t size = object_size(sizes, config[j].second);
+      if (size < bestSize){
+        best = j;
+        bestSize = size;
+      }
+    }
+    if (best != idx){
+      taken[idx] = false;
+      taken[best] = true;
+      idx = best;
+    }
+  }
+}
+
+/**
+ * Swap the chosen big and small elements pairwise, dropping the trades that
+ * would leave either side over the memory cap. Both partners run this on
+ * the same bigger/smaller lists and so keep the same trades.
+ */
+static uint64_t
+apply_trades(std::vector<pair64>& bigger, std::vector<pair64>& smaller,
+             const std::vector<int>& bigIdx, const std::vector<int>& smallIdx,
+             const object_sizes& sizes, uint64_t memoryCap)
+{
+  uint64_t biggerBytes = 0, smallerBytes = 0;
+  for (auto& pair : bigger) biggerBytes += object_size(sizes, pair.second);
+  for (auto& pair : smaller) smallerBytes += object_size(sizes, pair.second);
+
+  uint64_t totalDelta = 0;
+  for (int i=0; i < bigIdx.size(); ++i){
+    auto& bigTaskPair = bigger[bigIdx[i]];
+    auto& smallTaskPair = smaller[smallIdx[i]];
+    uint64_t bigBytes = object_size(sizes, bigTaskPair.second);
+    uint64_t smallBytes = object_size(sizes, smallTaskPair.second);
+    uint64_t newBigger = biggerBytes - bigBytes + smallBytes;
+    uint64_t newSmaller = smallerBytes - smallBytes + bigBytes;
+    if (memoryCap){
+      //a side may stay over the cap, but only if the trade does not grow it
+      bool overBigger = newBigger > memoryCap && newBigger > biggerBytes;
+      bool overSmaller = newSmaller > memoryCap && newSmaller > smallerBytes;
+      if (overBigger || overSmaller) continue;
+    }
+    biggerBytes = newBigger;
+    smallerBytes = newSmaller;
+    if (bigTaskPair.first > smallTaskPair.first){
+      totalDelta += bigTaskPair.first - smallTaskPair.first;
+    }
+    std::swap(bigTaskPair.second, smallTaskPair.second);
+    std::swap(bigTaskPair.first, smallTaskPair.first);
+  }
+  return totalDelta;
+}
+
+void
+dimension_exchange(std::vector<pair64>& lower, std::vector<pair64>& upper,
+                   const object_sizes& sizes, const comm_split_params& params)
+{
+  uint64_t lowerWork = 0, upperWork = 0;
+  for (auto& pair : lower) lowerWork += pair.first;
+  for (auto& pair : upper) upperWork += pair.first;
+  if (lowerWork == upperWork) return;
+
+  bool lowerGives = lowerWork > upperWork;
+  std::vector<pair64>& giver = lowerGives ? lower : upper;
+  std::vector<pair64>& taker = lowerGives ? upper : lower;
+  uint64_t giverWork = lowerGives ? lowerWork : upperWork;
+  uint64_t takerWork = lowerGives ? upperWork : lowerWork;
+  std::sort(giver.begin(), giver.end(), sort_by_weight());
+  std::sort(taker.begin(), taker.end(), sort_by_weight());
+
+  uint64_t takerBytes = 0;
+  for (auto& pair : taker) takerBytes += object_size(sizes, pair.second);
+
+  //give first, which is what lets the element counts change
+  uint64_t desiredDelta = (giverWork - takerWork) / 2;
+  std::set<int> toGive = take_tasks(desiredDelta, giver, giver.size());
+  for (auto iter = toGive.rbegin(); iter != toGive.rend(); ++iter){
+    pair64 given = giver[*iter];
+    uint64_t bytes = object_size(sizes, given.second);
+    if (params.memoryCap && takerBytes + bytes > params.memoryCap) continue;
+    takerBytes += bytes;
+    giverWork -= given.first;
+    takerWork += given.first;
+    taker.push_back(given);
+    giver.erase(giver.begin() + *iter);
+  }
+  std::sort(taker.begin(), taker.end(), sort_by_weight());
+
+  //then trade a big element for a small one if that closes the gap further
+  if (giverWork > takerWork && !giver.empty() && !taker.empty()){
+    desiredDelta = (giverWork - takerWork) / 2;
+    std::vector<int> bigIdx, smallIdx;
+    int maxTrades = std::min(giver.size(), taker.size());
+    trade_tasks(desiredDelta, giver, taker, bigIdx, smallIdx, maxTrades);
+    prefer_small_objects(giver, bigIdx, sizes, params.sizeTolerance);
+    prefer_small_objects(taker, smallIdx, sizes, params.sizeTolerance);
+    apply_trades(giver, taker, bigIdx, smallIdx, sizes, params.memoryCap);
+  }
+
+  std::sort(giver.begin(), giver.end(), sort_by_weight());
+  std::sort(taker.begin(), taker.end(), sort_by_weight());
+}
+
+void
+comm_split_exchange(std::vector<pair64>& localConfig, std::vector<pair64>& incomingConfig,
+                    uint64_t localWork, uint64_t perfBalance,
+                    int maxNumLocalTasks, bool allowTrades, bool allowGiveTake,
+                    const object_sizes& sizes, const comm_split_params& params)
+{
+  allowGiveTake = false;
+
+  uint64_t partnerTotalWork = 0;
+  for (auto& pair : incomingConfig) partnerTotalWork += pair.first;
+
+  int numLocalTasks = localConfig.size();
+  int numPartnerTasks = incomingConfig.size();
+
+  int maxTrades = maxNumLocalTasks;
+  bool exchangeFailed = true;
+  uint64_t closeness, minCloseness;
+
+  bool nothingToGain =    (localWork > perfBalance && partnerTotalWork > perfBalance)
+                       || (localWork <= perfBalance && partnerTotalWork <= perfBalance);
+
+  if (nothingToGain){
+    //well, I really hope that worked well
+    return;
+  }
+
+  int maxTake, maxGive;
+  if (localWork < partnerTotalWork){
+    // a bit tricky - the change in task sizes should be 1/2 the difference
+    uint64_t desiredDelta = (partnerTotalWork - localWork) / 2;
+    //the exchange needs to get this close to be called a "success"
+    minCloseness = desiredDelta / 10;
+    //less work here
+    if (numLocalTasks >= numPartnerTasks && allowTrades){
+      //this is awkward... I have more (or same) tasks but also less work
+      //I guess try to exchange some tasks, but don't make num task mismatch worse
+      std::vector<int> smallTaskIdx;
+      std::vector<int> bigTaskIdx;
+      /*incoming is bigger tasks, local is smaller tasks */
+      trade_tasks(desiredDelta, incomingConfig, localConfig,
+                  bigTaskIdx, smallTaskIdx, maxTrades);
+      prefer_small_objects(incomingConfig, bigTaskIdx, sizes, params.sizeTolerance);
+      prefer_small_objects(localConfig, smallTaskIdx, sizes, params.sizeTolerance);
+      uint64_t totalDelta = apply_trades(incomingConfig, localConfig, bigTaskIdx, smallTaskIdx,
+                                         sizes, params.memoryCap);
+
+      closeness = totalDelta > desiredDelta ? totalDelta - desiredDelta : desiredDelta - totalDelta;
+      exchangeFailed = closeness > minCloseness;
+    }
+  } else if (localWork > partnerTotalWork){
+    //more work here
+    uint64_t desiredDelta = (localWork - partnerTotalWork) / 2;
+    minCloseness = desiredDelta / 10;
+    if (numPartnerTasks >= numLocalTasks && allowTrades){
+      //this is awkward... I have fewer (or same) tasks but also more work
+      //I guess try to exchange some tasks, but don't make num task mismatch worse
+      /*local is bigger task, incoming is smaller task */
+      std::vector<int> smallTaskIdx;
+      std::vector<int> bigTaskIdx;
+      trade_tasks(desiredDelta, localConfig, incomingConfig,
+                  bigTaskIdx, smallTaskIdx, maxTrades);
+      prefer_small_objects(localConfig, bigTaskIdx, sizes, params.sizeTolerance);
+      prefer_small_objects(incomingConfig, smallTaskIdx, sizes, params.sizeTolerance);
+      uint64_t totalDelta = apply_trades(localConfig, incomingConfig, bigTaskIdx, smallTaskIdx,
+                                         sizes, params.memoryCap);
+
+      closeness = totalDelta > desiredDelta ? totalDelta - desiredDelta : desiredDelta - totalDelta;
+      exchangeFailed = closeness > minCloseness;
+    }
+  } else {
+    //exactly equal - don't do anything
+  }
+
+  //recompute where we got
+  partnerTotalWork = 0;
+  for (auto& pair : incomingConfig) partnerTotalWork += pair.first;
+  std::sort(incomingConfig.begin(), incomingConfig.end(), sort_by_weight());
+
+  localWork = 0;
+  for (auto& pair : localConfig) localWork += pair.first;
+  std::sort(localConfig.begin(), localConfig.end(), sort_by_weight());
+
+  if (exchangeFailed && allowGiveTake){
+    if (localWork < partnerTotalWork){
+      maxTake = maxGive = (numPartnerTasks - numLocalTasks) / 2 + 2;
+      uint64_t desiredDelta = (partnerTotalWork - localWork) / 2;
+      //I have less work and also fewer tasks, take some tasks
+      std::set<int> toTake = take_tasks(desiredDelta, incomingConfig, maxTake);
+      for (int bigTaskIdx : toTake){
+        localConfig.push_back(incomingConfig[bigTaskIdx]);
+      }
+    } else if (localWork > partnerTotalWork){
+      maxTake = maxGive = (numLocalTasks - numPartnerTasks) / 2 + 2;
+      uint64_t desiredDelta = (localWork - partnerTotalWork) / 2;
+      //I have more work and also more tasks - give some tasks away
+      std::set<int> toGive = take_tasks(desiredDelta, localConfig, maxGive);
+      std::list<int> sortedGive;
+      for (int bigTaskIdx : toGive){
+        sortedGive.push_front(bigTaskIdx);
+      }
+      for (int bigTaskIdx : sortedGive){
+        //this is the task I'm giving away
+        int lastIdx = localConfig.size() - 1;
+        localConfig[bigTaskIdx] = std::move(localConfig[lastIdx]);
+        localConfig.pop_back();
+      }
+    } else {
+      //huh - not sure how exchange failed but partners are exactly equal
+    }
+  }
+}
+
+std::set<int>
+take_tasks(uint64_t desiredDelta, const std::vector<pair64>& giver, int maxTake)
+{
+  std::set<int> toRet;
+  uint64_t deltaCutoff = desiredDelta / 10;
+  uint64_t maxGiveAway = desiredDelta + deltaCutoff;
+  uint64_t totalGiven = 0;
+  uint64_t remainingDelta = maxGiveAway;
+  int numTaken = 0;
+  for (int i=giver.size() - 1; i >= 0 && numTaken < maxTake; --i){
+    uint64_t taskSize = giver[i].first;
+    if (taskSize < remainingDelta){
+      toRet.insert(i); //give it away, give it away, give it away now
+      totalGiven += taskSize;
+      remainingDelta -= taskSize;
+      ++numTaken;
+    }
+  }
+  return toRet;
+}
+
+uint64_t
+trade_tasks(uint64_t desiredDelta,
+            uint64_t maxOverage,
+            const std::vector<pair64>& bigger,
+            const std::vector<pair64>& smaller,
+            int bigTaskIdx,
+            int smallTaskIdx)
+{
+  if (bigTaskIdx >= bigger.size() || smallTaskIdx >= smaller.size()){
+    fprintf(stderr, "out of bounds on trade_tasks\n");
+    abort();
+  }
+  //I assume the smaller, bigger are sorted least to greatest coming in
+  uint64_t smallTaskSize = smaller[smallTaskIdx].first;
+  uint64_t bigTaskSize = bigger[bigTaskIdx].first;
+  uint64_t delta = bigTaskSize - smallTaskSize;
+  if (desiredDelta > delta){
+    //this is moving us in the right direction - add it
+    return delta;
+  } else {
+    uint64_t delta_delta = delta - desiredDelta;
+    //this is too far - but maybe close enough that it's okay
+    if (delta_delta < maxOverage){
+      return delta;
+    }
+    return 0;
+  }
+}
+
+uint64_t
+trade_tasks(uint64_t desiredDelta,
+            const std::vector<pair64>& bigger,
+            const std::vector<pair64>& smaller,
+            std::vector<int>& bigTaskIdxs,
+            std::vector<int>& smallTaskIdxs,
+            int maxTrades)
+{
+  uint64_t totalDelta = 0;
+  int numTrades = 0;
+  int smallTaskIdx = 0;
+  int bigTaskIdx = bigger.size() - 1;
+  uint64_t maxOverage = desiredDelta / 8;
+  int smallTaskStop = smaller.size() - 1;
+  while (numTrades < maxTrades && totalDelta < desiredDelta
+         && smallTaskIdx <= smallTaskStop && bigTaskIdx >= 0)
+  {
+    uint64_t nextDelta = trade_tasks(desiredDelta-totalDelta, maxOverage,
+      bigger, smaller, bigTaskIdx, smallTaskIdx);
+
+    if (nextDelta > 0){
+      bigTaskIdxs.push_back(bigTaskIdx);
+      smallTaskIdxs.push_back(smallTaskIdx);
+      totalDelta += nextDelta;
+      ++smallTaskIdx;
+      --bigTaskIdx;
+      ++numTrades;
+    } else {
+      uint64_t smallTaskDelta = std::numeric_limits<uint64_t>::max();
+      uint64_t bigTaskDelta = std::numeric_limits<uint64_t>::max();
+      //increment whichever index causes the least change
+      if (smallTaskIdx < smallTaskStop)
+        smallTaskDelta = smaller[smallTaskIdx+1].first - smaller[smallTaskIdx].first;
+      if (bigTaskIdx > 0)
+        bigTaskDelta = bigger[bigTaskIdx].first - bigger[bigTaskIdx-1].first;
+
+      //depending on which produces the smallest delta, change that index
+      if (bigTaskDelta < smallTaskDelta) bigTaskIdx--;
+      else smallTaskIdx++;
+    }
+
+  }
+  return totalDelta;
+}
+
+std::vector<int>
+random_destinations(int rank, int size, uint64_t call, std::size_t count)
+{
+  std::mt19937_64 gen(uint64_t(rank) * 1000003 + call);
+  std::uniform_int_distribution<int> dist(0, size - 1);
+  std::vector<int> ret(count);
+  for (auto& dst : ret){
+    dst = dist(gen);
+  }
+  return ret;
+}
+
+bool
+auto_lb_pays_off(const auto_lb_params& params, uint64_t oldMax,
+                 uint64_t newMax, uint64_t migrateNs)
+{
+  if (newMax >= oldMax) return false;
+  double savings = double(oldMax - newMax) * params.horizon;
+  return savings > double(migrateNs);
+}
+
+rank_configs
+simulate_comm_split(rank_configs oldConfig, const comm_split_params& params,
+                    const object_sizes& sizes)
+{
+  int size = oldConfig.size();
+  uint64_t lastImbalance = std::numeric_limits<uint64_t>::max();
+  bool allowGiveTake = false;
+  for (int tryNum=0; tryNum < params.maxNumTries; ++tryNum){
+    std::vector<uint64_t> localWork(size, 0);
+    uint64_t minWork = std::numeric_limits<uint64_t>::max();
+    uint64_t maxWork = 0;
+    uint64_t totalWork = 0;
+    int maxNumLocalTasks = 0;
+    for (int r=0; r < size; ++r){
+      for (auto& pair : oldConfig[r]) localWork[r] += pair.first;
+      minWork = std::min(minWork, localWork[r]);
+      maxWork = std::max(maxWork, localWork[r]);
+      totalWork += localWork[r];
+      maxNumLocalTasks = std::max<int>(maxNumLocalTasks, oldConfig[r].size());
+    }
+
+    if (comm_split_done(params, minWork, maxWork, totalWork, size, lastImbalance)){
+      break;
+    }
+
+    allowGiveTake = allowGiveTake || tryNum >= 4;
+    for (auto& config : oldConfig){
+      std::sort(config.begin(), config.end(), sort_by_weight());
+    }
+
+    //the split communicator orders ranks by their work in thousands
+    std::vector<int> byWork(size);
+    std::iota(byWork.begin(), byWork.end(), 0);
+    std::stable_sort(byWork.begin(), byWork.end(), [&](int a, int b){
+      return localWork[a]/1000 < localWork[b]/1000;
+    });
+
+    uint64_t perfBalance = totalWork / size;
+    rank_configs newConfig(size);
+    for (int balanceRank=0; balanceRank < size; ++balanceRank){
+      int r = byWork[balanceRank];
+      int partner = byWork[trading_partner(balanceRank, size)];
+      newConfig[r] = oldConfig[r];
+      if (partner != r){
+        std::vector<pair64> incoming = oldConfig[partner];
+        comm_split_exchange(newConfig[r], incoming, localWork[r], perfBalance,
+                            maxNumLocalTasks, true, allowGiveTake, sizes, params);
+      }
+    }
+    oldConfig = std::move(newConfig);
+  }
+  return oldConfig;
+}
+
+rank_configs
+simulate_hypercube(rank_configs configs, const comm_split_params& params,
+                   const object_sizes& sizes)
+{
+  int size = configs.size();
+  int dims = 0;
+  while ((1 << dims) < size) ++dims;
+
+  uint64_t lastImbalance = std::numeric_limits<uint64_t>::max();
+  for (int sweep=0; sweep < params.maxNumTries; ++sweep){
+    uint64_t minWork = std::numeric_limits<uint64_t>::max();
+    uint64_t maxWork = 0;
+    uint64_t totalWork = 0;
+    for (auto& config : configs){
+      uint64_t work = 0;
+      for (auto& pair : config) work += pair.first;
+      minWork = std::min(minWork, work);
+      maxWork = std::max(maxWork, work);
+      totalWork += work;
+    }
+    if (comm_split_done(params, minWork, maxWork, totalWork, size, lastImbalance)){
+      break;
+    }
+
+    for (int d=0; d < dims; ++d){
+      for (int r=0; r < size; ++r){
+        int partner = r ^ (1 << d);
+        if (partner > r && partner < size){
+          dimension_exchange(configs[r], configs[partner], sizes, params);
+        }
+      }
+    }
+  }
+  return configs;
+}
+
+rank_configs
+simulate_random(rank_configs configs, uint64_t call)
+{
+  int size = configs.size();
+  rank_configs ret(size);
+  for (int r=0; r < size; ++r){
+    auto dsts = random_destinations(r, size, call, configs[r].size());
+    for (int i=0; i < dsts.size(); ++i){
+      ret[dsts[i]].push_back(configs[r][i]);
+    }
+  }
+  return ret;
+}
+
+rank_configs
+simulate_debug(rank_configs configs)
+{
+  int size = configs.size();
+  rank_configs ret = configs;
+  for (int r=0; r < size; ++r){
+    int partner = trading_partner(r, size);
+    if (partner == r) continue;
+    auto& local = ret[r];
+    if (!local.empty()) local.pop_back();
+    if (!configs[partner].empty()){
+      local.emplace_back(0, configs[partner].back().second);
+    }
+  }
+  return ret;
+}
+
+}
+}
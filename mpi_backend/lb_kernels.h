@@ -0,0 +1,183 @@
+#ifndef DARMA_BACKEND_LB_KERNELS_H
+#define DARMA_BACKEND_LB_KERNELS_H
+
+#include <cstdint>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace darma_backend {
+namespace lb {
+
+  /** A (weight, index) pair describing one element */
+  using pair64 = std::pair<uint64_t,uint64_t>;
+
+  /** One configuration per rank, indexed by rank */
+  using rank_configs = std::vector<std::vector<pair64>>;
+
+  /** Packed size of elements by index, elements not listed count as 0 bytes */
+  using object_sizes = std::unordered_map<uint64_t,uint64_t>;
+
+  /** The stopping rules and constraints of the comm-split balancer */
+  struct comm_split_params {
+    int maxNumTries = 5;          //rounds of pairwise exchange
+    double diffCutoff = 0.15;     //stop once (max-min)/avg work is below this
+    double minImprovement = 1.05; //stop once a round shrinks max-avg by less than this factor
+    double maxImbalance = 1.1;    //stop once max/avg work is below this
+    uint64_t memoryCap = 0;       //most element bytes a trade may leave on a rank, 0 for no cap
+    double sizeTolerance = 0.05;  //loads this close (relative) are traded for the smaller object
+  };
+
+  /** When --lb-auto lets a requested rebalance go ahead */
+  struct auto_lb_params {
+    bool enabled = false;
+    int horizon = 10;           //phases a new mapping is expected to pay off over
+    double minImbalance = 1.05; //skip the balancer below this max/avg predicted load
+    double bandwidth = 1.0;     //migration bytes/ns assumed until one is measured
+  };
+
+  /**
+   * @brief Decide whether moving to a new mapping is worth its migration
+   * @param params    The auto mode parameters
+   * @param oldMax    The most predicted work on any rank with the current mapping
+   * @param newMax    The most predicted work on any rank with the new mapping
+   * @param migrateNs The estimated time of the slowest rank to send its migrating elements
+   * @return Whether the savings over the horizon exceed the migration time
+   */
+  bool auto_lb_pays_off(const auto_lb_params& params, uint64_t oldMax,
+                        uint64_t newMax, uint64_t migrateNs);
+
+  struct sort_by_weight {
+    bool operator()(const pair64& lhs, const pair64& rhs) const {
+      return lhs.first < rhs.first;
+    }
+  };
+
+  /**
+   * @brief Decide whether the comm-split balancer should stop before another round
+   * @param params        The stopping rules
+   * @param minWork       The least work on any rank
+   * @param maxWork       The most work on any rank
+   * @param totalWork     The work summed over all ranks
+   * @param nranks        The number of ranks
+   * @param lastImbalance in-out max-avg work of the previous round
+   * @return Whether to stop
+   */
+  bool comm_split_done(const comm_split_params& params,
+                       uint64_t minWork, uint64_t maxWork, uint64_t totalWork,
+                       int nranks, uint64_t& lastImbalance);
+
+  /**
+   * @brief Pair the least loaded rank with the most loaded, and so on inwards
+   * @param rank The rank in order of increasing work
+   * @param size The number of ranks
+   * @return The partner to trade with, which is rank itself for the middle of an odd count
+   */
+  int trading_partner(int rank, int size);
+
+  /**
+   * @brief One side of a pairwise comm-split exchange. Both partners run this with
+   * the arguments swapped and reach the same trades.
+   * @param local     in-out this rank's elements, sorted by weight
+   * @param incoming  The partner's elements, sorted by weight
+   * @param localWork The work on this rank
+   * @param perfBalance The average work over all ranks
+   * @param maxNumLocalTasks The most elements on any rank
+   * @param allowTrades Whether one-for-one trades are allowed
+   * @param allowGiveTake Whether moving elements without a trade is allowed
+   * @param sizes     The packed sizes of the elements of both partners
+   * @param params    The memory cap and size tolerance to apply to the trades
+   */
+  void comm_split_exchange(std::vector<pair64>& local, std::vector<pair64>& incoming,
+                           uint64_t localWork, uint64_t perfBalance,
+                           int maxNumLocalTasks, bool allowTrades, bool allowGiveTake,
+                           const object_sizes& sizes, const comm_split_params& params);
+
+  /**
+   * @brief One round of dimension exchange. The more loaded partner gives
+   * elements to the other until their loads are close, then trades to close
+   * the remaining gap. Both partners run this with the lower rank's elements
+   * first and reach the same result.
+   * @param lower  in-out The elements of the lower rank
+   * @param upper  in-out The elements of the higher rank
+   * @param sizes  The packed sizes of the elements of both partners
+   * @param params The memory cap and size tolerance to apply
+   */
+  void dimension_exchange(std::vector<pair64>& lower, std::vector<pair64>& upper,
+                          const object_sizes& sizes, const comm_split_params& params);
+
+  /**
+   * @brief Swap chosen elements for unchosen ones of similar load but smaller size
+   * @param config    The elements of one rank, sorted by weight
+   * @param chosen    in-out The positions in config picked for trading
+   * @param sizes     The packed sizes of the elements
+   * @param tolerance The largest relative load difference of a substitute
+   */
+  void prefer_small_objects(const std::vector<pair64>& config, std::vector<int>& chosen,
+                            const object_sizes& sizes, double tolerance);
+
+  /** @brief The packed size of an element, 0 if unknown */
+  inline uint64_t object_size(const object_sizes& sizes, uint64_t index){
+    auto iter = sizes.find(index);
+    return iter == sizes.end() ? 0 : iter->second;
+  }
+
+  /**
+   * @brief tradeTasks Try to find two tasks to trade between ranks that have a given difference
+   * in workload size. Note, the desired delta is 1/2 the difference in total workload since
+   * once subtracts and the other adds
+   * @param desiredDelta The difference between big/small tasks wanted for exact match
+   * @param bigger  The list of task sizes on the rank with bigger workload
+   * @param smaller The list of task sizes on the rank with smaller workload
+   * @param biggerIdx The index of the task in bigger list that best satisfies desired delta
+   * @param smallerIdx The index of the task in small list that best satisfies desired delta
+   * @return The actual delta achieved
+   */
+  uint64_t trade_tasks(uint64_t desiredDelta,
+                       const std::vector<pair64>& bigger,
+                       const std::vector<pair64>& smaller,
+                       std::vector<int>& biggerIdx,
+                       std::vector<int>& smallerIdx,
+                       int maxTrades);
+
+  uint64_t trade_tasks(uint64_t desiredDelta,
+                       uint64_t maxOverage,
+                       const std::vector<pair64>& bigger,
+                       const std::vector<pair64>& smaller,
+                       int biggerIdx, int smallerIdx);
+
+  /**
+   * @brief takeTasks Try to find a set of tasks to balance workload between two rans.
+   * Note, the desired delta is 1/2 the difference in total workload.
+   * @param desiredDelta The difference between big/small tasks wanted for exact match
+   * @param giver The list of task sizes on the rank with bigger workload
+   * @return The set of tasks that best matches delta
+   */
+  std::set<int> take_tasks(uint64_t desiredDelta, const std::vector<pair64>& giver, int maxTake);
+
+  /**
+   * @brief The rank each element goes to under the random balancer
+   * @param rank  The rank the elements are on
+   * @param size  The number of ranks
+   * @param call  How many times the balancer ran before on this rank
+   * @param count The number of local elements
+   */
+  std::vector<int> random_destinations(int rank, int size, uint64_t call, std::size_t count);
+
+  /*
+   * Sequential replays of the distributed balancers over simulated ranks.
+   * Given the same configurations they return what every rank would end up
+   * with after the MPI version, so parameters can be tuned offline.
+   */
+  rank_configs simulate_comm_split(rank_configs configs, const comm_split_params& params,
+                                   const object_sizes& sizes = object_sizes());
+  rank_configs simulate_hypercube(rank_configs configs, const comm_split_params& params,
+                                  const object_sizes& sizes = object_sizes());
+  rank_configs simulate_random(rank_configs configs, uint64_t call);
+  rank_configs simulate_debug(rank_configs configs);
+
+}
+}
+
+#endif  // DARMA_BACKEND_LB_KERNELS_H
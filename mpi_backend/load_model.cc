@@ -0,0 +1,93 @@
+#include "load_model.h"
+#include <algorithm>
+#include <vector>
+
+namespace darma_backend {
+namespace lb {
+
+void
+record_load(load_history& hist, uint64_t load, const load_model_params& params)
+{
+  if (hist.count == 0){
+    hist.ewma = load;
+  } else {
+    hist.ewma = params.alpha * load + (1.0 - params.alpha) * hist.ewma;
+  }
+
+  if (hist.count < load_history::capacity){
+    hist.samples[(hist.head + hist.count) % load_history::capacity] = load;
+    ++hist.count;
+  } else {
+    hist.samples[hist.head] = load;
+    hist.head = (hist.head + 1) % load_history::capacity;
+  }
+}
+
+static uint64_t
+predict_trend(const load_history& hist, int n)
+{
+  //fit load = a + b*x with x=0 the oldest and x=n-1 the newest sample
+  double sumX = 0, sumY = 0, sumXX = 0, sumXY = 0;
+  for (int x=0; x < n; ++x){
+    double y = hist.newest(n - 1 - x);
+    sumX += x;
+    sumY += y;
+    sumXX += double(x)*x;
+    sumXY += x*y;
+  }
+  double denom = n*sumXX - sumX*sumX;
+  double slope = denom == 0 ? 0 : (n*sumXY - sumX*sumY) / denom;
+  double intercept = (sumY - slope*sumX) / n;
+  double next = intercept + slope*n;
+  //a falling load must not extrapolate to nothing, the balancers need a weight
+  return next >= 1 ? uint64_t(next) : 1;
+}
+
+static uint64_t
+predict_median(const load_history& hist, int n)
+{
+  std::vector<uint64_t> recent(n);
+  for (int i=0; i < n; ++i) recent[i] = hist.newest(i);
+  std::sort(recent.begin(), recent.end());
+  if (n % 2 == 1) return recent[n/2];
+  return (recent[n/2 - 1] + recent[n/2]) / 2;
+}
+
+uint64_t
+predict_load(const load_history& hist, const load_model_params& params)
+{
+  if (hist.count == 0) return 0;
+
+  int n = std::max(1, std::min<int>(params.window, hist.count));
+  switch(params.type){
+    case LastPhase:
+      return hist.newest(0);
+    case Ewma:
+      return uint64_t(hist.ewma);
+    case LinearTrend:
+      return predict_trend(hist, n);
+    case Median:
+      return predict_median(hist, n);
+  }
+  return hist.newest(0);
+}
+
+bool
+load_model_from_name(const std::string& name, load_model_t& type)
+{
+  if (name == "last"){
+    type = LastPhase;
+  } else if (name == "ewma"){
+    type = Ewma;
+  } else if (name == "trend"){
+    type = LinearTrend;
+  } else if (name == "median"){
+    type = Median;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+}
+}
@@ -0,0 +1,77 @@
+#ifndef DARMA_BACKEND_LOAD_MODEL_H
+#define DARMA_BACKEND_LOAD_MODEL_H
+
+#include <cstdint>
+#include <string>
+
+namespace darma_backend {
+namespace lb {
+
+  /** How the load of an element in the next phase is predicted from past phases */
+  enum load_model_t {
+    LastPhase,   //the load measured in the last phase
+    Ewma,        //exponentially weighted moving average
+    LinearTrend, //least squares line through the last window phases, one phase ahead
+    Median,      //median of the last window phases
+  };
+
+  struct load_model_params {
+    load_model_t type = LastPhase;
+    double alpha = 0.5; //weight of the newest phase in the moving average
+    int window = 5;     //phases used by the trend and median, at most load_history::capacity
+  };
+
+  /**
+   * The loads measured for one element over its last phases. This is plain
+   * data so it can be shipped to the new owner when the element migrates.
+   */
+  struct load_history {
+    static constexpr int capacity = 8;
+
+    uint64_t samples[capacity]; //ring buffer, newest at (head + count - 1) % capacity
+    uint32_t head;
+    uint32_t count;
+    double ewma;
+
+    load_history(){
+      clear();
+    }
+
+    void clear(){
+      for (auto& s : samples) s = 0;
+      head = 0;
+      count = 0;
+      ewma = 0;
+    }
+
+    /** @brief The i-th newest sample, 0 being the last phase */
+    uint64_t newest(int i) const {
+      return samples[(head + count - 1 - i) % capacity];
+    }
+  };
+
+  /**
+   * @brief Add the load measured in a finished phase
+   * @param hist   The history of the element
+   * @param load   The measured load
+   * @param params The model, which sets the moving average weight
+   */
+  void record_load(load_history& hist, uint64_t load, const load_model_params& params);
+
+  /**
+   * @brief Predict the load of the next phase
+   * @return The predicted load, or 0 if nothing was recorded yet. A trend
+   *         never extrapolates below 1.
+   */
+  uint64_t predict_load(const load_history& hist, const load_model_params& params);
+
+  /**
+   * @brief Look up a model by its command line name: last, ewma, trend or median
+   * @return Whether the name is known
+   */
+  bool load_model_from_name(const std::string& name, load_model_t& type);
+
+}
+}
+
+#endif  // DARMA_BACKEND_LOAD_MODEL_H
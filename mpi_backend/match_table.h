@@ -0,0 +1,182 @@
+#ifndef DARMA_BACKEND_MATCH_TABLE_H
+#define DARMA_BACKEND_MATCH_TABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+namespace darma_backend {
+  /**
+   * Message matching keyed by (source rank, tag), where the tag already
+   * names the collection and both elements. Every key owns a FIFO queue of
+   * entries threaded through their own next pointer, so queueing allocates
+   * nothing once the entry pool has warmed up. The keys live in one flat
+   * array with linear probing and backward-shift deletion, which leaves no
+   * tombstones behind when a queue drains.
+   *
+   * @tparam Entry The queued type, which must have an Entry* next member
+   */
+  template <class Entry>
+  class match_table {
+   public:
+    /**
+     * @param capacity The initial number of slots, rounded up to a power of two
+     */
+    explicit match_table(size_t capacity = 64) :
+      used_(0), queued_(0)
+    {
+      size_t n = 8;
+      while (n < capacity) n *= 2;
+      slots_.resize(n);
+      mask_ = n - 1;
+    }
+
+    static uint64_t key(int source, int tag){
+      return uint64_t(uint32_t(source)) << 32 | uint32_t(tag);
+    }
+
+    /**
+     * @brief The oldest entry queued under key
+     * @return The entry, or null if nothing is queued
+     */
+    Entry* front(uint64_t k) const {
+      size_t i = find(k);
+      return i == npos ? nullptr : slots_[i].head;
+    }
+
+    void push_back(uint64_t k, Entry* e){
+      e->next = nullptr;
+      ++queued_;
+      size_t i = find(k);
+      if (i != npos){
+        slots_[i].tail->next = e;
+        slots_[i].tail = e;
+        return;
+      }
+      //keep the load at most one half so probe chains stay short
+      if (2*(used_ + 1) > slots_.size()) grow();
+      i = insert_slot(k);
+      slots_[i].head = slots_[i].tail = e;
+    }
+
+    /**
+     * @brief Remove the oldest entry queued under key
+     * @return The entry, or null if nothing is queued
+     */
+    Entry* pop_front(uint64_t k){
+      size_t i = find(k);
+      if (i == npos) return nullptr;
+      Entry* e = slots_[i].head;
+      slots_[i].head = e->next;
+      if (!e->next) erase_slot(i);
+      e->next = nullptr;
+      --queued_;
+      return e;
+    }
+
+    /** @brief An entry from the pool, to be given back with release */
+    Entry* allocate(){
+      if (free_.empty()){
+        pool_.emplace_back();
+        return &pool_.back();
+      }
+      Entry* e = free_.back();
+      free_.pop_back();
+      return e;
+    }
+
+    void release(Entry* e){
+      *e = Entry();
+      free_.push_back(e);
+    }
+
+    /** @brief The number of entries queued under all keys */
+    size_t size() const {
+      return queued_;
+    }
+
+    /** @brief The number of keys with a nonempty queue */
+    size_t keys() const {
+      return used_;
+    }
+
+   private:
+    static constexpr size_t npos = size_t(-1);
+
+    struct slot {
+      uint64_t key = 0;
+      Entry* head = nullptr;
+      Entry* tail = nullptr;
+    };
+
+    size_t home(uint64_t k) const {
+      //splitmix64 finalizer - tags differ mostly in their middle bits
+      k ^= k >> 30;
+      k *= 0xbf58476d1ce4e5b9ULL;
+      k ^= k >> 27;
+      k *= 0x94d049bb133111ebULL;
+      k ^= k >> 31;
+      return k & mask_;
+    }
+
+    size_t find(uint64_t k) const {
+      for (size_t i = home(k); slots_[i].head; i = (i + 1) & mask_){
+        if (slots_[i].key == k) return i;
+      }
+      return npos;
+    }
+
+    size_t insert_slot(uint64_t k){
+      size_t i = home(k);
+      while (slots_[i].head) i = (i + 1) & mask_;
+      slots_[i].key = k;
+      ++used_;
+      return i;
+    }
+
+    void erase_slot(size_t i){
+      //pull later members of the probe chain back over the hole
+      size_t j = i;
+      while (true){
+        slots_[i] = slot();
+        while (true){
+          j = (j + 1) & mask_;
+          if (!slots_[j].head){
+            --used_;
+            return;
+          }
+          size_t h = home(slots_[j].key);
+          //the entry at j may move to i only if its home is not in (i,j]
+          bool stays = i <= j ? (i < h && h <= j) : (i < h || h <= j);
+          if (!stays) break;
+        }
+        slots_[i] = slots_[j];
+        i = j;
+      }
+    }
+
+    void grow(){
+      std::vector<slot> old(slots_.size() * 2);
+      old.swap(slots_);
+      mask_ = slots_.size() - 1;
+      used_ = 0;
+      for (slot& s : old){
+        if (s.head){
+          size_t i = insert_slot(s.key);
+          slots_[i] = s;
+        }
+      }
+    }
+
+    std::vector<slot> slots_;
+    size_t mask_;
+    size_t used_;
+    size_t queued_;
+    //deque never moves what it holds, the queues point into it
+    std::deque<Entry> pool_;
+    std::vector<Entry*> free_;
+  };
+}
+
+#endif  // DARMA_BACKEND_MATCH_TABLE_H
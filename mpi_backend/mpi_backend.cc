@@ -4,10 +4,19 @@
 #include <iostream>
 #include <cstdarg>
 #include <sstream>
+#include <cstring>
+#include <algorithm>
+#include <set>
+#include <unordered_map>
 #include <CLI/CLI.hpp>
 
 int MpiBackend::taskIdCtr_ = 1;
-std::vector<RecvOpGeneratorBase<MpiBackend::Context>*> MpiBackend::generators_;
+std::vector<RecvOpGeneratorBase<MpiBackend::Context>*>&
+MpiBackend::generators()
+{
+  static std::vector<RecvOpGeneratorBase<Context>*> gens;
+  return gens;
+}
 
 static inline std::string str_tolower(std::string&& s) {
   std::transform(s.begin(), s.end(), s.begin(),
@@ -30,10 +39,45 @@ static void perfCtrReduceFxn(void* a, void* b, int* len, MPI_Datatype* type)
   inout->maxLocalTasks = std::max(inout->maxLocalTasks, in->maxLocalTasks);
 }
 
+static void phaseTimesReduceFxn(void* a, void* b, int* len, MPI_Datatype* type)
+{
+  MpiBackend::PhaseTimesReduce* in = (MpiBackend::PhaseTimesReduce*) a;
+  MpiBackend::PhaseTimesReduce* inout = (MpiBackend::PhaseTimesReduce*) b;
+
+  for (int i=0; i < MpiBackend::PhaseTimes::NumCategories; ++i){
+    inout->min[i] = std::min(inout->min[i], in->min[i]);
+    inout->max[i] = std::max(inout->max[i], in->max[i]);
+    inout->total[i] += in->total[i];
+  }
+}
+
 MpiBackend::MpiBackend(MPI_Comm comm, int argc, char** argv) :
   comm_(comm),
   collIdCtr_(0),
-  numPendingProbes_(0)
+  numPendingProbes_(0),
+  activeSent_(0),
+  activeRecvd_(0),
+  numLocalActive_(0),
+  messageChunk_(darma_backend::max_message_chunk),
+  creditShare_(0),
+  creditComm_(MPI_COMM_NULL),
+  numHeld_(0),
+  numHeldTotal_(0),
+  unexpectedBytes_(0),
+  peakUnexpectedBytes_(0),
+  phaseReport_(false),
+  phaseCount_(0),
+  numCompleted_(0),
+  numTasksRun_(0),
+  phaseTimes_(),
+  lastPhaseReport_(),
+  ranksPerNode_(0),
+  migrationStats_(),
+  phaseMigration_(),
+  activeCounters_(nullptr),
+  timeSerialization_(false),
+  migrateBytesPerNs_(0),
+  dumpLb_(false)
 {
   auto& fe = frontend();
   int app_argc = fe.split_argv(argc, argv);
@@ -44,11 +88,61 @@ MpiBackend::MpiBackend(MPI_Comm comm, int argc, char** argv) :
 
 
   std::string lbType = "commSplit";
+  std::string collectives = "flat";
+  int traceEvents = 1 << 16;
+  bool useHwCounters = false;
+  std::string lbDumpPath;
+  std::string loadModel = "last";
+  double autoLbBandwidth = 1000;
+  double memCapMB = 0;
+  int numThreads = 1;
+  double unexpectedCapMB = 0;
+  uint64_t messageChunk = messageChunk_;
   std::vector<std::string> debugs;
   if (be_argc > 0){
     CLI::App app{"DARMA MPI Backend"};
     app.add_option("--lb", lbType, "the load balancer type to use");
     app.add_option("-d,--debug", debugs, "debug flags to activate");
+    app.add_option("--collectives", collectives,
+                   "flat or hierarchical (node-aware) reduce/gather/broadcast");
+    app.add_option("--ranks-per-node", ranksPerNode_,
+                   "emulate nodes of this many ranks for hierarchical collectives and load balancing");
+    app.add_option("--trace", tracePrefix_,
+                   "record a trace of tasks, messages and load balancing to <prefix>.<rank>.bin");
+    app.add_option("--trace-events", traceEvents,
+                   "the number of most recent events each rank keeps in its trace");
+    app.add_flag("--time-serialization", timeSerialization_,
+                 "count time spent packing and unpacking messages per element");
+    app.add_flag("--hw-counters", useHwCounters,
+                 "count cycles and instructions per element with perf_event");
+    app.add_option("--lb-model", loadModel,
+                   "how element loads are predicted from past phases: last, ewma, trend or median");
+    app.add_option("--lb-model-alpha", loadModel_.alpha,
+                   "weight of the newest phase in the ewma model");
+    app.add_option("--lb-model-window", loadModel_.window,
+                   "number of past phases used by the trend and median models");
+    app.add_flag("--lb-auto", autoLb_.enabled,
+                 "only rebalance when the predicted savings outweigh the migration cost");
+    app.add_option("--lb-auto-horizon", autoLb_.horizon,
+                   "phases a new mapping is expected to pay off over");
+    app.add_option("--lb-auto-threshold", autoLb_.minImbalance,
+                   "max/avg predicted load below which the balancer is not run");
+    app.add_option("--lb-auto-bandwidth", autoLbBandwidth,
+                   "migration bandwidth in MB/s assumed until one is measured");
+    app.add_option("--lb-mem-cap", memCapMB,
+                   "most element memory in MB the commsplit balancer may move onto a rank, 0 for no cap");
+    app.add_option("--lb-size-tolerance", commSplitParams_.sizeTolerance,
+                   "relative load difference within which commsplit trades the smaller element");
+    app.add_option("--lb-dump", lbDumpPath,
+                   "append the index, rank, load and size of every element to this file before each rebalance");
+    app.add_option("--threads", numThreads,
+                   "threads per rank that run create_concurrent_work loops");
+    app.add_option("--unexpected-mem-cap", unexpectedCapMB,
+                   "most put_task payload in MB that may be in flight to a rank, 0 for no flow control");
+    app.add_option("--message-chunk", messageChunk,
+                   "largest run of bytes a message describes with one MPI count, larger messages are sent in chunks");
+    app.add_flag("--phase-report", phaseReport_,
+                 "print the min/avg/max compute, communication, idle, LB and migration time of each phase");
     try {
       app.parse(be_argc, be_argv);
     } catch (const CLI::ParseError &e) {
@@ -72,28 +166,97 @@ MpiBackend::MpiBackend(MPI_Comm comm, int argc, char** argv) :
     }
   }
 
-  std::map<std::string, lb_type_t> lbs{
-    { "random", RandomLB },
-    { "commsplit", CommSplitLB },
-#if DARMA_ZOLTAN_LB
-    { "zoltan", ZoltanLB },
-#endif
-    { "debug", DebugLB },
-  };
+  set_load_balancer(lbType);
 
-  auto iter = lbs.find(str_tolower(std::move(lbType)));
-  if (iter == lbs.end()){
-    std::cerr << "Supported load balancers are:\n";
-    for (auto& pair : lbs){
-      std::cerr << pair.first << "\n";
-    }
-    error("Invalid load balancer %s specified - either type-o or not configured to support",
-          lbType.c_str());
+  auto modelName = str_tolower(std::move(loadModel));
+  if (!darma_backend::lb::load_model_from_name(modelName, loadModel_.type)){
+    error("Invalid load model %s - must be last, ewma, trend or median", modelName.c_str());
+  }
+  if (loadModel_.alpha <= 0 || loadModel_.alpha > 1){
+    error("Invalid load model alpha %f - must be in (0,1]", loadModel_.alpha);
+  }
+  if (memCapMB < 0){
+    error("Invalid load balancer memory cap %f", memCapMB);
+  }
+  commSplitParams_.memoryCap = uint64_t(memCapMB * 1024 * 1024);
+
+  if (autoLb_.horizon < 1){
+    error("Invalid auto load balancing horizon %d", autoLb_.horizon);
+  }
+  if (autoLbBandwidth <= 0){
+    error("Invalid auto load balancing bandwidth %f", autoLbBandwidth);
+  }
+  //MB/s to bytes/ns
+  autoLb_.bandwidth = autoLbBandwidth * 1e-3;
+  migrateBytesPerNs_ = autoLb_.bandwidth;
+
+  if (loadModel_.window < 1 || loadModel_.window > darma_backend::lb::load_history::capacity){
+    error("Invalid load model window %d - must be in [1,%d]",
+          loadModel_.window, darma_backend::lb::load_history::capacity);
   }
-  lbType_ = iter->second;
 
   MPI_Comm_rank(comm, &rank_);
   MPI_Comm_size(comm, &size_);
+  //migration and load balancer traffic must never be mistaken for an active message by the probes
+  MPI_Comm_dup(comm, &migrateComm_);
+  MPI_Comm_dup(comm, &gatherComm_);
+
+  auto collType = str_tolower(std::move(collectives));
+  if (collType == "hierarchical"){
+    topology_ = std::make_unique<darma_backend::node_topology>(comm, ranksPerNode_);
+  } else if (collType != "flat"){
+    error("Invalid collectives type %s - must be flat or hierarchical", collType.c_str());
+  }
+
+  if (!lbDumpPath.empty()){
+    dumpLb_ = true;
+    if (rank_ == 0 && !lbDump_.open(lbDumpPath)){
+      error("Unable to open load balancer dump %s", lbDumpPath.c_str());
+    }
+  }
+
+  if (messageChunk < 1 || messageChunk > darma_backend::max_message_chunk){
+    error("Invalid message chunk %llu - must be in [1,%llu]", (unsigned long long) messageChunk,
+          (unsigned long long) darma_backend::max_message_chunk);
+  }
+  messageChunk_ = messageChunk;
+
+  if (unexpectedCapMB < 0){
+    error("Invalid unexpected message memory cap %f", unexpectedCapMB);
+  } else if (unexpectedCapMB > 0){
+    //every peer gets an equal share of the budget, at least one byte
+    int64_t cap = int64_t(unexpectedCapMB * 1024 * 1024);
+    creditShare_ = std::max<int64_t>(1, cap / std::max(1, size_ - 1));
+    MPI_Comm_dup(comm, &creditComm_);
+    credits_.assign(size_, creditShare_);
+    owed_.assign(size_, 0);
+    held_.resize(size_);
+  }
+
+  if (numThreads < 1){
+    error("Invalid number of threads %d", numThreads);
+  } else if (numThreads > 1){
+    threads_ = std::make_unique<darma_backend::thread_pool>(numThreads);
+  }
+
+  if (useHwCounters){
+    hwCounters_ = std::make_unique<darma_backend::hw_counters>();
+    if (!hwCounters_->open()){
+      if (rank_ == 0){
+        std::cerr << "Hardware counters unavailable - continuing without them" << std::endl;
+      }
+      hwCounters_.reset();
+    }
+  }
+
+  if (!tracePrefix_.empty()){
+    if (traceEvents <= 0){
+      error("Invalid number of trace events %d", traceEvents);
+    }
+    //line up the start of the trace on all ranks
+    MPI_Barrier(comm);
+    trace_.enable(traceEvents);
+  }
 
   requests_.reserve(1024);
   statuses_.reserve(1024);
@@ -111,6 +274,17 @@ MpiBackend::MpiBackend(MPI_Comm comm, int argc, char** argv) :
     error("Unable to create performance counter reduce op");
   }
 
+  ierr = MPI_Type_contiguous(sizeof(PhaseTimesReduce)/sizeof(uint64_t), MPI_UINT64_T, &phaseTimesType_);
+  if (ierr != MPI_SUCCESS){
+    error("Unable to create phase times reduce type");
+  }
+  MPI_Type_commit(&phaseTimesType_);
+
+  ierr = MPI_Op_create(phaseTimesReduceFxn, 1, &phaseTimesOp_);
+  if (ierr != MPI_SUCCESS){
+    error("Unable to create phase times reduce op");
+  }
+
 }
 
 template <int T>
@@ -134,6 +308,22 @@ MpiBackend::~MpiBackend()
 
   MPI_Type_free(&perfCtrType_);
   MPI_Op_free(&perfCtrOp_);
+  MPI_Type_free(&phaseTimesType_);
+  MPI_Op_free(&phaseTimesOp_);
+  MPI_Comm_free(&migrateComm_);
+  MPI_Comm_free(&gatherComm_);
+  if (creditComm_ != MPI_COMM_NULL){
+    for (auto& pair : creditSends_){
+      MPI_Wait(&pair.second, MPI_STATUS_IGNORE);
+    }
+    MPI_Comm_free(&creditComm_);
+  }
+  topology_.reset();
+  lbTopology_.reset();
+
+  if (trace_.enabled()){
+    trace_.dump(tracePrefix_ + "." + std::to_string(rank_) + ".bin", rank_);
+  }
 }
 
 static const uint32_t collIdMask = 0xF << 16;
@@ -161,87 +351,182 @@ MpiBackend::makeUniqueTag(int collId, int dstId, int srcId, int taskId){
   return tag;
 }
 
+static const std::map<std::string, MpiBackend::lb_type_t>&
+load_balancer_types()
+{
+  static const std::map<std::string, MpiBackend::lb_type_t> lbs{
+    { "random", MpiBackend::RandomLB },
+    { "commsplit", MpiBackend::CommSplitLB },
+#if DARMA_ZOLTAN_LB
+    { "zoltan", MpiBackend::ZoltanLB },
+#endif
+    { "debug", MpiBackend::DebugLB },
+    { "hierarchical", MpiBackend::HierarchicalLB },
+    { "hypercube", MpiBackend::HypercubeLB },
+  };
+  return lbs;
+}
+
+darma_backend::node_topology&
+MpiBackend::lb_topology()
+{
+  if (topology_) return *topology_;
+  if (!lbTopology_){
+    lbTopology_ = std::make_unique<darma_backend::node_topology>(comm_, ranksPerNode_);
+  }
+  return *lbTopology_;
+}
+
+std::vector<std::string>
+MpiBackend::load_balancers()
+{
+  std::vector<std::string> ret;
+  for (auto& pair : load_balancer_types()){
+    ret.push_back(pair.first);
+  }
+  return ret;
+}
+
+void
+MpiBackend::set_load_balancer(const std::string& name)
+{
+  auto& lbs = load_balancer_types();
+  auto iter = lbs.find(str_tolower(std::string(name)));
+  if (iter == lbs.end()){
+    std::cerr << "Supported load balancers are:\n";
+    for (auto& pair : lbs){
+      std::cerr << pair.first << "\n";
+    }
+    error("Invalid load balancer %s specified - either type-o or not configured to support",
+          name.c_str());
+  }
+  lbType_ = iter->second;
+}
+
 std::vector<MpiBackend::pair64>
 MpiBackend::balance(const std::vector<LocalIndex>& local)
 {
   std::vector<pair64> localConfig(local.size());
+  darma_backend::lb::object_sizes sizes;
   for (int i=0; i < local.size(); ++i){
     pair64& p = localConfig[i];
     const LocalIndex& lidx = local[i];
-    p.first = lidx.counters.counter;
+    p.first = darma_backend::lb::predict_load(lidx.history, loadModel_);
     p.second = lidx.index;
+    if (lidx.bytes) sizes[lidx.index] = lidx.bytes;
   }
-  return balance(std::move(localConfig));
+  return balance(std::move(localConfig), sizes);
 }
 
 std::vector<MpiBackend::pair64>
 MpiBackend::balance(std::vector<pair64>&& localConfig)
 {
+  return balance(std::move(localConfig), darma_backend::lb::object_sizes());
+}
+
+std::vector<MpiBackend::pair64>
+MpiBackend::balance(std::vector<pair64>&& localConfig,
+                    const darma_backend::lb::object_sizes& sizes)
+{
+  lastBalanceRounds_ = 1;
   switch(lbType_){
     case ZoltanLB:
       return zoltanBalance(std::move(localConfig));
     case CommSplitLB:
-      return commSplitBalance(std::move(localConfig));
+      return commSplitBalance(std::move(localConfig), sizes);
     case RandomLB:
       return randomBalance(std::move(localConfig));
     case DebugLB:
       return debugBalance(std::move(localConfig));
+    case HierarchicalLB:
+      return hierarchicalBalance(std::move(localConfig), sizes);
+    case HypercubeLB:
+      return hypercubeBalance(std::move(localConfig), sizes);
   }
   
   return std::vector<MpiBackend::pair64>{};
 }
 
+void
+MpiBackend::post_probed_recv(const MPI_Status& stat)
+{
+  //this might be an incoming task - or it might just be a message
+  PendingRecvBase* recv = nullptr;
+  int tag = stat.MPI_TAG;
+  int collId = (tag & collIdMask) >> 16;
+  int dstId = (tag & dstIdMask) >> 10;
+  int srcId = (tag & srcIdMask) >> 4;
+  int taskId = (tag & taskIdMask);
+  bool generated = false;
+  if (taskId != 0){
+    //this delivered a task to me
+    if (taskId >= int(generators().size()) || !generators()[taskId]){
+      error("Rank %d received a task with unregistered id %d - "
+            "register every put_task accessor with recv_task_id at static scope",
+            rank_, taskId);
+    }
+    auto& gen = generators()[taskId];
+    recv = gen->generate(frontendPtr(), dstId, collId);
+    generated = true;
+    ++activeRecvd_;
+  } else {
+    auto key = matches_.key(stat.MPI_SOURCE, tag);
+    MatchEntry* entry = matches_.front(key);
+    if (entry && entry->pending){
+      recv = entry->pending;
+      matches_.release(matches_.pop_front(key));
+    }
+  }
+
+  std::size_t size = darma_backend::probed_bytes(stat);
+  void* data = allocate_temp_buffer(size);
+  int reqId;
+  if (generated){
+    //nobody is waiting on this - the recv listens on its own request
+    reqId = allocate_request();
+    recv->setId(reqId);
+    recv->increment_join_counter();
+    listeners_[reqId] = recv;
+    recv->configure(this, size, data);
+    recv->setUnexpectedSource(stat.MPI_SOURCE);
+    count_unexpected(size);
+  } else if (recv){
+    //probe we expected
+    --numPendingProbes_;
+    recv->configure(this, size, data);
+    reqId = recv->id();
+  } else {
+    //this was not a pending pro
+    reqId = allocate_request();
+    MatchEntry* entry = matches_.allocate();
+    entry->id = reqId;
+    entry->size = size;
+    entry->data = data;
+    matches_.push_back(matches_.key(stat.MPI_SOURCE, tag), entry);
+    count_unexpected(size);
+  }
+  trace_.post(reqId, darma_backend::TraceRecv, stat.MPI_SOURCE, stat.MPI_TAG, size);
+  recv_data(stat.MPI_SOURCE, data, size, stat.MPI_TAG, comm_, &requests_[reqId]);
+}
+
 void
 MpiBackend::create_pending_recvs()
 {
-  int numIter = 0;
+  //the messages we block on may wait for the credits we owe
+  if (numPendingProbes_ > 0) return_credits(true);
   while(numPendingProbes_ > 0){
     MPI_Status stat;
     MPI_Probe(MPI_ANY_SOURCE, MPI_ANY_TAG, comm_, &stat);
+    post_probed_recv(stat);
+  }
 
-
-    //this might be an incoming task - or it might just be a message
-    PendingRecvBase* recv = nullptr;
-    int tag = stat.MPI_TAG;
-    int collId = (tag & collIdMask) >> 16;
-    int dstId = (tag & dstIdMask) >> 10;
-    int srcId = (tag & srcIdMask) >> 4;
-    int taskId = (tag & taskIdMask);
-    if (taskId != 0){
-      //this delivered a task to me
-      auto& gen = generators_[taskId];
-      recv = gen->generate(frontendPtr(), dstId, collId);
-    } else {
-      auto& rankMap = pendingRecvs_[stat.MPI_SOURCE];
-      auto iter = rankMap.find(stat.MPI_TAG);
-      if (iter != rankMap.end()){
-        auto& list = iter->second;
-        recv = list.front();
-        list.pop_front();
-        if (list.empty()){
-          rankMap.erase(iter);
-        }
-      }
-    }
-
-    int size; MPI_Get_count(&stat, MPI_BYTE, &size);
-    void* data = allocate_temp_buffer(size);
-    int reqId;
-    if (recv){
-      //probe we expected
-      --numPendingProbes_;
-      recv->configure(this, size, data);
-      reqId = recv->id();
-    } else {
-      //this was not a pending pro
-      reqId = allocate_request();
-      recvsQueued_[stat.MPI_TAG].emplace_back(reqId, size,data);
-    }
-    MPI_Irecv(data, size, MPI_BYTE, stat.MPI_SOURCE, stat.MPI_TAG, comm_,
-              &requests_[reqId]);
-
+  //active messages arrive without a matching recv - drain whatever is waiting
+  int flag = 1;
+  while (flag){
+    MPI_Status stat;
+    MPI_Iprobe(MPI_ANY_SOURCE, MPI_ANY_TAG, comm_, &flag, &stat);
+    if (flag) post_probed_recv(stat);
   }
-  numPendingProbes_ = 0;
 }
 
 void
@@ -251,35 +536,35 @@ MpiBackend::add_pending_recv(PendingRecvBase* pending, int collId,
   int tag = makeUniqueTag(collId, local.rankUniqueId, remote.rankUniqueId);
   darmaDebug(SendRecv, "Rank {} collection {} made tag={} for receiving elem={},{} from elem={},{}",
              rank_, collId, tag, local.rank, local.rankUniqueId, remote.rank, remote.rankUniqueId);
-  auto iter = recvsQueued_.find(tag);
-  if (iter == recvsQueued_.end()){
-    pendingRecvs_[remote.rank][tag].push_back(pending);
+  auto key = matches_.key(remote.rank, tag);
+  MatchEntry* post = matches_.front(key);
+  if (!post || post->pending){
+    MatchEntry* entry = matches_.allocate();
+    entry->pending = pending;
+    matches_.push_back(key, entry);
     int reqId = allocate_request();
     pending->setId(reqId);
     listeners_[reqId] = pending;
     requests_[reqId] = MPI_REQUEST_NULL;
     ++numPendingProbes_;
   } else {
-    auto& list = iter->second;
-    PostedRecv& post = list.front();
-    Listener* listener = listeners_[post.id];
+    count_unexpected(-int64_t(post->size));
+    Listener* listener = listeners_[post->id];
     if (listener == (Listener*)REQUEST_CLEAR){
       //the recv was posted and already finished
-      pending->configure(this, post.size, post.data);
+      pending->configure(this, post->size, post->data);
       bool del = pending->finalize();
       if (del){
         delete pending;
       }
-      listeners_[post.id] = nullptr;
-      freeRequests_.push_back(post.id);
+      listeners_[post->id] = nullptr;
+      freeRequests_.push_back(post->id);
     } else {
       //the recv is posted, but not yet completed
-      listeners_[post.id] = pending;
-      pending->configure(this, post.size, post.data);
+      listeners_[post->id] = pending;
+      pending->configure(this, post->size, post->data);
     }
-    list.pop_front();
-    if (list.empty())
-      recvsQueued_.erase(iter);
+    matches_.release(matches_.pop_front(key));
   }
 }
 
@@ -308,8 +593,9 @@ MpiBackend::register_dependency(task* t, mpi_async_ref& in)
 {
   for (int reqId : in.pendingRequests()){
     if (listeners_[reqId] == (void*)REQUEST_CLEAR){
-      //oh, nothing to do
+      //oh, nothing to do - the request slot can now be reused
       listeners_[reqId] = nullptr;
+      freeRequests_.push_back(reqId);
     } else if (listeners_[reqId]){
       error("listener should be null or cleared");
     } else {
@@ -325,13 +611,14 @@ MpiBackend::inform_listener(int idx)
 {
   Listener* listener = listeners_[idx];
   if (listener){
+    //a listener may wait on several requests, this slot is done with it either way
+    listeners_[idx] = nullptr;
     int cnt = listener->decrement_join_counter();
     if (cnt == 0){
       bool del = listener->finalize();
       if (del){
         delete listener;
       }
-      listeners_[idx] = nullptr;
     }
   } else {
     listeners_[idx] = (Listener*) REQUEST_CLEAR;
@@ -341,37 +628,47 @@ MpiBackend::inform_listener(int idx)
 bool
 MpiBackend::progress_dependencies()
 {
+  progress_credits();
   create_pending_recvs();
 
   int nComplete;
   MPI_Testsome(requests_.size(), requests_.data(), &nComplete,
                indices_.data(), statuses_.data());
 
+  //a rank that made no progress owes everything back, a busy one only large debts
+  return_credits(nComplete == MPI_UNDEFINED || nComplete == 0);
 
   if (nComplete == MPI_UNDEFINED){
-    return false;
+    return numHeld_ > 0;
   }
 
-  int freeSize = freeRequests_.size();
+  numCompleted_ += nComplete;
 
   //start from the end for backfilling
   for (int i=0; i < nComplete; ++i){
     int idxDone = indices_[i];
+    trace_.complete(idxDone);
     inform_listener(idxDone);
-    freeRequests_.push_back(idxDone);
+    //a cleared request keeps its slot until the dependency on it is registered
+    if (listeners_[idxDone] != (Listener*)REQUEST_CLEAR){
+      freeRequests_.push_back(idxDone);
+    }
   }
 
   int nonNull = 0;
-  for (MPI_Request req : requests_){
-    if (req != MPI_REQUEST_NULL) ++nonNull;
+  int cleared = 0;
+  for (int i=0; i < requests_.size(); ++i){
+    if (requests_[i] != MPI_REQUEST_NULL) ++nonNull;
+    else if (listeners_[i] == (Listener*)REQUEST_CLEAR) ++cleared;
   }
-  if ( (nComplete + freeSize + numPendingProbes_ + nonNull) != requests_.size()){
-    error("Sum of individual request types (complete=%d,free=%d,pending=%d,active=%d), do not sum total=%d",
-          nComplete, freeSize, numPendingProbes_, nonNull, requests_.size());
+  int freeSize = freeRequests_.size();
+  if ( (freeSize + cleared + numPendingProbes_ + numHeld_ + nonNull) != requests_.size()){
+    error("Sum of individual request types (free=%d,cleared=%d,pending=%d,held=%d,active=%d), do not sum total=%d",
+          freeSize, cleared, numPendingProbes_, numHeld_, nonNull, requests_.size());
   }
 
-  //if all requests are now free requests
-  return freeRequests_.size() < requests_.size();
+  //if all requests are now free or just waiting to be claimed
+  return (freeSize + cleared) < requests_.size();
 }
 
 void
@@ -381,10 +678,27 @@ MpiBackend::progress_tasks()
     task* t = taskQueue_.front();
     if (t->join_counter() == 0){
       taskQueue_.pop_front();
-      uint64_t t_start = rdtsc();
+      PerformanceCounter* ctrs = t->counters();
+      activeCounters_ = ctrs;
+      uint64_t cycles_start, instructions_start;
+      if (hwCounters_) hwCounters_->read(cycles_start, instructions_start);
+      uint64_t t_start = wall_ns();
       t->run(static_cast<Context*>(this));
-      uint64_t t_stop = rdtsc();
-      t->addCounter(t_stop-t_start);
+      uint64_t t_stop = wall_ns();
+      activeCounters_ = nullptr;
+      phaseTimes_.ns[PhaseTimes::Compute] += t_stop - t_start;
+      ++numTasksRun_;
+      if (ctrs){
+        ctrs->wallNs += t_stop - t_start;
+        if (hwCounters_){
+          uint64_t cycles, instructions;
+          hwCounters_->read(cycles, instructions);
+          ctrs->cycles += cycles - cycles_start;
+          ctrs->instructions += instructions - instructions_start;
+        }
+      }
+      trace_.record(darma_backend::TraceTask, trace_.since_start(t_start),
+                    trace_.since_start(t_stop), t->index());
       delete t;
     } else {
       return;
@@ -400,14 +714,14 @@ MpiBackend::progress_engine()
 }
 
 void*
-MpiBackend::allocate_temp_buffer(int size)
+MpiBackend::allocate_temp_buffer(std::size_t size)
 {
   void* ptr = new char[size];
   return ptr;
 }
 
 void
-MpiBackend::free_temp_buffer(void* buf, int size)
+MpiBackend::free_temp_buffer(void* buf, std::size_t size)
 {
   char* cbuf = (char*) buf;
   delete [] cbuf;
@@ -419,6 +733,7 @@ MpiBackend::clear_dependencies()
   create_pending_recvs();
   MPI_Waitall(requests_.size(), requests_.data(), MPI_STATUSES_IGNORE);
   for (int i=0; i < requests_.size(); ++i){
+    trace_.complete(i);
     inform_listener(i);
   }
   requests_.clear();
@@ -436,13 +751,67 @@ MpiBackend::error(const char *fmt, ...)
   abort();
 }
 
+void
+MpiBackend::progress_timed()
+{
+  uint64_t completed = numCompleted_;
+  uint64_t tasksRun = numTasksRun_;
+  uint64_t t_start = wall_ns();
+  progress_dependencies();
+  uint64_t t_deps = wall_ns();
+  progress_tasks();
+  if (numCompleted_ == completed && numTasksRun_ == tasksRun){
+    phaseTimes_.ns[PhaseTimes::Idle] += wall_ns() - t_start;
+  } else {
+    phaseTimes_.ns[PhaseTimes::CommWait] += t_deps - t_start;
+  }
+}
+
+void
+MpiBackend::report_phase()
+{
+  PhaseTimesReduce local;
+  for (int i=0; i < PhaseTimes::NumCategories; ++i){
+    local.min[i] = local.max[i] = local.total[i] = phaseTimes_.ns[i];
+  }
+  MPI_Reduce(&local, &lastPhaseReport_, 1, phaseTimesType_, phaseTimesOp_, 0, comm_);
+  MigrationStats migrated;
+  MPI_Reduce(&phaseMigration_, &migrated, sizeof(MigrationStats)/sizeof(uint64_t),
+             MPI_UINT64_T, MPI_SUM, 0, comm_);
+
+  if (rank_ == 0){
+    static const char* names[] = {"compute", "comm wait", "idle", "lb", "migration"};
+    std::stringstream sstr;
+    sstr << "Phase " << phaseCount_ << " ms min/avg/max:";
+    for (int i=0; i < PhaseTimes::NumCategories; ++i){
+      sstr << "  " << names[i] << " "
+           << lastPhaseReport_.min[i]*1e-6 << "/"
+           << lastPhaseReport_.total[i]*1e-6/size_ << "/"
+           << lastPhaseReport_.max[i]*1e-6;
+    }
+    if (migrated.intraNode || migrated.interNode){
+      sstr << "  migrated intra/inter node " << migrated.intraNode << "/" << migrated.interNode
+           << " elements " << migrated.intraNodeBytes << "/" << migrated.interNodeBytes << " bytes";
+    }
+    std::cout << sstr.str() << std::endl;
+  }
+
+  ++phaseCount_;
+  phaseTimes_ = PhaseTimes();
+  phaseMigration_ = MigrationStats();
+}
+
 void
 MpiBackend::clear_tasks()
 {
   uint64_t numTries = 0;
   while (!taskQueue_.empty()){
-    progress_dependencies();
-    progress_tasks();
+    if (phaseReport_){
+      progress_timed();
+    } else {
+      progress_dependencies();
+      progress_tasks();
+    }
     ++numTries;
     if (numTries > 1e3){
       std::cerr << "Have " << numPendingProbes_
@@ -453,36 +822,209 @@ MpiBackend::clear_tasks()
     }
   }
 
-  while(progress_dependencies());
+  if (phaseReport_){
+    uint64_t t_start = wall_ns();
+    while(progress_dependencies());
+    phaseTimes_.ns[PhaseTimes::CommWait] += wall_ns() - t_start;
+  } else {
+    while(progress_dependencies());
+  }
+}
+
+void
+MpiBackend::wait_for_termination(darma_backend::termination_detector& term)
+{
+  while (!term.terminated()){
+    //only an idle rank may count itself into a wave
+    while (!taskQueue_.empty() || progress_dependencies()){
+      clear_tasks();
+    }
+    term.contribute(activeSent_, activeRecvd_);
+    //messages that arrive during the wave are still delivered
+    while (term.wave_active() && !term.test()){
+      if (phaseReport_){
+        progress_timed();
+      } else {
+        progress_engine();
+      }
+    }
+  }
+  darmaDebug(Task, "Rank {} detected termination after {} waves", rank_, term.waves());
 }
 
 int
 MpiBackend::send_data(mpi_async_ref& ref, int collId,
                       const IndexInfo& src, const IndexInfo& dst,
-                      void* data, int size, int taskId)
+                      void* data, std::size_t size, int taskId)
 {
   int tag = makeUniqueTag(collId, dst.rankUniqueId, src.rankUniqueId, taskId);
   darmaDebug(SendRecv, "Rank {} collection {} made tag={} for sending elem={},{} to elem={},{}",
              rank_, collId, tag, src.rank, src.rankUniqueId, dst.rank, dst.rankUniqueId);
   int request = allocate_request();
   ref.addRequest(request);
-  send_data(dst.rank, data, size, tag, &requests_[request]);
+  trace_.post(request, darma_backend::TraceSend, dst.rank, tag, size);
+  send_data(dst.rank, data, size, tag, comm_, &requests_[request]);
+  return request;
+}
+
+int
+MpiBackend::send_regions(mpi_async_ref& ref, int collId,
+                         const IndexInfo& src, const IndexInfo& dst,
+                         const darma_backend::region_list& regions)
+{
+  if (dst.rank >= size_ || dst.rank < 0){
+    error("Trying to send to invalid rank %d", dst.rank);
+  }
+  int tag = makeUniqueTag(collId, dst.rankUniqueId, src.rankUniqueId);
+  int request = allocate_request();
+  ref.addRequest(request);
+  trace_.post(request, darma_backend::TraceSend, dst.rank, tag, regions.bytes());
+  MPI_Datatype type = regions.make_type(messageChunk_);
+  MPI_Isend(MPI_BOTTOM, 1, type, dst.rank, tag, comm_, &requests_[request]);
+  MPI_Type_free(&type);
   return request;
 }
 
+int
+MpiBackend::send_active(mpi_async_ref& ref, int collId,
+                        const IndexInfo& src, const IndexInfo& dst,
+                        void* data, std::size_t size, int taskId)
+{
+  if (creditShare_ == 0){
+    return send_data(ref, collId, src, dst, data, size, taskId);
+  }
+
+  //a message larger than a whole share goes once nothing else is in flight
+  int64_t& credits = credits_[dst.rank];
+  auto& held = held_[dst.rank];
+  if (held.empty() && (credits >= int64_t(size) || credits == creditShare_)){
+    credits -= size;
+    return send_data(ref, collId, src, dst, data, size, taskId);
+  }
+
+  int tag = makeUniqueTag(collId, dst.rankUniqueId, src.rankUniqueId, taskId);
+  int request = allocate_request();
+  ref.addRequest(request);
+  requests_[request] = MPI_REQUEST_NULL;
+  held.push_back(HeldSend{request, tag, data, size});
+  ++numHeld_;
+  ++numHeldTotal_;
+  darmaDebug(SendRecv, "Rank {} holds tag={} of {} bytes for rank {} with {} credits",
+             rank_, tag, size, dst.rank, credits);
+  return request;
+}
+
+void
+MpiBackend::progress_credits()
+{
+  if (creditShare_ == 0) return;
+
+  int flag = 1;
+  while (flag){
+    MPI_Status stat;
+    MPI_Iprobe(MPI_ANY_SOURCE, MPI_ANY_TAG, creditComm_, &flag, &stat);
+    if (flag){
+      int64_t returned;
+      MPI_Recv(&returned, 1, MPI_INT64_T, stat.MPI_SOURCE, stat.MPI_TAG,
+               creditComm_, MPI_STATUS_IGNORE);
+      credits_[stat.MPI_SOURCE] += returned;
+    }
+  }
+
+  for (int dst=0; dst < size_ && numHeld_ > 0; ++dst){
+    auto& held = held_[dst];
+    int64_t& credits = credits_[dst];
+    while (!held.empty() && (credits >= int64_t(held.front().size) || credits == creditShare_)){
+      HeldSend& h = held.front();
+      credits -= h.size;
+      trace_.post(h.request, darma_backend::TraceSend, dst, h.tag, h.size);
+      send_data(dst, h.data, h.size, h.tag, comm_, &requests_[h.request]);
+      held.pop_front();
+      --numHeld_;
+    }
+  }
+
+  creditSends_.remove_if([](std::pair<int64_t,MPI_Request>& pair){
+    int done;
+    MPI_Test(&pair.second, &done, MPI_STATUS_IGNORE);
+    return done;
+  });
+}
+
 void
-MpiBackend::send_data(int dest, void *data, int size, int tag, MPI_Request *req)
+MpiBackend::return_credits(bool all)
+{
+  if (creditShare_ == 0) return;
+
+  for (int src=0; src < size_; ++src){
+    int64_t& owed = owed_[src];
+    if (owed > 0 && (all || owed >= creditShare_ / 4)){
+      creditSends_.emplace_back(owed, MPI_REQUEST_NULL);
+      auto& pair = creditSends_.back();
+      int tag = 454;
+      MPI_Isend(&pair.first, 1, MPI_INT64_T, src, tag, creditComm_, &pair.second);
+      owed = 0;
+    }
+  }
+}
+
+void
+MpiBackend::count_unexpected(int64_t bytes)
+{
+  unexpectedBytes_ += bytes;
+  peakUnexpectedBytes_ = std::max<uint64_t>(peakUnexpectedBytes_, unexpectedBytes_);
+}
+
+void
+MpiBackend::consume_unexpected(int source, std::size_t size)
+{
+  count_unexpected(-int64_t(size));
+  if (creditShare_) owed_[source] += size;
+}
+
+void
+MpiBackend::send_data(int dest, void *data, std::size_t size, int tag, MPI_Comm comm, MPI_Request *req)
 {
   if (dest >= size_ || dest < 0){
     error("Trying to send to invalid rank %d", dest);
   }
-  MPI_Isend(data, size, MPI_BYTE, dest, tag, comm_, req);
+  darma_backend::isend_bytes(data, size, messageChunk_, dest, tag, comm, req);
+}
+
+void
+MpiBackend::recv_data(int src, void *data, std::size_t size, int tag, MPI_Comm comm, MPI_Request *req)
+{
+  darma_backend::irecv_bytes(data, size, messageChunk_, src, tag, comm, req);
+}
+
+std::vector<LocalIndex>
+MpiBackend::gather_counters(const std::vector<LocalIndex>& local, int root)
+{
+  darma_backend::serialization_buffer buff(local.size()*sizeof(LocalIndex));
+  ::memcpy(buff.data(), local.data(), buff.capacity());
+  auto all = darma_backend::detail::gather_internal(buff, root, comm_,
+                                                      darma_backend::detail::gather_max_count,
+                                                      gatherComm_);
+
+  std::vector<LocalIndex> ret;
+  const LocalIndex* begin = reinterpret_cast<const LocalIndex*>(all.data());
+  ret.assign(begin, begin + all.capacity()/sizeof(LocalIndex));
+  std::sort(ret.begin(), ret.end(), [](const LocalIndex& a, const LocalIndex& b){
+    return a.index < b.index;
+  });
+  return ret;
 }
 
 void
-MpiBackend::recv_data(int src, void *data, int size, int tag, MPI_Request *req)
+MpiBackend::write_counters(std::ostream& os, const std::vector<LocalIndex>& counters)
 {
-  MPI_Irecv(data, size, MPI_BYTE, src, tag, comm_, req);
+  os << "index,wall_ns,bytes_sent,bytes_recvd,messages,serialize_ns,cycles,instructions\n";
+  for (const LocalIndex& lidx : counters){
+    const PerformanceCounter& c = lidx.counters;
+    os << lidx.index << "," << c.wallNs << "," << c.bytesSent << "," << c.bytesRecvd
+       << "," << c.numMessages << "," << c.serializeNs << "," << c.cycles
+       << "," << c.instructions << "\n";
+  }
 }
 
 void
@@ -579,16 +1121,152 @@ MpiBackend::make_rank_mapping(int nEntriesGlobal, std::vector<IndexInfo>& mappin
   }
 }
 
+void
+MpiBackend::dump_lb_records(const std::vector<LocalIndex>& local)
+{
+  std::vector<darma_backend::lb_record> mine(local.size());
+  for (int i=0; i < local.size(); ++i){
+    darma_backend::lb_record& rec = mine[i];
+    rec.index = local[i].index;
+    rec.load = local[i].counters.wallNs;
+    rec.bytes = local[i].bytes;
+    rec.rank = rank_;
+    rec.unused = 0;
+  }
+
+  darma_backend::serialization_buffer buff(mine.size()*sizeof(darma_backend::lb_record));
+  ::memcpy(buff.data(), mine.data(), buff.capacity());
+  auto all = darma_backend::detail::gather_internal(buff, 0, comm_,
+                                                      darma_backend::detail::gather_max_count,
+                                                      gatherComm_);
+
+  if (rank_ == 0){
+    std::vector<darma_backend::lb_record> records(all.capacity() / sizeof(darma_backend::lb_record));
+    ::memcpy(records.data(), all.data(), all.capacity());
+    lbDump_.write(size_, records);
+  }
+}
+
+bool
+MpiBackend::rebalance_local(std::vector<LocalIndex>& local, std::vector<IndexInfo>& mapping)
+{
+  for (LocalIndex& lidx : local){
+    darma_backend::lb::record_load(lidx.history, lidx.counters.wallNs, loadModel_);
+  }
+
+  uint64_t oldMax = 0;
+  if (autoLb_.enabled){
+    uint64_t localWork = 0;
+    for (const LocalIndex& lidx : local){
+      localWork += darma_backend::lb::predict_load(lidx.history, loadModel_);
+    }
+    PerfCtrReduce ctr;
+    ctr.total = ctr.max = ctr.min = localWork;
+    ctr.maxTask = ctr.minTask = 0;
+    ctr.maxLocalTasks = local.size();
+    PerfCtrReduce global;
+    MPI_Allreduce(&ctr, &global, 1, perfCtrType_, perfCtrOp_, comm_);
+    oldMax = global.max;
+    double avg = double(global.total) / size_;
+    if (avg == 0 || global.max / avg < autoLb_.minImbalance){
+      darmaDebug(LB, "Rank={} skipping balancer at imbalance {}", rank_, global.max / avg);
+      for (LocalIndex& lidx : local) lidx.counters.reset();
+      return false;
+    }
+  }
+
+  std::vector<pair64> newConfig = balance(local);
+
+  if (autoLb_.enabled){
+    std::set<int> staying;
+    uint64_t newWork = 0;
+    for (const pair64& pair : newConfig){
+      staying.insert(pair.second);
+      newWork += pair.first;
+    }
+    uint64_t bytesOut = 0;
+    for (const LocalIndex& lidx : local){
+      if (staying.find(lidx.index) == staying.end()) bytesOut += lidx.bytes;
+    }
+    uint64_t maxes[2] = {newWork, uint64_t(bytesOut / migrateBytesPerNs_)};
+    MPI_Allreduce(MPI_IN_PLACE, maxes, 2, MPI_UINT64_T, MPI_MAX, comm_);
+    if (!darma_backend::lb::auto_lb_pays_off(autoLb_, oldMax, maxes[0], maxes[1])){
+      darmaDebug(LB, "Rank={} keeping mapping: max work {}->{} does not pay for {} ns of migration",
+                 rank_, oldMax, maxes[0], maxes[1]);
+      for (LocalIndex& lidx : local) lidx.counters.reset();
+      return false;
+    }
+  }
+
+  if (loadModel_.type == darma_backend::lb::LastPhase){
+    reset_phase(newConfig, local, mapping);
+  } else {
+    std::vector<LocalIndex> oldLocal = local;
+    reset_phase(newConfig, local, mapping);
+    migrate_load_histories(oldLocal, local, mapping);
+  }
+  return true;
+}
+
+void
+MpiBackend::migrate_load_histories(const std::vector<LocalIndex>& oldLocal,
+                                   std::vector<LocalIndex>& newLocal,
+                                   const std::vector<IndexInfo>& mapping)
+{
+  struct history_msg {
+    int64_t index;
+    darma_backend::lb::load_history history;
+  };
+
+  std::vector<std::vector<history_msg>> outgoing(size_);
+  for (const LocalIndex& lidx : oldLocal){
+    outgoing[mapping[lidx.index].rank].push_back(history_msg{lidx.index, lidx.history});
+  }
+
+  std::vector<int> sendCounts(size_), sendDispls(size_);
+  std::vector<history_msg> sendBuf;
+  for (int r=0; r < size_; ++r){
+    sendDispls[r] = sendBuf.size() * sizeof(history_msg);
+    sendCounts[r] = outgoing[r].size() * sizeof(history_msg);
+    sendBuf.insert(sendBuf.end(), outgoing[r].begin(), outgoing[r].end());
+  }
+
+  std::vector<int> recvCounts(size_), recvDispls(size_);
+  MPI_Alltoall(sendCounts.data(), 1, MPI_INT, recvCounts.data(), 1, MPI_INT, comm_);
+  int recvBytes = 0;
+  for (int r=0; r < size_; ++r){
+    recvDispls[r] = recvBytes;
+    recvBytes += recvCounts[r];
+  }
+
+  std::vector<history_msg> recvBuf(recvBytes / sizeof(history_msg));
+  MPI_Alltoallv(sendBuf.data(), sendCounts.data(), sendDispls.data(), MPI_BYTE,
+                recvBuf.data(), recvCounts.data(), recvDispls.data(), MPI_BYTE, comm_);
+
+  //the local position of every element is its unique id on this rank
+  for (const history_msg& msg : recvBuf){
+    newLocal[mapping[msg.index].rankUniqueId].history = msg.history;
+  }
+}
+
 void
 MpiBackend::reset_phase(const std::vector<pair64>& config,
                         std::vector<LocalIndex>& local,
                         std::vector<IndexInfo>& indices)
 {
+  //elements that stay keep their measured size, the rest get theirs on arrival
+  std::unordered_map<int,uint64_t> oldBytes;
+  for (const LocalIndex& lidx : local){
+    if (lidx.bytes) oldBytes[lidx.index] = lidx.bytes;
+  }
+
   for (int i=0; i < local.size() && i < config.size(); ++i){
     LocalIndex& lidx = local[i];
     const pair64& pair = config[i];
     lidx.index = pair.second;
-    lidx.counters.counter = 0;
+    lidx.counters.reset();
+    lidx.bytes = 0;
+    lidx.history.clear();
   }
 
   int oldSize = local.size();
@@ -598,6 +1276,11 @@ MpiBackend::reset_phase(const std::vector<pair64>& config,
     local.emplace_back(pair.second);
   }
 
+  for (LocalIndex& lidx : local){
+    auto iter = oldBytes.find(lidx.index);
+    if (iter != oldBytes.end()) lidx.bytes = iter->second;
+  }
+
   for (int i=newSize; i < oldSize; ++i){
     local.pop_back();
   }
@@ -617,36 +1300,39 @@ MpiBackend::rebalance(std::vector<migration>& objToSend,
   int rebalance_info_tag = 444;
   int rebalance_data_tag = 445;
 
+  //size, index and MPI parent - the size may not fit an int
   static const int numInfoFields = 3;
 
+  uint64_t trace_start = trace_.time();
+  uint64_t t_start = wall_ns();
   int numSends = objToSend.size();
   int numRecvs = objToRecv.size();
   std::vector<MPI_Request> sendDataReqs(numSends);
   std::vector<MPI_Request> sendInfoReqs(numSends);
   std::vector<MPI_Request> recvInfoReqs(numRecvs);
   std::vector<MPI_Request> recvDataReqs(numRecvs);
-  std::vector<int> sendInfos(numSends*numInfoFields);
-  std::vector<int> recvInfos(numRecvs*numInfoFields);
+  std::vector<int64_t> sendInfos(numSends*numInfoFields);
+  std::vector<int64_t> recvInfos(numRecvs*numInfoFields);
 
   for (int i=0; i < numSends; ++i){
     const migration& m = objToSend[i];
-    int* info = &sendInfos[numInfoFields*i];
+    int64_t* info = &sendInfos[numInfoFields*i];
     info[0] = m.size;
     info[1] = m.index;
     info[2] = m.mpiParent;
     int tag = rebalance_info_tag + m.index;
     darmaDebug(LB, "Rank {} sending info for index {} of size {} to Rank {} on tag {}", 
       rank_, m.index, m.size, m.rank, tag);
-    send_data(m.rank, info, sizeof(int)*numInfoFields, tag, &sendInfoReqs[i]);
+    send_data(m.rank, info, sizeof(int64_t)*numInfoFields, tag, migrateComm_, &sendInfoReqs[i]);
   }
 
   for (int i=0; i < numRecvs; ++i){
-    int* info = &recvInfos[numInfoFields*i];
+    int64_t* info = &recvInfos[numInfoFields*i];
     migration& m = objToRecv[i];
     int tag = rebalance_info_tag + m.index;
     darmaDebug(LB, "Rank {} requesting to receive index {} from Rank {} on tag {}",
                rank_, m.index, m.rank, tag);
-    recv_data(m.rank, info, sizeof(int)*numInfoFields, tag, &recvInfoReqs[i]);
+    recv_data(m.rank, info, sizeof(int64_t)*numInfoFields, tag, migrateComm_, &recvInfoReqs[i]);
   }
 
   MPI_Waitall(numSends, &sendInfoReqs[0], MPI_STATUSES_IGNORE);
@@ -660,15 +1346,14 @@ MpiBackend::rebalance(std::vector<migration>& objToSend,
 
   for (int i=0; i < numSends; ++i){
     const migration& m = objToSend[i];
-    int* info = &sendInfos[numInfoFields*i];
     int tag = rebalance_data_tag + m.index;
     darmaDebug(LB, "Rank {} sending data {} for index {} of size {} to Rank {} on tag {}", 
       rank_, m.buf, m.index, m.size, m.rank, tag);
-    send_data(m.rank, m.buf, m.size, tag, &sendDataReqs[i]);
+    send_data(m.rank, m.buf, m.size, tag, migrateComm_, &sendDataReqs[i]);
   }
 
   for (int i=0; i < numRecvs; ++i){
-    int* info = &recvInfos[numInfoFields*i];
+    int64_t* info = &recvInfos[numInfoFields*i];
     migration& m = objToRecv[i];
     m.size = info[0];
     if (m.index != info[1]){
@@ -679,26 +1364,65 @@ MpiBackend::rebalance(std::vector<migration>& objToSend,
     int tag = rebalance_data_tag + m.index;
     darmaDebug(LB, "Rank {} ready to receive index {} from Rank {} on tag {} into buf {} for obj {}",
                rank_, m.index, m.rank, tag, m.buf, m.obj);
-    recv_data(m.rank, m.buf, m.size, tag, &recvDataReqs[i]);
+    recv_data(m.rank, m.buf, m.size, tag, migrateComm_, &recvDataReqs[i]);
   }
 
   MPI_Waitall(numRecvs, recvDataReqs.data(), MPI_STATUSES_IGNORE);
   MPI_Waitall(numSends, sendDataReqs.data(), MPI_STATUSES_IGNORE);
+
+  darma_backend::node_topology& topo = lb_topology();
+  for (MigrationStats* stats : {&phaseMigration_, &migrationStats_}){
+    for (const migration& m : objToSend){
+      if (topo.node_of_rank[m.rank] == topo.node_id){
+        ++stats->intraNode;
+        stats->intraNodeBytes += m.size;
+      } else {
+        ++stats->interNode;
+        stats->interNodeBytes += m.size;
+      }
+    }
+  }
+
+  uint64_t bytesMoved = 0;
+  for (const migration& m : objToSend) bytesMoved += m.size;
+  for (const migration& m : objToRecv) bytesMoved += m.size;
+  uint64_t t_migrate = wall_ns() - t_start;
+  if (bytesMoved > 0 && t_migrate > 0){
+    migrateBytesPerNs_ = double(bytesMoved) / t_migrate;
+  }
+
+  if (trace_.enabled()){
+    uint64_t bytesSent = 0;
+    for (const migration& m : objToSend) bytesSent += m.size;
+    trace_.record(darma_backend::TraceMigrate, trace_start, trace_.time(),
+                  numSends, numRecvs, int32_t(std::min<uint64_t>(bytesSent, INT32_MAX)));
+  }
   darmaDebug(LB, "Rank {} cleared rebalance", rank_);
 }
 
 void
 PendingRecvBase::clear()
 {
-  be_->free_temp_buffer(data_, size_);
+  if (owner_){
+    owner_.reset();
+  } else {
+    be_->free_temp_buffer(data_, size_);
+  }
+  if (unexpectedSource_ >= 0){
+    be_->consume_unexpected(unexpectedSource_, size_);
+  }
 }
 
 void
-PendingRecvBase::configure(MpiBackend* be, int size, void* data)
+PendingRecvBase::configure(MpiBackend* be, std::size_t size, void* data)
 {
   be_ = static_cast<Frontend<MpiBackend>*>(be);
   size_ = size;
   data_ = data;
+  if (counters_){
+    counters_->bytesRecvd += size;
+    ++counters_->numMessages;
+  }
 }
 
 
@@ -34,36 +34,45 @@ template <class T> bool DebugFlag<T>::active = false;
 #include "mpi_pending_recv.h"
 #include "gather.h"
 #include "broadcast.h"
+#include "hierarchy.h"
+#include "trace.h"
+#include "hw_counters.h"
+#include "lb_kernels.h"
+#include "lb_dump.h"
+#include "termination.h"
+#include "thread_pool.h"
+#include "match_table.h"
+#include "large_count.h"
+#include "regions.h"
+#include "halo.h"
 
 
 #include <darma/serialization/simple_handler.h>
 #include <darma/serialization/serializers/all.h>
 
 #include <mpi.h>
+#include <cstring>
+#include <deque>
+#include <limits>
 #include <list>
 #include <vector>
 #include <map>
 #include <set>
+#include <string>
+#include <ostream>
 
 template <class Accessor, class T, class Index>
 int recv_task_id();
 
-static inline uint64_t rdtsc(void)
-{
-  uint32_t hi, lo;
-  __asm__ __volatile__ ("rdtsc" : "=a"(lo), "=d"(hi));
-  return uint64_t( (uint64_t)lo | (uint64_t)hi<<32);
-}
-
 struct MpiBackend {
   struct migration {
     int index;
     void* buf;
     void* obj;
-    int size;
+    std::size_t size;
     int rank;
     int mpiParent;
-    migration(int i, void* b, void* o, int s, int r, int p) :
+    migration(int i, void* b, void* o, std::size_t s, int r, int p) :
       index(i), buf(b), obj(o), size(s), rank(r), mpiParent(p)
     {
     }
@@ -73,7 +82,9 @@ struct MpiBackend {
     RandomLB,
     CommSplitLB,
     ZoltanLB,
-    DebugLB
+    DebugLB,
+    HierarchicalLB,
+    HypercubeLB
   } lb_type_t;
 
   struct PerfCtrReduce {
@@ -85,6 +96,34 @@ struct MpiBackend {
     uint64_t maxLocalTasks;
   };
 
+  /** Where the time on one rank went since the last phase report, in ns */
+  struct PhaseTimes {
+    enum {
+      Compute,     //running tasks
+      CommWait,    //probing, testing and finalizing messages
+      Idle,        //progress loop iterations that completed nothing
+      LoadBalance, //computing a new mapping
+      Migration,   //packing, moving and unpacking migrated objects
+      NumCategories
+    };
+    uint64_t ns[NumCategories];
+  };
+
+  /** Elements moved by migrations, split by whether they left their node */
+  struct MigrationStats {
+    uint64_t intraNode;
+    uint64_t interNode;
+    uint64_t intraNodeBytes;
+    uint64_t interNodeBytes;
+  };
+
+  /** PhaseTimes combined across all ranks */
+  struct PhaseTimesReduce {
+    uint64_t min[PhaseTimes::NumCategories];
+    uint64_t max[PhaseTimes::NumCategories];
+    uint64_t total[PhaseTimes::NumCategories];
+  };
+
   using Context=Frontend<MpiBackend>;
   using task=TaskBase<Context>;
 
@@ -113,10 +152,20 @@ struct MpiBackend {
   auto make_collection(Idx size){
     auto ret = async_ref<collection<T,Idx>,None,Modify>::make(size);
     ret->setId(collIdCtr_++);
-    collections_[ret->id()] = ret.get();
+    register_collection(ret->id(), ret.get());
     return ret;
   }
 
+  /**
+   * @brief Make a collection reachable by the id its active messages carry
+   */
+  void register_collection(int id, collection_base* coll){
+    if (collections_.size() <= std::size_t(id)){
+      collections_.resize(id + 1, nullptr);
+    }
+    collections_[id] = coll;
+  }
+
   double get_time() const {
     timeval t; gettimeofday(&t, nullptr);
     return t.tv_sec + 1e-6*t.tv_usec;
@@ -167,12 +216,35 @@ struct MpiBackend {
 
   void run_worker(){}
 
+  /**
+   * @brief Compute a new element-to-rank mapping for a phase from the loads
+   *        measured since the last call. With --lb-auto the current mapping is
+   *        kept unless the predicted savings outweigh the migration.
+   * @param ph The phase to rebalance
+   * @return Whether the mapping changed
+   */
   template <class Idx>
-  void rebalance(Phase<Idx>& ph){
+  bool rebalance(Phase<Idx>& ph){
     clear_tasks();
-    MPI_Barrier(comm_); //bad to do, but for the timers
-    std::vector<pair64> newConfig = balance(ph->local());
-    reset_phase(newConfig, ph->local_, ph->index_to_rank_mapping_);
+    if (phaseReport_){
+      //keep waiting on slow ranks out of the load balancer time
+      uint64_t t_wait = wall_ns();
+      MPI_Barrier(comm_);
+      phaseTimes_.ns[PhaseTimes::Idle] += wall_ns() - t_wait;
+    }
+    uint64_t t_start = wall_ns();
+    uint64_t trace_start = trace_.since_start(t_start);
+    int numLocal = ph->local().size();
+    if (dumpLb_){
+      dump_lb_records(ph->local());
+    }
+    bool changed = rebalance_local(ph->local_, ph->index_to_rank_mapping_);
+    ph->halo_.reset();
+    uint64_t t_stop = wall_ns();
+    phaseTimes_.ns[PhaseTimes::LoadBalance] += t_stop - t_start;
+    trace_.record(darma_backend::TraceLoadBalance, trace_start, trace_.since_start(t_stop),
+                  numLocal, ph->local().size());
+    return changed;
   }
 
   template <class T>
@@ -279,6 +351,7 @@ struct MpiBackend {
       auto ref = async_ref<collection<T,Index>,None,Modify>
             ::make(rank_, mpi_coll->size(), mpi_coll->localElements());
       ref->setId(collIdCtr_++);
+      register_collection(ref->id(), ref.get());
       ref->assignMpi(std::move(mpi_coll));
       return ref;
     }
@@ -365,20 +438,12 @@ struct MpiBackend {
     if(is_local) {
       //extra work needed here to put a local listener in the list
     } else {
-      // The templated methods below operate on an instance, in case you need
-      // something like a stateful allocator at some point in the future.
-      // (All SerializationHandlers that are currently implemented, though,
-      // use static methods for everything).
-      auto buffer = make_packed_buffer<Accessor>(
-        non_local_handler_t{}, ref,
-        std::forward<LocalIndex>(local),
-        std::forward<RemoteIndex>(remote),
-        std::forward<Args>(args)...
-      );
-      int reqId = send_data(ref, parent->id(), src, dst, buffer.data(), buffer.capacity());
-      auto* listener = new PendingSend<decltype(buffer)>(std::move(buffer));
-      listener->increment_join_counter();
-      listeners_[reqId] = listener;
+      using zero_copy = std::integral_constant<bool,
+        darma_backend::has_send_regions<Accessor,T,LocalIndex,RemoteIndex,Args...>::value>;
+      post_send<Accessor>(zero_copy{}, ref, parent->id(), src, dst,
+                          std::forward<LocalIndex>(local),
+                          std::forward<RemoteIndex>(remote),
+                          std::forward<Args>(args)...);
     }
 
     //size
@@ -388,6 +453,48 @@ struct MpiBackend {
     return op;
   }
 
+  /** Pack the message into a buffer that lives until the send completes */
+  template <class Accessor, class T, class LocalIndex, class RemoteIndex, class... Args>
+  void post_send(std::false_type /*zero_copy*/, async_ref_base<T>& ref, int collId,
+                 const IndexInfo& src, const IndexInfo& dst,
+                 LocalIndex&& local, RemoteIndex&& remote, Args&&... args){
+    // The templated methods below operate on an instance, in case you need
+    // something like a stateful allocator at some point in the future.
+    // (All SerializationHandlers that are currently implemented, though,
+    // use static methods for everything).
+    uint64_t pack_start = timeSerialization_ ? wall_ns() : 0;
+    auto buffer = make_packed_buffer<Accessor>(
+      non_local_handler_t{}, ref,
+      std::forward<LocalIndex>(local),
+      std::forward<RemoteIndex>(remote),
+      std::forward<Args>(args)...
+    );
+    count_send(buffer.capacity(), pack_start);
+    int reqId = send_data(ref, collId, src, dst, buffer.data(), buffer.capacity());
+    auto* listener = new PendingSend<decltype(buffer)>(std::move(buffer));
+    listener->increment_join_counter();
+    listeners_[reqId] = listener;
+  }
+
+  /**
+   * Send straight out of the object's memory as the accessor describes it.
+   * The object is kept alive until the send completes, but the regions must
+   * not be written until the phase's sends have drained.
+   */
+  template <class Accessor, class T, class LocalIndex, class RemoteIndex, class... Args>
+  void post_send(std::true_type /*zero_copy*/, async_ref_base<T>& ref, int collId,
+                 const IndexInfo& src, const IndexInfo& dst,
+                 LocalIndex&& local, RemoteIndex&& remote, Args&&... args){
+    uint64_t pack_start = timeSerialization_ ? wall_ns() : 0;
+    darma_backend::region_list regions;
+    Accessor::send_regions(*ref, local, remote, regions, std::forward<Args>(args)...);
+    count_send(regions.bytes(), pack_start);
+    int reqId = send_regions(ref, collId, src, dst, regions);
+    auto* listener = new PendingSend<std::shared_ptr<T>>(std::shared_ptr<T>(ref.sharedPtr()));
+    listener->increment_join_counter();
+    listeners_[reqId] = listener;
+  }
+
   template <class Accessor, class SerializationHandler,
             class T, class LocalIndex, class RemoteIndex, class... Args>
   auto make_packed_buffer(SerializationHandler&& handler,
@@ -416,30 +523,56 @@ struct MpiBackend {
   }
 
 
+  /**
+   * A put_task to an element on this rank: no probe, tag or MPI request,
+   * the target unpacks the packed payload in place in a task of its own
+   */
+  template <class Accessor, class T, class Index, class Buffer>
+  void post_local_active(int collId, const IndexInfo& dst, const std::shared_ptr<Buffer>& payload){
+    //the recv holds on to the packed buffer until it is unpacked
+    auto& gen = generators()[recv_task_id<Accessor,T,Index>()];
+    PendingRecvBase* recv = gen->generate(frontendPtr(), dst.rankUniqueId, collId);
+    recv->setOwner(payload);
+    recv->configure(this, payload->capacity(), payload->data());
+    taskQueue_.push_back(new LocalActiveTask<Context>(recv));
+    ++numLocalActive_;
+  }
+
   template <class Accessor, class T, class Index, class... Args>
   auto make_active_send_op(async_ref_base<T>&& ref, Index&& idx, Args&&... args){
-    using index_t = std::decay_t<LocalIndex>;
+    using index_t = std::decay_t<Index>;
     if (!ref.hasParent()){
       error("sending object with no parent collection");
     }
 
     auto* parent = ref.template getParent<index_t>();
     auto& dst = parent->getIndexInfo(idx);
-    bool is_local = false; //push everything through MPI for now
+    bool is_local = dst.rank == rank_;
     if(is_local) {
-      //extra work needed here to put a local listener in the list
+      uint64_t pack_start = timeSerialization_ ? wall_ns() : 0;
+      auto buffer = make_packed_buffer<Accessor>(local_handler_t{}, ref,
+                                                 std::forward<Args>(args)...);
+      count_send(buffer.capacity(), pack_start);
+      post_local_active<Accessor,T,index_t>(parent->id(), dst,
+                                            std::make_shared<decltype(buffer)>(std::move(buffer)));
     } else {
       // The templated methods below operate on an instance, in case you need
       // something like a stateful allocator at some point in the future.
       // (All SerializationHandlers that are currently implemented, though,
       // use static methods for everything).
+      uint64_t pack_start = timeSerialization_ ? wall_ns() : 0;
       auto buffer = make_packed_buffer<Accessor>(non_local_handler_t{}, ref,
                                                  std::forward<Args>(args)...);
+      count_send(buffer.capacity(), pack_start);
       IndexInfo src; //the source doesn't actuall matter here
       src.rank = rank_;
       src.rankUniqueId = 0;
-      send_data(ref, parent->id(), src, dst, buffer.data(), buffer.capacity(),
-                recv_task_id<Accessor,T,Index>());
+      int reqId = send_active(ref, parent->id(), src, dst, buffer.data(), buffer.capacity(),
+                              recv_task_id<Accessor,T,index_t>());
+      ++activeSent_;
+      auto* listener = new PendingSend<decltype(buffer)>(std::move(buffer));
+      listener->increment_join_counter();
+      listeners_[reqId] = listener;
     }
 
     //size
@@ -449,6 +582,105 @@ struct MpiBackend {
     return op;
   }
 
+  /**
+   * A put_task of the same payload to every index in targets. The payload is
+   * packed once, and all the sends and local targets share one buffer, freed
+   * by the last of them to finish with it.
+   */
+  template <class Accessor, class T, class Indices, class... Args>
+  auto make_active_send_many_op(async_ref_base<T>&& ref, const Indices& targets, Args&&... args){
+    using index_t = std::decay_t<typename Indices::value_type>;
+    if (!ref.hasParent()){
+      error("sending object with no parent collection");
+    }
+
+    auto* parent = ref.template getParent<index_t>();
+    uint64_t pack_start = timeSerialization_ ? wall_ns() : 0;
+    auto buffer = make_packed_buffer<Accessor>(non_local_handler_t{}, ref,
+                                               std::forward<Args>(args)...);
+    count_send(buffer.capacity(), pack_start, targets.size());
+    using buffer_t = decltype(buffer);
+    auto shared = std::make_shared<buffer_t>(std::move(buffer));
+    void* data = shared->data();
+    std::size_t size = shared->capacity();
+    auto* listener = new PendingSend<std::shared_ptr<buffer_t>>(std::shared_ptr<buffer_t>(shared));
+    IndexInfo src; //the source doesn't actuall matter here
+    src.rank = rank_;
+    src.rankUniqueId = 0;
+    for (auto& idx : targets){
+      auto& dst = parent->getIndexInfo(idx);
+      if (dst.rank == rank_){
+        post_local_active<Accessor,T,index_t>(parent->id(), dst, shared);
+      } else {
+        int reqId = send_active(ref, parent->id(), src, dst, data, size,
+                                recv_task_id<Accessor,T,index_t>());
+        ++activeSent_;
+        listener->increment_join_counter();
+        listeners_[reqId] = listener;
+      }
+    }
+    if (listener->join_counter() == 0) delete listener;
+
+    SendOp<T> op(std::move(ref));
+    return op;
+  }
+
+  /**
+   * A send of the same payload from local to every index in remotes, packed
+   * once with
+   *   Accessor::compute_size(T&, Local, Archive&, Args...)
+   *   Accessor::pack(T&, Local, Archive&, Args...)
+   * since it cannot depend on the receiver. The sends share one buffer,
+   * freed by the last of them to complete.
+   */
+  template <class Accessor, class T, class LocalIndex, class Remotes, class... Args>
+  auto make_send_many_op(async_ref_base<T>&& ref, LocalIndex&& local,
+                         const Remotes& remotes, Args&&... args){
+    using index_t = std::decay_t<LocalIndex>;
+    if (!ref.hasParent()){
+      error("sending object with no parent collection");
+    }
+
+    auto* parent = ref.template getParent<index_t>();
+    auto& src = parent->getIndexInfo(local);
+
+    uint64_t pack_start = timeSerialization_ ? wall_ns() : 0;
+    non_local_handler_t handler{};
+    auto s_ar = handler.make_sizing_archive();
+    Accessor::compute_size(*ref, local, s_ar, args...);
+    auto p_ar = handler.make_packing_archive(std::move(s_ar));
+    Accessor::pack(*ref, local, p_ar, args...);
+    auto buffer = handler.extract_buffer(std::move(p_ar));
+    count_send(buffer.capacity(), pack_start, remotes.size());
+    void* data = buffer.data();
+    std::size_t size = buffer.capacity();
+    auto* listener = new PendingSend<decltype(buffer)>(std::move(buffer));
+    for (auto& remote : remotes){
+      auto& dst = parent->getIndexInfo(remote);
+      int reqId = send_data(ref, parent->id(), src, dst, data, size);
+      listener->increment_join_counter();
+      listeners_[reqId] = listener;
+    }
+    if (listener->join_counter() == 0) delete listener;
+
+    SendOp<T> op(std::move(ref));
+    return op;
+  }
+
+  template <class Accessor, class Index, class T, class... Args>
+  PendingRecvBase* make_pending_recv(std::false_type /*zero_copy*/, async_ref_base<T>&& ref,
+                                     const Index& local, const Index& remote, Args&&... args){
+    using MyRecv = NonLocalPendingRecv<Accessor,T,Index,std::remove_reference_t<Args>...>;
+    return new MyRecv(std::move(ref), std::forward<Args>(args)...);
+  }
+
+  template <class Accessor, class Index, class T, class... Args>
+  PendingRecvBase* make_pending_recv(std::true_type /*zero_copy*/, async_ref_base<T>&& ref,
+                                     const Index& local, const Index& remote, Args&&... args){
+    using MyRecv = RegionPendingRecv<Accessor,T,Index,std::remove_reference_t<Args>...>;
+    return new MyRecv(std::move(ref), local, remote, std::forward<Args>(args)...);
+  }
+
   template <class Accessor, class T, class LocalIndex, class RemoteIndex, class... Args>
   auto make_recv_op(async_ref_base<T>&& ref, LocalIndex&& local, RemoteIndex&& remote, Args&&... args){
     using index_t = std::decay_t<LocalIndex>;
@@ -456,9 +688,12 @@ struct MpiBackend {
     auto& localEntry = parent->getIndexInfo(local);
     auto& remoteEntry = parent->getIndexInfo(remote);
 
-    using MyRecv = NonLocalPendingRecv<Accessor,T,index_t,std::remove_reference_t<Args>...>;
-    auto* pending = new MyRecv(std::move(ref), std::forward<Args>(args)...);
+    using zero_copy = std::integral_constant<bool,
+      darma_backend::has_recv_regions<Accessor,T,LocalIndex,RemoteIndex,Args...>::value>;
+    auto* pending = make_pending_recv<Accessor,index_t>(zero_copy{}, std::move(ref),
+                                                        local, remote, std::forward<Args>(args)...);
     pending->increment_join_counter();
+    pending->setCounters(activeCounters_, timeSerialization_);
     add_pending_recv(pending, parent->id(), localEntry, remoteEntry);
     RecvOp<T> op{};
     return op;
@@ -470,7 +705,7 @@ struct MpiBackend {
   template <class Accessor, class Index, class T>
   auto rebalance(Phase<Index>& ph, async_collection<T,Index>&& coll){
     clear_tasks();
-    double t_start = get_time();
+    uint64_t t_start = wall_ns();
     int numSends = 0;
     int numRecvs = 0;
     async_ref_base<T>* dummy;
@@ -523,14 +758,86 @@ struct MpiBackend {
       coll->removeParentMpiRank(m.index);
     }
 
-    coll->index_mapping_ = ph->index_to_rank_mapping_;
+    coll->initPhase(ph);
 
-    double t_stop = get_time();
-    double t_ms = (t_stop - t_start)*1e3;
-    if (rank_ == 0){
-      std::cout << "Load balance data migration took " << t_ms << "ms" << std::endl;
+    //the balancers weigh elements by size: arrivals bring theirs, elements
+    //never moved are sized once, and a dump wants every size up to date
+    for (const migration& m : toRecv){
+      ph->local_[ph->index_to_rank_mapping_[m.index].rankUniqueId].bytes = m.size;
+    }
+    for (LocalIndex& lidx : ph->local_){
+      if (!dumpLb_ && lidx.bytes != 0) continue;
+      auto elem = coll->getElement(lidx.index);
+      if (!elem) continue;
+      non_local_handler_t handler{};
+      auto s_ar = handler.make_sizing_archive();
+      Accessor::compute_size(*elem, s_ar);
+      lidx.bytes = handler.get_size(s_ar);
     }
 
+    phaseTimes_.ns[PhaseTimes::Migration] += wall_ns() - t_start;
+
+    async_collection<T,Index> ret(std::move(coll));
+    return ret;
+  }
+
+  /**
+   * @brief Exchange halos between the neighboring elements of a phase as one
+   *        neighborhood collective, collective over all ranks. Each element
+   *        sends every neighbor Accessor::pack(T&, local, remote, Archive&)
+   *        and takes in theirs with Accessor::unpack(T&, local, remote, Archive&).
+   * @param neighbors Maps an element index to a container of the indices of
+   *        its neighbors. The relation must be symmetric and must not change
+   *        until the phase is rebalanced, since the graph is kept until then.
+   */
+  template <class Accessor, class Index, class T, class Neighbors>
+  auto exchange(Phase<Index>& ph, async_collection<T,Index>&& coll, Neighbors&& neighbors){
+    clear_tasks();
+    uint64_t t_start = wall_ns();
+    if (!ph->halo_){
+      ph->halo_ = make_halo_graph(*ph.data_, neighbors);
+    }
+    darma_backend::halo_graph& g = *ph->halo_;
+    collection<T,Index>* elems = coll.get();
+
+    int n = g.ranks.size();
+    std::vector<int> sendCounts(n), sendDispls(n), recvCounts(n), recvDispls(n);
+    std::vector<char> sendBuf;
+    for (int k=0; k < n; ++k){
+      std::size_t start = sendBuf.size();
+      for (auto& e : g.sends[k]) append_halo_piece<Accessor>(elems, e.local, e.remote, sendBuf);
+      sendDispls[k] = halo_count(start);
+      sendCounts[k] = halo_count(sendBuf.size() - start);
+    }
+    halo_count(sendBuf.size());
+    std::vector<char> localBuf;
+    for (auto& e : g.local) append_halo_piece<Accessor>(elems, e.local, e.remote, localBuf);
+
+    MPI_Neighbor_alltoall(sendCounts.data(), 1, MPI_INT, recvCounts.data(), 1, MPI_INT, g.comm);
+    std::size_t recvBytes = 0;
+    for (int k=0; k < n; ++k){
+      recvDispls[k] = halo_count(recvBytes);
+      recvBytes += recvCounts[k];
+    }
+    std::vector<char> recvBuf(halo_count(recvBytes));
+    MPI_Request req;
+    MPI_Ineighbor_alltoallv(sendBuf.data(), sendCounts.data(), sendDispls.data(), MPI_BYTE,
+                            recvBuf.data(), recvCounts.data(), recvDispls.data(), MPI_BYTE,
+                            g.comm, &req);
+
+    //pairs within this rank unpack while the collective is in flight
+    const char* piece = localBuf.data();
+    for (auto& e : g.local){
+      piece = unpack_halo_piece<Accessor>(elems, e.remote, e.local, piece);
+    }
+    MPI_Wait(&req, MPI_STATUS_IGNORE);
+    for (int k=0; k < n; ++k){
+      piece = recvBuf.data() + recvDispls[k];
+      for (auto& e : g.recvs[k]){
+        piece = unpack_halo_piece<Accessor>(elems, e.local, e.remote, piece);
+      }
+    }
+    phaseTimes_.ns[PhaseTimes::CommWait] += wall_ns() - t_start;
 
     async_collection<T,Index> ret(std::move(coll));
     return ret;
@@ -553,6 +860,87 @@ struct MpiBackend {
 
   template <class Phase, class GeneratorTask>
   void register_phase_collection(Phase& ph, GeneratorTask&& gen){
+    queue_phase_tasks(ph, gen);
+    //flush all tasks created by this collection
+    //run "bulk-synchronously" for now
+    clear_tasks();
+    if (phaseReport_){
+      report_phase();
+    }
+  }
+
+  /**
+   * @brief Detect when the active messages sent by an idempotent phase,
+   *        and the ones they trigger in turn, have all been delivered
+   */
+  darma_backend::termination_detector make_termination_detection(){
+    return darma_backend::termination_detector(comm_);
+  }
+
+  template <class Phase, class Terminator, class GeneratorTask>
+  void register_phase_idempotent_collection(Phase& ph, Terminator&& term, GeneratorTask&& gen){
+    queue_phase_tasks(ph, gen);
+    //keep delivering put_task messages until no rank has any left
+    wait_for_termination(term);
+    if (phaseReport_){
+      report_phase();
+    }
+  }
+
+  template <class Idx, class GeneratorTask>
+  void register_concurrent_work(Idx size, GeneratorTask& gen){
+    static_assert(std::is_integral<Idx>::value, "concurrent work needs an integral index space");
+    //whatever produced the arguments must be done, as before a phase
+    clear_tasks();
+    Context* ctx = static_cast<Context*>(this);
+    uint64_t t_start = wall_ns();
+    auto body = [&](int64_t begin, int64_t end){
+      for (int64_t i=begin; i < end; ++i){
+        Idx idx = i;
+        gen.invoke(ctx, idx);
+      }
+    };
+    if (threads_){
+      threads_->parallel_for(size, body);
+    } else {
+      body(0, size);
+    }
+    phaseTimes_.ns[PhaseTimes::Compute] += wall_ns() - t_start;
+  }
+
+  /** @brief The put_task messages this rank delivered without MPI so far */
+  uint64_t num_local_active() const {
+    return numLocalActive_;
+  }
+
+  /** @brief The put_task messages that waited for credits before being sent */
+  uint64_t num_held_sends() const {
+    return numHeldTotal_;
+  }
+
+  /**
+   * @brief The most bytes of messages nobody had posted a receive for that
+   *        this rank held at once
+   */
+  uint64_t peak_unexpected_bytes() const {
+    return peakUnexpectedBytes_;
+  }
+
+  /**
+   * @brief Release the payload of an unexpected active message once it was
+   *        unpacked, owing its bytes back to the sender as credits
+   * @param source The rank that sent the message
+   * @param size   The size of the payload
+   */
+  void consume_unexpected(int source, std::size_t size);
+
+  /** @brief The threads concurrent work runs on, including the calling thread */
+  int num_threads() const {
+    return threads_ ? threads_->size() : 1;
+  }
+
+  template <class Phase, class GeneratorTask>
+  void queue_phase_tasks(Phase& ph, GeneratorTask& gen){
     clear_tasks();
     int size = ph->local().size();
     for (auto iter=ph->index_begin(); iter != ph->index_end(); ++iter){
@@ -561,18 +949,9 @@ struct MpiBackend {
       //these rigorously cannot have any dependencies
       //frontend().register_dependencies(be_task);
       be_task->setCounters(&local.counters);
+      be_task->setIndex(local.index);
       taskQueue_.push_back(be_task);
     }
-    //flush all tasks created by this collection
-    //run "bulk-synchronously" for now
-    clear_tasks();
-  }
-
-  template <class Phase, class Terminator, class GeneratorTask>
-  void register_phase_idempotent_collection(Phase& ph, Terminator&& term, GeneratorTask&& gen){
-    register_phase_collection(ph, std::move(gen));
-    //add a task that will keep looping until termination detection is achieved
-    //taskQueue_.push_back(terminate_task);
   }
 
   template <class Functor, class T, class Idx>
@@ -595,12 +974,20 @@ struct MpiBackend {
     clear_tasks();
 
     auto localResult = register_local_reduce<Functor>(std::move(collIn), collOut);
-    MPI_Allreduce(MPI_IN_PLACE,
-                  Functor::mpiBuffer(*localResult),
-                  Functor::mpiSize(*localResult),
-                  Functor::mpiType(*localResult),
-                  Functor::mpiOp(*localResult),
-                  comm_);
+    if (topology_){
+      darma_backend::allreduce(Functor::mpiBuffer(*localResult),
+                               Functor::mpiSize(*localResult),
+                               Functor::mpiType(*localResult),
+                               Functor::mpiOp(*localResult),
+                               *topology_);
+    } else {
+      MPI_Allreduce(MPI_IN_PLACE,
+                    Functor::mpiBuffer(*localResult),
+                    Functor::mpiSize(*localResult),
+                    Functor::mpiType(*localResult),
+                    Functor::mpiOp(*localResult),
+                    comm_);
+    }
     return localResult;
   }
   
@@ -610,7 +997,24 @@ struct MpiBackend {
   {
     // Finish all pending tasks
     clear_tasks();
-    return darma_backend::gather(std::move(coll_in), root, comm_);
+    if (topology_){
+      return darma_backend::gather(std::move(coll_in), root, *topology_, gatherComm_);
+    }
+    return darma_backend::gather(std::move(coll_in), root, comm_, gatherComm_);
+  }
+
+  template <class Phase, class T, class Idx, class Consumer>
+  void register_phase_gather_stream(Phase& ph, int root,
+                                    async_ref_base<collection<T, Idx>>&& coll_in,
+                                    Consumer&& consume)
+  {
+    // Finish all pending tasks
+    clear_tasks();
+    if (topology_){
+      darma_backend::gather_stream(std::move(coll_in), root, consume, *topology_, gatherComm_);
+    } else {
+      darma_backend::gather_stream(std::move(coll_in), root, consume, comm_, gatherComm_);
+    }
   }
   
   template <class Idx, class Phase, class T>
@@ -619,7 +1023,15 @@ struct MpiBackend {
   {
     // Finish all pending tasks
     clear_tasks();
-    return darma_backend::broadcast<Idx>(std::move(ref_in), root, comm_);
+    std::vector<int> local;
+    for (auto& l : ph->local()){
+      local.push_back(l.index);
+    }
+    Idx size = ph->getSize();
+    if (topology_){
+      return darma_backend::broadcast<Idx>(std::move(ref_in), root, *topology_, size, local);
+    }
+    return darma_backend::broadcast<Idx>(std::move(ref_in), root, comm_, size, local);
   }
 
   template <class T, class Index>
@@ -628,10 +1040,20 @@ struct MpiBackend {
   }
 
   template <class T>
-  auto get_collection_element(int id, int idx){
+  auto get_collection_element(int id, int localId){
+    if (id < 0 || std::size_t(id) >= collections_.size() || !collections_[id]){
+      error("Rank %d received a message for unknown collection %d", rank_, id);
+    }
     //hope this is an int
-    collection<T,int>* coll = static_cast<collection<T,int>*>(collections_[idx]);
-    return get_element(idx, coll);
+    collection<T,int>* coll = static_cast<collection<T,int>*>(collections_[id]);
+    auto t = coll->getLocalElement(localId);
+    if (t){
+      async_ref_base<T> ret(std::move(t));
+      ret.setParent(coll);
+      return ret;
+    }
+    //not created yet, or no phase has assigned rank-unique ids
+    return get_element(coll->globalIndex(rank_, localId), coll);
   }
 
   template <class Index, class T>
@@ -670,25 +1092,204 @@ struct MpiBackend {
   template <class Accessor, class T, class Index>
   static int register_recv_generator(){
     int id = taskIdCtr_++;
-    generators_.push_back(new RecvOpGenerator<Context,Accessor,T,Index>);
+    //task ids are packed into the low three bits of the tag
+    if (id > 7){
+      std::cerr << "Too many active message types registered - max is 7" << std::endl;
+      abort();
+    }
+    generators().resize(id+1, nullptr);
+    generators()[id] = new RecvOpGenerator<Context,Accessor,T,Index>;
     return id;
   }
 
-  void* allocate_temp_buffer(int size);
-  void free_temp_buffer(void* buf, int size);
+  void* allocate_temp_buffer(std::size_t size);
+  void free_temp_buffer(void* buf, std::size_t size);
+
+  /**
+   * @brief Collect the performance counters of every index in a phase onto root
+   * @param ph   The phase
+   * @param root The rank to collect on
+   * @return     The counters of all indices in index order on root, empty elsewhere
+   */
+  template <class Idx>
+  std::vector<LocalIndex> gather_counters(Phase<Idx>& ph, int root = 0){
+    clear_tasks();
+    return gather_counters(ph->local(), root);
+  }
+
+  /**
+   * @brief Write counters as CSV, one line per index
+   */
+  static void write_counters(std::ostream& os, const std::vector<LocalIndex>& counters);
+
+  /**
+   * @brief The time breakdown of the most recent phase across all ranks.
+   * Only valid on rank 0 when running with --phase-report.
+   */
+  const PhaseTimesReduce& last_phase_report() const {
+    return lastPhaseReport_;
+  }
   
   void flush()
   {
     clear_tasks();
   }
 
- private:
+  /** A (weight, index) pair describing one element to the load balancers */
   using pair64 = std::pair<uint64_t,uint64_t>;
-  struct sortByWeight {
-    bool operator()(const pair64& lhs, const pair64& rhs) const {
-      return lhs.first < rhs.first;
+
+  /**
+   * @brief The names of the load balancers compiled into this backend,
+   *        as accepted by --lb and set_load_balancer
+   */
+  static std::vector<std::string> load_balancers();
+
+  /**
+   * @brief Switch the strategy used by rebalance and balance
+   * @param name One of load_balancers()
+   */
+  void set_load_balancer(const std::string& name);
+
+  /**
+   * @brief The pairwise exchange rounds the last balance() ran, 1 for the
+   *        strategies that compute the new mapping in one shot
+   */
+  int last_balance_rounds() const {
+    return lastBalanceRounds_;
+  }
+
+  /** @brief The elements this rank sent in all migrations so far */
+  const MigrationStats& migration_stats() const {
+    return migrationStats_;
+  }
+
+  /**
+   * @brief The node structure used by the hierarchical balancer and the
+   *        migration statistics, created on first use. Collective on first use.
+   */
+  darma_backend::node_topology& lb_topology();
+
+  /**
+   * @brief Change when --lb-auto lets a rebalance go ahead. The bandwidth
+   *        replaces the measured one until the next migration.
+   */
+  void set_auto_lb_params(const darma_backend::lb::auto_lb_params& params){
+    autoLb_ = params;
+    migrateBytesPerNs_ = params.bandwidth;
+  }
+
+  /** @brief Change the stopping rules of the commsplit balancer */
+  void set_comm_split_params(const darma_backend::lb::comm_split_params& params){
+    commSplitParams_ = params;
+  }
+
+  /**
+   * @brief balance
+   * @param local
+   * @return The new local configuraiton
+   */
+  std::vector<pair64> balance(const std::vector<LocalIndex>& local);
+
+  /**
+   * @brief balance
+   * @param localConfig
+   * @return The new local configuraiton
+   */
+  std::vector<pair64> balance(std::vector<pair64>&& localConfig);
+
+  /**
+   * @brief balance, taking the packed size of the elements into account
+   *        where the strategy supports it (commsplit)
+   * @param localConfig
+   * @param sizes The packed size of the local elements
+   * @return The new local configuraiton
+   */
+  std::vector<pair64> balance(std::vector<pair64>&& localConfig,
+                              const darma_backend::lb::object_sizes& sizes);
+
+ private:
+
+  std::vector<LocalIndex> gather_counters(const std::vector<LocalIndex>& local, int root);
+
+  /**
+   * @brief Charge a packed send to the element whose task is running
+   * @param messages The number of messages the one packed buffer goes out in
+   */
+  void count_send(std::size_t bytes, uint64_t pack_start, std::size_t messages = 1){
+    if (!activeCounters_) return;
+    activeCounters_->bytesSent += bytes * messages;
+    activeCounters_->numMessages += messages;
+    if (timeSerialization_){
+      activeCounters_->serializeNs += wall_ns() - pack_start;
     }
-  };
+  }
+
+  template <class Neighbors>
+  std::shared_ptr<darma_backend::halo_graph> make_halo_graph(PhaseData& ph, Neighbors& neighbors){
+    std::vector<darma_backend::halo_graph::edge> edges;
+    std::vector<int> ranks;
+    for (const LocalIndex& lidx : ph.local()){
+      for (auto nbr : neighbors(lidx.index)){
+        edges.push_back({lidx.index, int(nbr)});
+        ranks.push_back(ph.getRank(nbr));
+      }
+    }
+    auto g = std::make_shared<darma_backend::halo_graph>();
+    if (!g->build(comm_, rank_, edges, ranks)){
+      error("Halo neighbors on rank %d are not symmetric", rank_);
+    }
+    return g;
+  }
+
+  /** Pack what element local sends to remote, prefixed with its size */
+  template <class Accessor, class Coll>
+  void append_halo_piece(Coll* elems, int local, int remote, std::vector<char>& buf){
+    auto elem = elems->getElement(local);
+    if (!elem){
+      error("Halo element %d is not on rank %d", local, rank_);
+    }
+    non_local_handler_t handler{};
+    auto s_ar = handler.make_sizing_archive();
+    Accessor::compute_size(*elem, local, remote, s_ar);
+    auto p_ar = handler.make_packing_archive(std::move(s_ar));
+    Accessor::pack(*elem, local, remote, p_ar);
+    auto packed = handler.extract_buffer(std::move(p_ar));
+    uint64_t size = packed.capacity();
+    std::size_t offset = buf.size();
+    buf.resize(offset + sizeof(size) + size);
+    ::memcpy(&buf[offset], &size, sizeof(size));
+    ::memcpy(&buf[offset + sizeof(size)], packed.data(), size);
+  }
+
+  /**
+   * @brief Unpack into element local the piece remote sent it
+   * @return The next piece
+   */
+  template <class Accessor, class Coll>
+  const char* unpack_halo_piece(Coll* elems, int local, int remote, const char* piece){
+    uint64_t size;
+    ::memcpy(&size, piece, sizeof(size));
+    piece += sizeof(size);
+    auto elem = elems->getElement(local);
+    if (!elem){
+      error("Halo element %d is not on rank %d", local, rank_);
+    }
+    non_local_handler_t handler{};
+    auto u_ar = handler.make_unpacking_archive(
+      darma::serialization::NonOwningSerializationBuffer(const_cast<char*>(piece), size));
+    Accessor::unpack(*elem, local, remote, u_ar);
+    return piece + size;
+  }
+
+  /** Neighborhood collectives take int counts and displacements */
+  int halo_count(std::size_t bytes){
+    if (bytes > std::size_t(std::numeric_limits<int>::max())){
+      error("Halo exchange of %zu bytes on rank %d exceeds the int counts of MPI", bytes, rank_);
+    }
+    return int(bytes);
+  }
+
+  using sortByWeight = darma_backend::lb::sort_by_weight;
 
   void inform_listener(int idx);
 
@@ -699,22 +1300,80 @@ struct MpiBackend {
   bool progress_dependencies();
   void progress_tasks();
   void progress_engine();
+  /**
+   * @brief One iteration of the progress loop, charging its time
+   * to communication or idle in the phase times
+   */
+  void progress_timed();
+  /**
+   * @brief Combine the phase times across ranks, print them on rank 0, and reset them
+   */
+  void report_phase();
   void clear_dependencies();
   void clear_tasks();
+  /**
+   * @brief Run tasks and deliver messages until the detector finds that
+   *        no rank has any put_task message left to send or receive
+   */
+  void wait_for_termination(darma_backend::termination_detector& term);
   void clear_queues();
   void make_global_mapping_from_local(int total_size, const std::vector<int>& local,
                                       std::vector<IndexInfo>& mapping);
   void make_rank_mapping(int total_size, std::vector<IndexInfo>& mapping, std::vector<int>& local);
   int allocate_request();
   void create_pending_recvs();
+  void post_probed_recv(const MPI_Status& stat);
   void add_pending_recv(PendingRecvBase* recv, int collId,
                         const IndexInfo& local, const IndexInfo& remote);
   int send_data(mpi_async_ref& in, int collId,
                  const IndexInfo& src, const IndexInfo& dst,
-                 void* data, int size, int taskId = 0 /*zero means no task*/);
+                 void* data, std::size_t size, int taskId = 0 /*zero means no task*/);
+  /** @brief Send the bytes of regions as one message, without copying them */
+  int send_regions(mpi_async_ref& in, int collId,
+                   const IndexInfo& src, const IndexInfo& dst,
+                   const darma_backend::region_list& regions);
+  /**
+   * @brief Send a put_task message, or hold it until the receiver returned
+   *        enough credits if flow control is on
+   * @return The request the send completes, which stays null while held
+   */
+  int send_active(mpi_async_ref& in, int collId,
+                  const IndexInfo& src, const IndexInfo& dst,
+                  void* data, std::size_t size, int taskId);
+  /** @brief Take in returned credits and send what they allow of the held messages */
+  void progress_credits();
+  /**
+   * @brief Give senders back the bytes this rank has consumed
+   * @param all Whether to return every owed byte, rather than only large debts
+   */
+  void return_credits(bool all);
+  void count_unexpected(int64_t bytes);
+
+  void send_data(int dest, void* data, std::size_t size, int tag, MPI_Comm comm, MPI_Request* req);
+  void recv_data(int src, void* data, std::size_t size, int tag, MPI_Comm comm, MPI_Request* req);
 
-  void send_data(int dest, void* data, int size, int tag, MPI_Request* req);
-  void recv_data(int src, void* data, int size, int tag, MPI_Request* req);
+  /**
+   * @brief Gather the load balancer inputs of a phase onto rank 0
+   *        and append them to the --lb-dump file
+   */
+  void dump_lb_records(const std::vector<LocalIndex>& local);
+
+  /**
+   * @brief Record the phase loads, balance, and build the new local elements and mapping
+   * @return Whether the mapping changed
+   */
+  bool rebalance_local(std::vector<LocalIndex>& local, std::vector<IndexInfo>& mapping);
+
+  /**
+   * @brief Send the load history of every element that was local before
+   *        a rebalance to the rank that owns it now
+   * @param oldLocal The elements before the rebalance, with their histories
+   * @param newLocal in-out The elements after the rebalance
+   * @param mapping  The element-to-rank mapping after the rebalance
+   */
+  void migrate_load_histories(const std::vector<LocalIndex>& oldLocal,
+                              std::vector<LocalIndex>& newLocal,
+                              const std::vector<IndexInfo>& mapping);
 
   void reset_phase(const std::vector<pair64>& config,
                    std::vector<LocalIndex>& local,
@@ -729,87 +1388,56 @@ struct MpiBackend {
     }
   }
 
-  /**
-   * @brief tradeTasks Try to find two tasks to trade between ranks that have a given difference
-   * in workload size. Note, the desired delta is 1/2 the difference in total workload since
-   * once subtracts and the other adds
-   * @param desiredDelta The difference between big/small tasks wanted for exact match
-   * @param bigger  The list of task sizes on the rank with bigger workload
-   * @param smaller The list of task sizes on the rank with smaller workload
-   * @param biggerIdx The index of the task in bigger list that best satisfies desired delta
-   * @param smallerIdx The index of the task in small list that best satisfies desired delta
-   * @return The actual delta achieved
-   */
-  uint64_t tradeTasks(uint64_t desiredDelta,
-                  const std::vector<pair64>& bigger,
-                  const std::vector<pair64>& smaller,
-                  std::vector<int>& biggerIdx, 
-                  std::vector<int>& smallerIdx,
-                  int maxTrades);
-
-  uint64_t tradeTasks(uint64_t desiredDelta,
-                  uint64_t maxOverage,
-                  const std::vector<pair64>& bigger,
-                  const std::vector<pair64>& smaller,
-                  int biggerIdx, int smallerIdx);
-
-  /**
-   * @brief takeTasks Try to find a set of tasks to balance workload between two rans.
-   * Note, the desired delta is 1/2 the difference in total workload.
-   * @param desiredDelta The difference between big/small tasks wanted for exact match
-   * @param giver The list of task sizes on the rank with bigger workload
-   * @return The set of tasks that best matches delta
-   */
-  std::set<int> takeTasks(uint64_t desiredDelta, const std::vector<pair64>& giver, int maxTake);
-
-  /**
-   * @brief balance
-   * @param local
-   * @return The new local configuraiton
-   */
-  std::vector<pair64> balance(const std::vector<LocalIndex>& local);
-
-  /**
-   * @brief balance
-   * @param localConfig
-   * @return The new local configuraiton
-   */
-  std::vector<pair64> balance(std::vector<pair64>&& localConfig);
-
   /**
    * @brief runCommSplitBalancer
    * @param localConfig
    * @param newLocalConfig in-out return of new local config after moving tasks
+   * @param partner The rank to trade with, which may be this rank
    * @param localWork The total amount of work currently local
    * @param globalWork  The total amount of work globally
    * @param maxNumLocalTasks  The max number of tasks on any given node
    * @param allowGiveTake whether to rigorously enforce only "exchanging" tasks
    *         or to allow giving/taking tasks that change num local
+   * @param sizes in-out The known element sizes, extended with the partner's
    */
   void runCommSplitBalancer(std::vector<pair64>&& localConfig,
-      std::vector<pair64>& newLocalConfig,
+      std::vector<pair64>& newLocalConfig, int partner,
       uint64_t localWork, uint64_t globalWork,
-      int maxNumLocalTasks, bool allowTrades, bool allowGiveTake);
-
-  /**
-   * @brief getPartner Get a partner for trading tasks
-   * @param rank Current rank in relevant communicator
-   * @return Your partner in the trade
-   */
-  int getTradingPartner(int rank) const;
+      int maxNumLocalTasks, bool allowTrades, bool allowGiveTake,
+      darma_backend::lb::object_sizes& sizes);
 
   std::vector<pair64> zoltanBalance(std::vector<pair64>&& localConfig);
   std::vector<pair64> randomBalance(std::vector<pair64>&& localConfig);
   std::vector<pair64> debugBalance(std::vector<pair64>&& localConfig);
-  std::vector<pair64> commSplitBalance(std::vector<pair64>&& localConfig);
+  /**
+   * @brief Balance within each node, then between nodes through the node
+   *        leaders, then spread what arrived over the ranks of each node
+   */
+  std::vector<pair64> hierarchicalBalance(std::vector<pair64>&& localConfig,
+                                          darma_backend::lb::object_sizes sizes);
+  std::vector<pair64> commSplitBalance(std::vector<pair64>&& localConfig,
+                                       darma_backend::lb::object_sizes sizes);
+  /**
+   * @brief Dimension exchange: in round d every rank balances with the rank
+   *        that differs in bit d, giving away elements and not only swapping
+   *        them, and sweeps over all dimensions until the commsplit stopping
+   *        rules are met
+   */
+  std::vector<pair64> hypercubeBalance(std::vector<pair64>&& localConfig,
+                                       darma_backend::lb::object_sizes sizes);
 
  private:
-  struct PostedRecv {
-    int size;
-    void* data;
-    int id;
-    PostedRecv(int i, int s, void* d) :
-      id(i), size(s), data(d){}
+  /**
+   * One side of a point-to-point match: either a receive that is waiting for
+   * its message, or a message that was probed and posted before anyone
+   * expected it. A queue in the match table only ever holds one kind.
+   */
+  struct MatchEntry {
+    PendingRecvBase* pending = nullptr; //the expected receive, null for a message
+    void* data = nullptr;
+    std::size_t size = 0;
+    int id = -1;
+    MatchEntry* next = nullptr;
   };
 
   std::vector<Listener*> listeners_;
@@ -819,30 +1447,100 @@ struct MpiBackend {
   std::vector<int> freeRequests_;
   std::vector<darma::serialization::DynamicSerializationBuffer<>> sendBuffers_;
   std::list<task*> taskQueue_;
-  std::map<int,collection_base*> collections_;
-  std::map<int,std::list<PostedRecv>> recvsQueued_;
-  std::map<int,std::map<int,std::list<PendingRecvBase*>>> pendingRecvs_;
+  //indexed by collection id, which is dense
+  std::vector<collection_base*> collections_;
+  darma_backend::match_table<MatchEntry> matches_;
   MPI_Comm comm_;
+  MPI_Comm migrateComm_;
+  MPI_Comm gatherComm_; //the point-to-point messages of gathers, duplicated once
   int rank_;
   int size_;
   int collIdCtr_;
   int numPendingProbes_;
   static int taskIdCtr_;
-  static std::vector<RecvOpGeneratorBase<Context>*> generators_;
+  /**
+   * @brief The active message generators by task id. Applications register
+   *        from static initializers, so this cannot be a static member.
+   */
+  static std::vector<RecvOpGeneratorBase<Context>*>& generators();
 
   //for idempotent task regions
   int activeWindow_;
+  uint64_t activeSent_;  //put_task messages sent, for termination detection
+  uint64_t activeRecvd_; //put_task messages received
+  uint64_t numLocalActive_; //put_task messages that stayed on this rank
+
+  std::size_t messageChunk_; //messages beyond this many bytes go as chunks of a derived type
+
+  /**
+   * Credit flow control for put_task messages, off unless --unexpected-mem-cap
+   * is given. Every rank may have creditShare_ bytes in flight to each peer;
+   * the receiver returns them on creditComm_ once the messages are unpacked.
+   */
+  struct HeldSend {
+    int request;
+    int tag;
+    void* data;
+    std::size_t size;
+  };
+  int64_t creditShare_;
+  MPI_Comm creditComm_;
+  std::vector<int64_t> credits_;  //bytes this rank may still send to each rank
+  std::vector<int64_t> owed_;     //bytes consumed but not yet returned to each rank
+  std::vector<std::deque<HeldSend>> held_;
+  std::list<std::pair<int64_t,MPI_Request>> creditSends_;
+  int numHeld_;
+  uint64_t numHeldTotal_;
+  int64_t unexpectedBytes_;
+  uint64_t peakUnexpectedBytes_;
+  std::unique_ptr<darma_backend::thread_pool> threads_; //null unless --threads > 1
 
   MPI_Op perfCtrOp_;
   MPI_Datatype perfCtrType_;
 
+  bool phaseReport_;
+  int phaseCount_;
+  uint64_t numCompleted_;
+  uint64_t numTasksRun_;
+  PhaseTimes phaseTimes_;
+  PhaseTimesReduce lastPhaseReport_;
+  MPI_Op phaseTimesOp_;
+  MPI_Datatype phaseTimesType_;
+
+  //null unless node-aware collectives were requested
+  std::unique_ptr<darma_backend::node_topology> topology_;
+  //the nodes as seen by load balancing when topology_ is null
+  std::unique_ptr<darma_backend::node_topology> lbTopology_;
+  int ranksPerNode_;
+  MigrationStats migrationStats_;
+  int lastBalanceRounds_ = 0;
+  MigrationStats phaseMigration_;
+
+  //the counters of the phase task currently running, if any
+  PerformanceCounter* activeCounters_;
+  bool timeSerialization_;
+  //null unless hardware counters were requested
+  std::unique_ptr<darma_backend::hw_counters> hwCounters_;
+
+  //disabled unless a trace file was requested
+  darma_backend::tracer trace_;
+  std::string tracePrefix_;
+
   lb_type_t lbType_;
+  darma_backend::lb::comm_split_params commSplitParams_;
+  darma_backend::lb::load_model_params loadModel_;
+  darma_backend::lb::auto_lb_params autoLb_;
+  double migrateBytesPerNs_; //measured by the last migration, for --lb-auto
+  //set on every rank when --lb-dump is given, the file is only open on rank 0
+  bool dumpLb_;
+  darma_backend::lb_dump lbDump_;
 
 };
 
 template <class Accessor, class T, class Index>
 int recv_task_id(){
-  return MpiBackend::register_recv_generator<Accessor,T,Index>();
+  static const int id = MpiBackend::register_recv_generator<Accessor,T,Index>();
+  return id;
 }
 
 static inline auto allocate_context(MPI_Comm comm, int argc, char** argv){
@@ -118,8 +118,22 @@ struct collection : public collection_base {
     return iter == local_elements_.end() ? nullptr : iter->second;
   }
 
+  /**
+   * @brief Look up a local element by its rank-unique id, the number the
+   *        active-message tags carry, without searching either map
+   * @param rankUniqueId  The dense local number of the element in the current phase
+   * @return The element, or null if it does not exist here (yet)
+   */
+  std::shared_ptr<T> getLocalElement(int rankUniqueId) const {
+    if (rankUniqueId < 0 || std::size_t(rankUniqueId) >= local_by_unique_id_.size()){
+      return nullptr;
+    }
+    return local_by_unique_id_[rankUniqueId];
+  }
+
   void setElement(int idx, const std::shared_ptr<T>& t){
     local_elements_[idx] = t;
+    setDense(idx, t);
   }
 
   int size() const {
@@ -157,11 +171,21 @@ struct collection : public collection_base {
 
   void initPhase(Phase<int>& ph){
     index_mapping_ = ph.mapping();
+    //the local entries of a phase are in rank-unique id order
+    unique_id_to_index_.clear();
+    for (const LocalIndex& lidx : ph->local()){
+      unique_id_to_index_.push_back(lidx.index);
+    }
+    local_by_unique_id_.assign(unique_id_to_index_.size(), nullptr);
+    for (int i=0; i < unique_id_to_index_.size(); ++i){
+      local_by_unique_id_[i] = getElement(unique_id_to_index_[i]);
+    }
   }
 
   auto emplaceNew(const Idx& idx){
     auto t = std::make_shared<T>();
     local_elements_[idx] = t;
+    setDense(idx, t);
     return t;
   }
 
@@ -169,12 +193,29 @@ struct collection : public collection_base {
     return index_mapping_[index];
   }
 
+  int globalIndex(int rank, int rankUniqueId) const {
+    if (!unique_id_to_index_.empty() && std::size_t(rankUniqueId) < unique_id_to_index_.size()){
+      int idx = unique_id_to_index_[rankUniqueId];
+      if (index_mapping_[idx].rank == rank) return idx;
+    }
+    for (int i=0; i < int(index_mapping_.size()); ++i){
+      const IndexInfo& info = index_mapping_[i];
+      if (info.rank == rank && info.rankUniqueId == rankUniqueId){
+        return i;
+      }
+    }
+    std::cerr << "no index with id " << rankUniqueId
+      << " on rank " << rank << std::endl;
+    abort();
+  }
+
   auto& localElements() const {
     return local_elements_;
   }
 
   void remove(const Idx& idx){
     local_elements_.erase(idx);
+    setDense(idx, nullptr);
   }
 
   void addParentMpiRank(int index, int rank){
@@ -195,11 +236,23 @@ struct collection : public collection_base {
 
   std::vector<IndexInfo> index_mapping_;
   std::map<int, std::shared_ptr<T>> local_elements_;
+  //the local elements of the current phase, indexed by rank-unique id
+  std::vector<int> unique_id_to_index_;
+  std::vector<std::shared_ptr<T>> local_by_unique_id_;
   std::map<int,int> parent_mpi_ranks_;
   int size_;
   bool initialized_;
   std::unique_ptr<mpi_collection<T,Idx>> mpi_parent_;
 
+ private:
+  void setDense(int idx, const std::shared_ptr<T>& t){
+    if (idx < 0 || idx >= index_mapping_.size()) return;
+    int id = index_mapping_[idx].rankUniqueId;
+    if (id < unique_id_to_index_.size() && unique_id_to_index_[id] == idx){
+      local_by_unique_id_[id] = t;
+    }
+  }
+
 };
 
 
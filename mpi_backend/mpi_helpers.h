@@ -70,6 +70,20 @@ namespace darma_backend
   {
     return type_to_mpi<T>::datatype();
   }
+
+  inline int comm_rank(MPI_Comm comm)
+  {
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    return rank;
+  }
+
+  inline int comm_size(MPI_Comm comm)
+  {
+    int size;
+    MPI_Comm_size(comm, &size);
+    return size;
+  }
 }
 
 #endif  // DARMA_BACKEND_MPI_HELPERS_H
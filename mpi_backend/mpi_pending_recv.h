@@ -2,7 +2,10 @@
 #define mpi_pending_recv_h
 
 #include "mpi_listener.h"
+#include "mpi_task.h"
 #include "frontend.h"
+#include "mpi_phase.h"
+#include "regions.h"
 #include <tuple>
 #include <memory>
 #include <darma/serialization/simple_handler.h>
@@ -12,11 +15,12 @@ struct MpiBackend;
 
 struct PendingRecvBase : public Listener {
 
-  PendingRecvBase() : listener_(nullptr), id_(-1), size_(-1), data_(nullptr) {}
+  PendingRecvBase() : data_(nullptr), size_(0), id_(-1), listener_(nullptr),
+    counters_(nullptr), timeUnpack_(false), unexpectedSource_(-1) {}
 
   virtual ~PendingRecvBase(){}
 
-  void configure(MpiBackend* be, int size, void* data);
+  void configure(MpiBackend* be, std::size_t size, void* data);
 
   void setListener(Listener* listener){
     listener_ = listener;
@@ -26,10 +30,37 @@ struct PendingRecvBase : public Listener {
     id_ = id;
   }
 
+  /**
+   * @brief Charge this message to the counters of the element that posted it
+   * @param counters The counters, or null if not posted from a phase task
+   * @param timeUnpack Whether to also charge the time spent unpacking
+   */
+  void setCounters(PerformanceCounter* counters, bool timeUnpack){
+    counters_ = counters;
+    timeUnpack_ = timeUnpack;
+  }
+
   int id() const {
     return id_;
   }
 
+  /**
+   * @brief Mark the payload as an active message nobody posted a receive for,
+   *        so freeing it gives the sender its flow control credits back
+   * @param source The rank the message came from
+   */
+  void setUnexpectedSource(int source){
+    unexpectedSource_ = source;
+  }
+
+  /**
+   * @brief Unpack straight out of a buffer that owner keeps alive, instead of
+   *        a temp buffer freed once unpacked
+   */
+  void setOwner(std::shared_ptr<void> owner){
+    owner_ = std::move(owner);
+  }
+
   void clear();
 
   using non_local_handler_t = darma::serialization::SimpleSerializationHandler<>;
@@ -37,10 +68,14 @@ struct PendingRecvBase : public Listener {
 
  protected:
   void* data_;
-  int size_;
+  std::size_t size_;
   int id_;
   Listener* listener_;
   Frontend<MpiBackend>* be_;
+  PerformanceCounter* counters_;
+  bool timeUnpack_;
+  int unexpectedSource_;
+  std::shared_ptr<void> owner_;
 };
 
 template <class Accessor, class T, class Index>
@@ -58,14 +93,18 @@ struct PendingRecv : public PendingRecvBase {
 
   template <class Handler, class Tuple>
   void unpack(Handler&& handler, Tuple&& t) {
-    if (size_ == -1){
+    if (!data_){
       std::cerr << "Size not inited on " << this << std::endl;
       abort();
     }
+    uint64_t t_start = timeUnpack_ ? wall_ns() : 0;
     auto u_ar = handler.make_unpacking_archive(
       darma::serialization::NonOwningSerializationBuffer(data_, size_));
     static constexpr auto size = std::tuple_size<std::remove_reference_t<Tuple>>::value;
     call(std::move(u_ar), std::forward<Tuple>(t), std::make_index_sequence<size>{});
+    if (timeUnpack_ && counters_){
+      counters_->serializeNs += wall_ns() - t_start;
+    }
   }
 
   //void setObject(T* t){
@@ -125,6 +164,49 @@ struct NonLocalPendingRecv : public PendingRecv<Accessor,T,Index>
   std::tuple<Args...> args_;
 };
 
+/**
+ * A receive for an accessor that names the regions of the object the message
+ * lands in, so the payload is copied into place rather than unpacked
+ */
+template <class Accessor, class T, class Index, class... Args>
+struct RegionPendingRecv : public PendingRecvBase
+{
+  template <class... InArgs>
+  RegionPendingRecv(async_ref_base<T>&& ref, const Index& local, const Index& remote,
+                    InArgs&&... args) :
+    t_(std::move(ref)), local_(local), remote_(remote),
+    args_(std::forward<InArgs>(args)...)
+  {}
+
+  template <size_t... I>
+  void describe(darma_backend::region_list& regions, std::index_sequence<I...>){
+    Accessor::recv_regions(*t_, local_, remote_, regions, std::get<I>(args_)...);
+  }
+
+  bool finalize() override {
+    uint64_t t_start = timeUnpack_ ? wall_ns() : 0;
+    darma_backend::region_list regions;
+    describe(regions, std::index_sequence_for<Args...>{});
+    if (regions.bytes() != size_){
+      std::cerr << "Received " << size_ << " bytes into regions of "
+                << regions.bytes() << " bytes" << std::endl;
+      abort();
+    }
+    regions.scatter(data_);
+    if (timeUnpack_ && counters_){
+      counters_->serializeNs += wall_ns() - t_start;
+    }
+    if (listener_) listener_->decrement_join_counter();
+    clear();
+    return true; //this is done
+  }
+
+  async_ref_base<T> t_;
+  Index local_;
+  Index remote_;
+  std::tuple<Args...> args_;
+};
+
 
 template <class Context>
 struct RecvOpGeneratorBase {
@@ -139,6 +221,23 @@ struct RecvOpGenerator : public RecvOpGeneratorBase<Context> {
   }
 };
 
+/**
+ * A put_task to an element on the same rank. The payload is already packed,
+ * the task only unpacks it on the target.
+ */
+template <class Context>
+struct LocalActiveTask : public TaskBase<Context> {
+  LocalActiveTask(PendingRecvBase* recv) : recv_(recv){}
+
+  void run(Context* ctx) override {
+    if (recv_->finalize()){
+      delete recv_;
+    }
+  }
+
+  PendingRecvBase* recv_;
+};
+
 struct PendingSendBase : public Listener {
   virtual ~PendingSendBase(){}
 
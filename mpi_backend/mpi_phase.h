@@ -2,19 +2,55 @@
 #define mpi_be_phase_h
 
 #include <memory>
+#include <chrono>
 #include <cstdint>
 #include "mpi_index_entry.h"
+#include "load_model.h"
+
+namespace darma_backend {
+  struct halo_graph;
+}
+
+/** Monotonic wall clock time in nanoseconds */
+static inline uint64_t wall_ns()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
 
 struct PerformanceCounter {
-  uint64_t counter; //just one for now
-  PerformanceCounter() : counter(0){}
+  uint64_t wallNs;       //time running tasks, the load used by the balancers
+  uint64_t bytesSent;
+  uint64_t bytesRecvd;
+  uint64_t numMessages;  //sent and received
+  uint64_t serializeNs;  //packing sends and unpacking receives, if timed
+  uint64_t cycles;       //hardware counters, if enabled
+  uint64_t instructions;
+
+  PerformanceCounter(){
+    reset();
+  }
+
+  void reset(){
+    wallNs = 0;
+    bytesSent = 0;
+    bytesRecvd = 0;
+    numMessages = 0;
+    serializeNs = 0;
+    cycles = 0;
+    instructions = 0;
+  }
 };
 
 struct LocalIndex {
   PerformanceCounter counters;
   int index;
+  //packed size of the element when last measured, 0 if unknown
+  uint64_t bytes;
+  //loads of past phases, follows the element when it migrates
+  darma_backend::lb::load_history history;
 
-  LocalIndex(int i) : index(i){} 
+  LocalIndex(int i) : index(i), bytes(0){} 
 };
 
 namespace detail
@@ -85,6 +121,8 @@ struct PhaseData {
   int size_;
   std::vector<IndexInfo> index_to_rank_mapping_;
   std::vector<LocalIndex> local_;
+  //the neighbor graph of the last halo exchange, dropped on rebalance
+  std::shared_ptr<darma_backend::halo_graph> halo_;
 };
 
 template <class Idx>
@@ -9,7 +9,8 @@ struct collection_base;
 template <class Context>
 struct TaskBase : public Listener {
   TaskBase() : 
-    counters_(nullptr)
+    counters_(nullptr),
+    index_(-1)
   {}
 
   virtual ~TaskBase(){}
@@ -20,18 +21,26 @@ struct TaskBase : public Listener {
     return counters_;
   }
 
-  void addCounter(uint64_t ctr){
-    if (counters_){
-      counters_->counter += ctr;
-    }
+  PerformanceCounter* counters() const {
+    return counters_;
   }
 
   void setCounters(PerformanceCounter* ctr){
     counters_ = ctr;
   }
 
+  /** @brief The collection index this task runs on, -1 if not a phase task */
+  int index() const {
+    return index_;
+  }
+
+  void setIndex(int idx){
+    index_ = idx;
+  }
+
  private:
   PerformanceCounter* counters_;
+  int index_;
 };
 
 template <class Context, class FrontendTask>
@@ -3,6 +3,46 @@
 std::vector<MpiBackend::pair64>
 MpiBackend::randomBalance(std::vector<pair64>&& localConfig)
 {
-  error("Random load balancer not yet implemented");
-  return localConfig;
+  //send every element to a uniformly random rank - a baseline to compare
+  //the real balancers against, not something to run in production
+  static uint64_t numCalls = 0;
+  auto dsts = darma_backend::lb::random_destinations(rank_, size_, numCalls++, localConfig.size());
+
+  std::vector<std::vector<uint64_t>> outgoing(size_);
+  for (int i=0; i < localConfig.size(); ++i){
+    auto& out = outgoing[dsts[i]];
+    out.push_back(localConfig[i].first);
+    out.push_back(localConfig[i].second);
+  }
+
+  std::vector<int> sendCounts(size_);
+  std::vector<int> sendDispls(size_);
+  std::vector<uint64_t> sendBuf;
+  for (int r=0; r < size_; ++r){
+    sendCounts[r] = outgoing[r].size();
+    sendDispls[r] = sendBuf.size();
+    sendBuf.insert(sendBuf.end(), outgoing[r].begin(), outgoing[r].end());
+  }
+
+  std::vector<int> recvCounts(size_);
+  MPI_Alltoall(sendCounts.data(), 1, MPI_INT, recvCounts.data(), 1, MPI_INT, comm_);
+
+  std::vector<int> recvDispls(size_);
+  int numRecvd = 0;
+  for (int r=0; r < size_; ++r){
+    recvDispls[r] = numRecvd;
+    numRecvd += recvCounts[r];
+  }
+  std::vector<uint64_t> recvBuf(numRecvd);
+  MPI_Alltoallv(sendBuf.data(), sendCounts.data(), sendDispls.data(), MPI_UINT64_T,
+                recvBuf.data(), recvCounts.data(), recvDispls.data(), MPI_UINT64_T,
+                comm_);
+
+  std::vector<pair64> newConfig(numRecvd / 2);
+  for (int i=0; i < newConfig.size(); ++i){
+    newConfig[i].first = recvBuf[2*i];
+    newConfig[i].second = recvBuf[2*i+1];
+  }
+  darmaDebug(LB, "Rank {} has {} tasks after random LB", rank_, newConfig.size());
+  return newConfig;
 }
@@ -0,0 +1,42 @@
+#include "regions.h"
+#include "large_count.h"
+#include <algorithm>
+#include <cstring>
+
+namespace darma_backend {
+
+void
+region_list::scatter(const void* data) const
+{
+  const char* src = static_cast<const char*>(data);
+  for (auto& r : regions_){
+    ::memcpy(r.first, src, r.second);
+    src += r.second;
+  }
+}
+
+MPI_Datatype
+region_list::make_type(std::size_t chunk) const
+{
+  if (chunk == 0 || chunk > max_message_chunk) chunk = max_message_chunk;
+  //block lengths are int, so long regions become several blocks
+  std::vector<int> lengths;
+  std::vector<MPI_Aint> displs;
+  lengths.reserve(regions_.size());
+  displs.reserve(regions_.size());
+  for (auto& r : regions_){
+    for (std::size_t offset=0; offset < r.second; offset += chunk){
+      MPI_Aint addr;
+      MPI_Get_address(r.first + offset, &addr);
+      displs.push_back(addr);
+      lengths.push_back(int(std::min(chunk, r.second - offset)));
+    }
+  }
+  MPI_Datatype type;
+  MPI_Type_create_hindexed(int(lengths.size()), lengths.data(), displs.data(),
+                           MPI_BYTE, &type);
+  MPI_Type_commit(&type);
+  return type;
+}
+
+}
@@ -0,0 +1,82 @@
+#ifndef DARMA_BACKEND_REGIONS_H
+#define DARMA_BACKEND_REGIONS_H
+
+#include <mpi.h>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace darma_backend {
+  /**
+   * The pieces of an object's memory that make up one message, in message
+   * order. The message is their bytes laid end to end, so the sender can
+   * hand MPI the object itself instead of packing a copy, and the receiver
+   * can name where each byte lands.
+   */
+  class region_list {
+   public:
+    void add(const void* ptr, std::size_t bytes){
+      if (bytes == 0) return;
+      regions_.emplace_back(static_cast<char*>(const_cast<void*>(ptr)), bytes);
+      bytes_ += bytes;
+    }
+
+    /** @brief The total message size */
+    std::size_t bytes() const {
+      return bytes_;
+    }
+
+    std::size_t size() const {
+      return regions_.size();
+    }
+
+    /** @brief Copy a message of bytes() bytes into the regions */
+    void scatter(const void* data) const;
+
+    /**
+     * @brief The regions as a committed type at absolute addresses, to be
+     *        used as one element from MPI_BOTTOM and freed once posted
+     * @param chunk The largest run of bytes described by a single count
+     */
+    MPI_Datatype make_type(std::size_t chunk) const;
+
+   private:
+    std::vector<std::pair<char*,std::size_t>> regions_;
+    std::size_t bytes_ = 0;
+  };
+
+  /**
+   * Whether Accessor describes the sent message of a T as regions, with
+   *   static void send_regions(T&, Local, Remote, region_list&, Args...)
+   */
+  template <class Accessor, class T, class Local, class Remote, class... Args>
+  struct has_send_regions {
+    template <class A>
+    static auto test(int) -> decltype(A::send_regions(std::declval<T&>(),
+      std::declval<Local>(), std::declval<Remote>(),
+      std::declval<region_list&>(), std::declval<Args>()...), std::true_type{});
+    template <class A>
+    static std::false_type test(...);
+
+    static constexpr bool value = decltype(test<Accessor>(0))::value;
+  };
+
+  /**
+   * Whether Accessor describes where a received message lands in a T, with
+   *   static void recv_regions(T&, Local, Remote, region_list&, Args...)
+   */
+  template <class Accessor, class T, class Local, class Remote, class... Args>
+  struct has_recv_regions {
+    template <class A>
+    static auto test(int) -> decltype(A::recv_regions(std::declval<T&>(),
+      std::declval<Local>(), std::declval<Remote>(),
+      std::declval<region_list&>(), std::declval<Args>()...), std::true_type{});
+    template <class A>
+    static std::false_type test(...);
+
+    static constexpr bool value = decltype(test<Accessor>(0))::value;
+  };
+}
+
+#endif  // DARMA_BACKEND_REGIONS_H
@@ -0,0 +1,65 @@
+#include "termination.h"
+
+namespace darma_backend {
+
+  termination_detector::termination_detector(MPI_Comm comm) :
+    comm_(comm), request_(MPI_REQUEST_NULL), waves_(0), terminated_(false)
+  {
+    local_[0] = local_[1] = 0;
+    global_[0] = global_[1] = 0;
+    //no real wave can match this one
+    last_[0] = 1;
+    last_[1] = 0;
+  }
+
+  termination_detector::termination_detector(termination_detector&& other) :
+    comm_(other.comm_), request_(other.request_), waves_(other.waves_),
+    terminated_(other.terminated_)
+  {
+    if (request_ != MPI_REQUEST_NULL){
+      //the reduction writes into the buffers it was started with
+      MPI_Wait(&request_, MPI_STATUS_IGNORE);
+      other.request_ = MPI_REQUEST_NULL;
+    }
+    for (int i=0; i < 2; ++i){
+      local_[i] = other.local_[i];
+      global_[i] = other.global_[i];
+      last_[i] = other.last_[i];
+    }
+  }
+
+  termination_detector::~termination_detector()
+  {
+    if (request_ != MPI_REQUEST_NULL){
+      MPI_Wait(&request_, MPI_STATUS_IGNORE);
+    }
+  }
+
+  void
+  termination_detector::contribute(uint64_t sent, uint64_t recvd)
+  {
+    if (wave_active() || terminated_) return;
+    local_[0] = sent;
+    local_[1] = recvd;
+    MPI_Iallreduce(local_, global_, 2, MPI_UINT64_T, MPI_SUM, comm_, &request_);
+  }
+
+  bool
+  termination_detector::test()
+  {
+    if (terminated_) return true;
+    if (!wave_active()) return false;
+
+    int flag;
+    MPI_Test(&request_, &flag, MPI_STATUS_IGNORE);
+    if (!flag) return false;
+
+    ++waves_;
+    terminated_ = global_[0] == global_[1]
+               && global_[0] == last_[0] && global_[1] == last_[1];
+    last_[0] = global_[0];
+    last_[1] = global_[1];
+    return terminated_;
+  }
+
+}
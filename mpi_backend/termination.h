@@ -0,0 +1,68 @@
+#ifndef DARMA_BACKEND_TERMINATION_H
+#define DARMA_BACKEND_TERMINATION_H
+
+#include <mpi.h>
+#include <cstdint>
+
+namespace darma_backend {
+  /**
+   * Four-counter termination detection for active messages. Each wave is a
+   * nonblocking sum of the messages every rank has sent and received so far,
+   * started by a rank once it is locally idle. Since the counts only grow,
+   * two consecutive waves with the same totals and every send received mean
+   * nothing was in flight between them, and no rank can start work again.
+   * Ranks keep delivering messages while a wave is in flight, so there is
+   * no barrier per message.
+   */
+  class termination_detector {
+   public:
+    /**
+     * @param comm The communicator the waves reduce over. Every rank must
+     *             run the same detection at the same point of the program.
+     */
+    explicit termination_detector(MPI_Comm comm);
+
+    ~termination_detector();
+
+    termination_detector(termination_detector&& other);
+    termination_detector(const termination_detector&) = delete;
+    termination_detector& operator=(const termination_detector&) = delete;
+
+    /**
+     * @brief Start the next wave with this rank's counts, if none is in flight
+     * @param sent  The active messages this rank has sent so far
+     * @param recvd The active messages this rank has received so far
+     */
+    void contribute(uint64_t sent, uint64_t recvd);
+
+    /**
+     * @brief Check the wave in flight
+     * @return Whether it completed and detected termination
+     */
+    bool test();
+
+    bool wave_active() const {
+      return request_ != MPI_REQUEST_NULL;
+    }
+
+    bool terminated() const {
+      return terminated_;
+    }
+
+    /** @brief The waves completed so far */
+    int waves() const {
+      return waves_;
+    }
+
+   private:
+    MPI_Comm comm_;
+    MPI_Request request_;
+    uint64_t local_[2];
+    uint64_t global_[2];
+    uint64_t last_[2];
+    int waves_;
+    bool terminated_;
+  };
+}
+
+#endif  // DARMA_BACKEND_TERMINATION_H
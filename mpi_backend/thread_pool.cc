@@ -0,0 +1,81 @@
+#include "thread_pool.h"
+#include <algorithm>
+
+namespace darma_backend {
+
+  thread_pool::thread_pool(int nthreads) :
+    body_(nullptr), n_(0), grain_(1), next_(0), generation_(0), busy_(0), stop_(false)
+  {
+    for (int i=1; i < nthreads; ++i){
+      workers_.emplace_back([this]{ work_loop(); });
+    }
+  }
+
+  thread_pool::~thread_pool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      stop_ = true;
+    }
+    start_.notify_all();
+    for (auto& t : workers_) t.join();
+  }
+
+  void
+  thread_pool::run_chunks()
+  {
+    while (true){
+      int64_t begin = next_.fetch_add(grain_);
+      if (begin >= n_) return;
+      (*body_)(begin, std::min(n_, begin + grain_));
+    }
+  }
+
+  void
+  thread_pool::work_loop()
+  {
+    uint64_t seen = 0;
+    while (true){
+      {
+        std::unique_lock<std::mutex> lock(mtx_);
+        start_.wait(lock, [&]{ return stop_ || generation_ != seen; });
+        if (stop_) return;
+        seen = generation_;
+      }
+      run_chunks();
+      {
+        std::lock_guard<std::mutex> lock(mtx_);
+        --busy_;
+      }
+      done_.notify_one();
+    }
+  }
+
+  void
+  thread_pool::parallel_for(int64_t n, const std::function<void(int64_t,int64_t)>& body)
+  {
+    if (n <= 0) return;
+    if (workers_.empty() || n == 1){
+      body(0, n);
+      return;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      body_ = &body;
+      n_ = n;
+      //several chunks per thread so uneven iterations even out
+      grain_ = std::max<int64_t>(1, n / (8 * size()));
+      next_ = 0;
+      busy_ = workers_.size();
+      ++generation_;
+    }
+    start_.notify_all();
+    run_chunks();
+
+    std::unique_lock<std::mutex> lock(mtx_);
+    done_.wait(lock, [&]{ return busy_ == 0; });
+    body_ = nullptr;
+  }
+
+}
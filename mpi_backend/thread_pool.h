@@ -0,0 +1,61 @@
+#ifndef DARMA_BACKEND_THREAD_POOL_H
+#define DARMA_BACKEND_THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace darma_backend {
+  /**
+   * Worker threads that stay parked between loops, so a parallel-for costs
+   * a wakeup instead of a thread creation. The calling thread works on the
+   * loop too. Only one loop runs at a time.
+   */
+  class thread_pool {
+   public:
+    /**
+     * @param nthreads The threads working on each loop, including the caller
+     */
+    explicit thread_pool(int nthreads);
+
+    ~thread_pool();
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    int size() const {
+      return workers_.size() + 1;
+    }
+
+    /**
+     * @brief Run body over [0,n) in contiguous chunks handed out on demand,
+     *        and return once every chunk is done
+     * @param n    The number of iterations
+     * @param body Called as body(begin, end) for each chunk, from any thread
+     */
+    void parallel_for(int64_t n, const std::function<void(int64_t,int64_t)>& body);
+
+   private:
+    void work_loop();
+
+    void run_chunks();
+
+    std::vector<std::thread> workers_;
+    std::mutex mtx_;
+    std::condition_variable start_;
+    std::condition_variable done_;
+    const std::function<void(int64_t,int64_t)>* body_;
+    int64_t n_;
+    int64_t grain_;
+    std::atomic<int64_t> next_;
+    uint64_t generation_;
+    int busy_;
+    bool stop_;
+  };
+}
+
+#endif  // DARMA_BACKEND_THREAD_POOL_H
@@ -0,0 +1,73 @@
+#include "trace.h"
+#include <cstdio>
+#include <cstring>
+
+namespace darma_backend {
+
+  static const char trace_magic[8] = {'D','A','R','M','A','T','R','C'};
+
+  void
+  tracer::enable(std::size_t capacity)
+  {
+    capacity_ = capacity;
+    head_ = 0;
+    events_.resize(capacity);
+    t0_ = now();
+  }
+
+  void
+  tracer::dump(const std::string& path, int rank) const
+  {
+    trace_header header;
+    ::memcpy(header.magic, trace_magic, sizeof(trace_magic));
+    header.version = version;
+    header.rank = rank;
+    header.num_events = head_ < capacity_ ? head_ : capacity_;
+    header.num_dropped = head_ - header.num_events;
+
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f){
+      fprintf(stderr, "Unable to open trace file %s\n", path.c_str());
+      return;
+    }
+    fwrite(&header, sizeof(header), 1, f);
+    //oldest first: once wrapped, the oldest event is the next to be overwritten
+    uint64_t first = head_ - header.num_events;
+    for (uint64_t i=first; i < head_; ++i){
+      fwrite(&events_[i % capacity_], sizeof(trace_event), 1, f);
+    }
+    fclose(f);
+  }
+
+  bool
+  tracer::read(const std::string& path, trace_header& header,
+               std::vector<trace_event>& events)
+  {
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) return false;
+
+    bool ok = fread(&header, sizeof(header), 1, f) == 1
+           && ::memcmp(header.magic, trace_magic, sizeof(trace_magic)) == 0
+           && header.version == version;
+    if (ok){
+      events.resize(header.num_events);
+      ok = fread(events.data(), sizeof(trace_event), events.size(), f) == events.size();
+    }
+    fclose(f);
+    return ok;
+  }
+
+  const char*
+  tracer::name(uint32_t type)
+  {
+    switch(type){
+      case TraceTask: return "task";
+      case TraceSend: return "send";
+      case TraceRecv: return "recv";
+      case TraceLoadBalance: return "load balance";
+      case TraceMigrate: return "migrate";
+      default: return "unknown";
+    }
+  }
+
+}
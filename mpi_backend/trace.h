@@ -0,0 +1,148 @@
+#ifndef DARMA_BACKEND_TRACE_H
+#define DARMA_BACKEND_TRACE_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace darma_backend {
+
+  enum trace_event_type : uint32_t {
+    TraceTask = 0,
+    TraceSend,
+    TraceRecv,
+    TraceLoadBalance,
+    TraceMigrate,
+    TraceNumEventTypes
+  };
+
+  /**
+   * One fixed-size binary trace record. Times are in nanoseconds since the
+   * tracer was started. Meaning of the arguments depends on the type:
+   *  - task:    collection index (-1 if not a phase task)
+   *  - send:    peer rank, tag, bytes
+   *  - recv:    peer rank, tag, bytes
+   *  - lb:      number of local indices before and after
+   *  - migrate: number of objects sent and received
+   */
+  struct trace_event {
+    uint64_t start;
+    uint64_t stop;
+    uint32_t type;
+    int32_t arg0;
+    int32_t arg1;
+    int32_t arg2;
+  };
+
+  struct trace_header {
+    char magic[8];
+    uint32_t version;
+    int32_t rank;
+    uint64_t num_events;
+    uint64_t num_dropped;
+  };
+
+  /**
+   * Per-rank ring buffer of trace events. When the buffer is full the oldest
+   * events are overwritten. A tracer with no capacity is disabled and every
+   * record call returns immediately.
+   */
+  class tracer {
+   public:
+    static constexpr uint32_t version = 1;
+
+    tracer() : capacity_(0), head_(0), t0_(now()) {}
+
+    /**
+     * @brief Start recording into a buffer of the given number of events
+     */
+    void enable(std::size_t capacity);
+
+    bool enabled() const {
+      return capacity_ != 0;
+    }
+
+    /** @brief The current time in nanoseconds since the tracer was started */
+    uint64_t time() const {
+      return now() - t0_;
+    }
+
+    /** @brief Convert a steady clock time in nanoseconds to trace time */
+    uint64_t since_start(uint64_t ns) const {
+      return ns - t0_;
+    }
+
+    void record(trace_event_type type, uint64_t start, uint64_t stop,
+                int32_t arg0 = -1, int32_t arg1 = -1, int32_t arg2 = -1){
+      if (!enabled()) return;
+      trace_event& ev = events_[head_ % capacity_];
+      ev.start = start;
+      ev.stop = stop;
+      ev.type = type;
+      ev.arg0 = arg0;
+      ev.arg1 = arg1;
+      ev.arg2 = arg2;
+      ++head_;
+    }
+
+    /**
+     * @brief Start timing a message on a request. The event is
+     * recorded when the request completes.
+     */
+    void post(int request, trace_event_type type, int peer, int tag, uint64_t bytes){
+      if (!enabled()) return;
+      if (request >= static_cast< int >(posted_.size())){
+        posted_.resize(request + 1, trace_event{0, 0, TraceNumEventTypes, -1, -1, -1});
+      }
+      trace_event& ev = posted_[request];
+      ev.start = time();
+      ev.type = type;
+      ev.arg0 = peer;
+      ev.arg1 = tag;
+      //the event has 32 bits for the size, larger messages saturate
+      ev.arg2 = int32_t(std::min<uint64_t>(bytes, INT32_MAX));
+    }
+
+    void complete(int request){
+      if (!enabled() || request >= static_cast< int >(posted_.size())) return;
+      trace_event& ev = posted_[request];
+      if (ev.type == TraceNumEventTypes) return; //never posted
+      record(static_cast<trace_event_type>(ev.type), ev.start, time(), ev.arg0, ev.arg1, ev.arg2);
+      ev.type = TraceNumEventTypes;
+    }
+
+    /**
+     * @brief Write the buffered events, oldest first, to a binary file
+     * @param path The file name
+     * @param rank The rank recorded in the file header
+     */
+    void dump(const std::string& path, int rank) const;
+
+    /**
+     * @brief Read a file written by dump
+     * @return Whether the file could be read
+     */
+    static bool read(const std::string& path, trace_header& header,
+                     std::vector<trace_event>& events);
+
+    static const char* name(uint32_t type);
+
+   private:
+    static uint64_t now(){
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    std::size_t capacity_;
+    uint64_t head_;
+    uint64_t t0_;
+    std::vector<trace_event> events_;
+    //the messages currently in flight, indexed by request
+    std::vector<trace_event> posted_;
+  };
+
+}
+
+#endif  // DARMA_BACKEND_TRACE_H
@@ -91,3 +91,71 @@ TEST(mpi_broadcast_test, BroadcastFrontend) { // NOLINT
   
   dc->flush();
 }
+
+TEST(mpi_broadcast_test, BroadcastSerialized) { // NOLINT
+  int rank, nranks;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+  //the last rank is not a node leader with an even number of ranks
+  int root = nranks - 1;
+
+  darma_backend::node_topology topo(MPI_COMM_WORLD, 2);
+
+  //one that fits in the eager round, and one that needs several chunks
+  const std::size_t sizes[] = {16, 3*darma_backend::detail::broadcast_chunk_size + 5};
+  for (std::size_t n : sizes){
+    std::vector<char> element_vector(n);
+    for (std::size_t i=0; i < n; ++i) element_vector[i] = static_cast< char >(i % 127);
+
+    auto buff = rank == root
+      ? darma_backend::serializer::serialize(element_vector)
+      : darma_backend::serialization_buffer(0);
+    auto flat = darma_backend::detail::broadcast_serialized(std::move(buff), root);
+    EXPECT_EQ(darma_backend::serializer::deserialize<std::vector<char>>(flat), element_vector);
+
+    buff = rank == root
+      ? darma_backend::serializer::serialize(element_vector)
+      : darma_backend::serialization_buffer(0);
+    auto hier = darma_backend::detail::broadcast_serialized(std::move(buff), root, topo);
+    EXPECT_EQ(darma_backend::serializer::deserialize<std::vector<char>>(hier), element_vector);
+  }
+}
+
+TEST(mpi_broadcast_test, BroadcastShared) { // NOLINT
+  constexpr int value = 17;
+
+  int rank, nranks;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+
+  auto ref = async_ref<int, ReadOnly, None>::empty();
+  if (rank == 0) {
+    ref = async_ref<int, ReadOnly, None>::make(value);
+  }
+
+  std::vector<int> local = {2*rank, 2*rank + 1};
+  auto ret = darma_backend::broadcast< int >(std::move(ref), 0, MPI_COMM_WORLD, 2*nranks, local);
+
+  EXPECT_EQ(*ret->getElement(local[0]), value);
+  //all local indices reference the same copy
+  EXPECT_EQ(ret->getElement(local[0]), ret->getElement(local[1]));
+}
+
+TEST(mpi_broadcast_test, BroadcastFrontendMultipleLocal) { // NOLINT
+  int nranks;
+  MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+
+  auto dc = allocate_context(MPI_COMM_WORLD, 0, nullptr);
+
+  auto val = dc->make_async_ref< int >();
+  auto phase = dc->make_phase(2*nranks);
+  auto c = dc->make_collection<int>(2*nranks);
+
+  auto newval = dc->create_work<init_broadcast_val>(std::move(val), g_testval);
+
+  std::tie(c) = dc->phase_broadcast< int >(phase, 0, std::move(std::get<0>(newval)));
+
+  dc->create_phase_work< test_broadcasted >(phase, std::move(c));
+
+  dc->flush();
+}
@@ -0,0 +1,36 @@
+#include <gtest/gtest.h>
+#include <mpi_backend.h>
+#include <vector>
+
+using Context = Frontend<MpiBackend>;
+
+struct Square {
+  void operator()(Context* ctx, int index, int offset,
+                  async_ref_base<std::vector<long>>& out){
+    (*out)[index] = long(index + offset) * (index + offset);
+  }
+};
+
+//every index runs exactly once, whether or not there are threads
+TEST(mpi_concurrent_test, EveryIndexOnce) { // NOLINT
+  const int n = 10000;
+  const char* serialArgs[] = {"test"};
+  const char* threadArgs[] = {"test", "--", "--threads", "4"};
+
+  for (bool threaded : {false, true}){
+    SCOPED_TRACE(threaded);
+    auto dc = threaded ? allocate_context(MPI_COMM_WORLD, 4, const_cast<char**>(threadArgs))
+                       : allocate_context(MPI_COMM_WORLD, 1, const_cast<char**>(serialArgs));
+    EXPECT_EQ(dc->num_threads(), threaded ? 4 : 1);
+
+    auto out = dc->make_async_ref<std::vector<long>>(n, -1L);
+    auto squares = std::get<0>(dc->create_concurrent_work<Square>(n, 3, std::move(out)));
+    for (int i=0; i < n; ++i){
+      ASSERT_EQ((*squares)[i], long(i + 3) * (i + 3));
+    }
+
+    //an empty index space is fine
+    dc->create_concurrent_work<Square>(0, 3, std::move(squares));
+    dc->flush();
+  }
+}
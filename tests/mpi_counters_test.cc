@@ -0,0 +1,101 @@
+#include <gtest/gtest.h>
+#include <mpi_backend.h>
+#include <hw_counters.h>
+#include <sstream>
+
+static const uint64_t g_spin_ns = 200000;
+
+struct spin_task
+{
+  void operator()(Frontend<MpiBackend> *ctx, int index,
+                  async_ref< int, Modify, Modify > ref)
+  {
+    //heavier indices spin longer
+    uint64_t stop = wall_ns() + (index + 1)*g_spin_ns;
+    while (wall_ns() < stop);
+    *ref = index;
+  }
+};
+
+TEST(mpi_counters_test, PhaseCounters) { // NOLINT
+  int nranks;
+  MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+  int size = 2*nranks;
+
+  auto dc = allocate_context(MPI_COMM_WORLD, 0, nullptr);
+
+  auto c = dc->make_collection<int>(size);
+  auto phase = dc->make_phase(size);
+
+  std::tie(c) = dc->create_phase_work<spin_task>(phase, std::move(c));
+
+  for (const LocalIndex& lidx : phase->local()){
+    EXPECT_GE(lidx.counters.wallNs, (lidx.index + 1)*g_spin_ns);
+  }
+
+  auto all = dc->gather_counters(phase, 0);
+  if (dc->is_root()){
+    ASSERT_EQ(all.size(), size);
+    for (int i=0; i < size; ++i){
+      EXPECT_EQ(all[i].index, i);
+      EXPECT_GE(all[i].counters.wallNs, (i + 1)*g_spin_ns);
+      EXPECT_EQ(all[i].counters.numMessages, 0);
+    }
+
+    std::stringstream sstr;
+    MpiBackend::write_counters(sstr, all);
+    std::string line;
+    int numLines = 0;
+    while (std::getline(sstr, line)) ++numLines;
+    EXPECT_EQ(numLines, size + 1);
+  } else {
+    EXPECT_TRUE(all.empty());
+  }
+
+  dc->flush();
+}
+
+TEST(mpi_counters_test, HardwareCounters) { // NOLINT
+  darma_backend::hw_counters hw;
+  if (!hw.open()){
+    GTEST_SKIP();
+  }
+
+  uint64_t cycles_start, instructions_start;
+  hw.read(cycles_start, instructions_start);
+  volatile uint64_t sum = 0;
+  for (int i=0; i < 100000; ++i) sum += i;
+  uint64_t cycles, instructions;
+  hw.read(cycles, instructions);
+  EXPECT_GT(cycles, cycles_start);
+  EXPECT_GT(instructions, instructions_start);
+}
+
+TEST(mpi_counters_test, PhaseReport) { // NOLINT
+  int nranks;
+  MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+  int size = 2*nranks;
+
+  const char* args[] = {"test", "--", "--phase-report"};
+  auto dc = allocate_context(MPI_COMM_WORLD, 3, const_cast<char**>(args));
+
+  auto c = dc->make_collection<int>(size);
+  auto phase = dc->make_phase(size);
+
+  std::tie(c) = dc->create_phase_work<spin_task>(phase, std::move(c));
+
+  if (dc->is_root()){
+    using times = MpiBackend::PhaseTimes;
+    auto& report = dc->last_phase_report();
+    //the two lightest indices are on rank 0, the two heaviest on the last rank
+    EXPECT_GE(report.min[times::Compute], 3*g_spin_ns);
+    EXPECT_GE(report.max[times::Compute], (4*nranks - 1)*g_spin_ns);
+    EXPECT_GE(report.total[times::Compute], size*(size + 1)/2*g_spin_ns);
+    for (int i=0; i < times::NumCategories; ++i){
+      EXPECT_LE(report.min[i], report.max[i]);
+      EXPECT_LE(report.max[i], report.total[i]);
+    }
+  }
+
+  dc->flush();
+}
@@ -0,0 +1,73 @@
+#include <gtest/gtest.h>
+#include <mpi_backend.h>
+
+using Context = Frontend<MpiBackend>;
+
+struct Sink {
+  int received = 0;
+};
+
+//the number of bursts unpacked on this rank
+static long g_unpacked = 0;
+
+struct Burst {
+  template <class Archive>
+  static void pack(Sink& s, Archive& ar, std::vector<char>& payload){
+    ar | payload;
+  }
+
+  template <class Archive>
+  static void compute_size(Sink& s, Archive& ar, std::vector<char>& payload){
+    pack(s, ar, payload);
+  }
+
+  template <class Archive>
+  static void unpack(Context* ctx, async_ref_ii<Sink> s, Archive& ar){
+    std::vector<char> payload;
+    ar | payload;
+    ++s->received;
+    ++g_unpacked;
+  }
+};
+
+static const int burst_count = 200;
+static const int burst_bytes = 256;
+
+struct Flood {
+  void operator()(Context* ctx, int index, int nelems, async_ref_ii<Sink> s){
+    //two elements per rank, so this lands on the next rank
+    int target = (index + 2) % nelems;
+    std::vector<char> payload(burst_bytes);
+    for (int i=0; i < burst_count; ++i){
+      s = ctx->put_task<Burst>(target, std::move(s), payload);
+    }
+  }
+};
+
+static auto burst_task = recv_task_id<Burst,Sink,int>();
+
+//senders must hold bursts back rather than let a rank buffer more than its cap
+TEST(mpi_flow_test, CreditsBoundUnexpectedBytes) { // NOLINT
+  int nranks;
+  MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+  int nelems = 2*nranks;
+
+  const char* args[] = {"test", "--", "--unexpected-mem-cap", "0.01"};
+  auto dc = allocate_context(MPI_COMM_WORLD, 4, const_cast<char**>(args));
+  auto sinks = dc->make_collection<Sink>(nelems);
+  auto phase = dc->make_phase(nelems);
+
+  g_unpacked = 0;
+  std::tie(sinks) = dc->create_phase_idempotent_work<Flood>(phase, nelems, std::move(sinks));
+  EXPECT_EQ(g_unpacked, 2*burst_count);
+
+  uint64_t cap = uint64_t(0.01 * 1024 * 1024);
+  EXPECT_LE(dc->peak_unexpected_bytes(), cap);
+  if (nranks > 1){
+    //each rank sends far more than the cap to its neighbor
+    EXPECT_GT(dc->num_held_sends(), 0);
+    EXPECT_GT(dc->peak_unexpected_bytes(), 0);
+  }
+
+  dc->flush();
+}
@@ -50,8 +50,9 @@ TEST(mpi_gather_test, GatherAsyncRef) { // NOLINT
   
   const auto &v = *retref;
   
-  if (rank == 0)
+  if (rank == 0) {
     EXPECT_TRUE(std::equal(element_vector.begin(), element_vector.end(), v.begin(), v.end()));
+  }
 }
 
 const
@@ -148,3 +149,114 @@ TEST(mpi_gather_test, GatherFrontendComplexSerialization)
   dc->flush();
   
 }
+
+TEST(mpi_gather_test, GatherInternalChunked) { // NOLINT
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  int size;
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+  std::vector<int> mine(rank + 2, rank);
+  auto buff = darma_backend::serializer::serialize(mine);
+
+  // A tiny max count forces the chunked path used for totals beyond int counts,
+  // with or without MPI_Gatherv_c
+  auto whole = darma_backend::detail::gather_internal(buff, 0);
+  auto chunked = darma_backend::detail::gather_internal(buff, 0, MPI_COMM_WORLD, 5);
+
+  if (rank == 0) {
+    ASSERT_EQ(whole.capacity(), chunked.capacity());
+    EXPECT_EQ(0, ::memcmp(whole.data(), chunked.data(), whole.capacity()));
+  }
+}
+
+TEST(mpi_gather_test, GatherIndexOrder) { // NOLINT
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  int nranks;
+  MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+
+  // Deal the elements out round robin so rank order is not index order
+  collection<int, int> coll(static_cast< int >(g_element_vector.size()));
+  for (int i = rank; i < static_cast< int >(g_element_vector.size()); i += nranks) {
+    coll.setElement(i, std::make_shared< int >( g_element_vector[i] ));
+  }
+
+  auto ref = async_ref<collection<int, int>, ReadOnly, None>::make(std::move(coll));
+  auto retref = darma_backend::gather(std::move(ref), 0);
+
+  if (rank == 0) {
+    EXPECT_EQ(*retref, g_element_vector);
+  }
+}
+
+TEST(mpi_gather_test, GatherStream) { // NOLINT
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  int nranks;
+  MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+
+  collection<int, int> coll(static_cast< int >(g_element_vector.size()));
+  for (int i = rank; i < static_cast< int >(g_element_vector.size()); i += nranks) {
+    coll.setElement(i, std::make_shared< int >( g_element_vector[i] ));
+  }
+
+  auto ref = async_ref<collection<int, int>, ReadOnly, None>::make(std::move(coll));
+
+  std::vector<int> streamed(g_element_vector.size(), -1);
+  int count = 0;
+  darma_backend::gather_stream(std::move(ref), 0, [&](int idx, int&& val){
+    streamed[idx] = val;
+    ++count;
+  });
+
+  if (rank == 0) {
+    EXPECT_EQ(count, static_cast< int >(g_element_vector.size()));
+    EXPECT_EQ(streamed, g_element_vector);
+  } else {
+    EXPECT_EQ(count, 0);
+  }
+}
+
+static int stream_value(int index) {
+  return 7 * index + 3;
+}
+
+struct init_stream_work
+{
+  void operator()(Frontend<MpiBackend> *ctx, int index,
+                  async_ref< int, Modify, Modify > ref)
+  {
+    *ref = stream_value(index);
+  }
+};
+
+TEST(mpi_gather_test, GatherStreamFrontend) // NOLINT
+{
+  int nranks;
+  MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+  // Collections must divide evenly over the ranks, so size by the rank count
+  int nelems = 2 * nranks;
+
+  auto dc = allocate_context(MPI_COMM_WORLD, 0, nullptr);
+
+  auto c = dc->make_collection<int>(nelems);
+  auto phase = dc->make_phase(nelems);
+
+  std::tie(c) = dc->create_phase_work<init_stream_work>(phase, std::move(c));
+
+  std::vector<int> streamed(nelems, -1);
+  dc->phase_gather_stream(phase, 0, std::move(c), [&](int idx, int&& val){
+    streamed[idx] = val;
+  });
+
+  if ( dc->is_root() ) {
+    std::vector<int> expected(nelems);
+    for (int i = 0; i < nelems; ++i) {
+      expected[i] = stream_value(i);
+    }
+    EXPECT_EQ(streamed, expected);
+  }
+
+  dc->flush();
+}
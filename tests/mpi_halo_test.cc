@@ -0,0 +1,107 @@
+#include <gtest/gtest.h>
+#include <mpi_backend.h>
+#include <array>
+
+using Context = Frontend<MpiBackend>;
+
+struct Cell {
+  int index = -1;
+  int nelems = 0;
+  int step = 0;
+  //the index and step of the neighbors, as received
+  std::array<int,2> left = {{-1, -1}};
+  std::array<int,2> right = {{-1, -1}};
+};
+
+struct Ring {
+  int nelems;
+
+  std::array<int,2> operator()(int index) const {
+    return {{(index - 1 + nelems) % nelems, (index + 1) % nelems}};
+  }
+};
+
+struct Edge {
+  template <class Archive>
+  static void pack(Cell& c, int local, int remote, Archive& ar){
+    ar | c.index;
+    ar | c.step;
+  }
+
+  template <class Archive>
+  static void compute_size(Cell& c, int local, int remote, Archive& ar){
+    pack(c, local, remote, ar);
+  }
+
+  template <class Archive>
+  static void unpack(Cell& c, int local, int remote, Archive& ar){
+    std::array<int,2>& from = remote == (local + 1) % c.nelems ? c.right : c.left;
+    ar | from[0];
+    ar | from[1];
+  }
+};
+
+struct MoveCell {
+  template <class Archive>
+  static void pack(Cell& c, Archive& ar){
+    ar | c.index;
+    ar | c.step;
+  }
+
+  template <class Archive>
+  static void unpack(Cell& c, Archive& ar){
+    pack(c, ar);
+  }
+
+  template <class Archive>
+  static void compute_size(Cell& c, Archive& ar){
+    pack(c, ar);
+  }
+};
+
+struct Step {
+  void operator()(Context* ctx, int index, int nelems, async_ref_mm<Cell> c){
+    c->index = index;
+    c->nelems = nelems;
+    ++c->step;
+  }
+};
+
+//cells that did not get both neighbors' current step
+static long g_stale = 0;
+
+struct CheckHalo {
+  void operator()(Context* ctx, int index, int nelems, async_ref_mm<Cell> c){
+    Ring ring{nelems};
+    auto nbrs = ring(index);
+    if (c->left[0] != nbrs[0] || c->left[1] != c->step) ++g_stale;
+    else if (c->right[0] != nbrs[1] || c->right[1] != c->step) ++g_stale;
+  }
+};
+
+TEST(mpi_halo_test, RingExchangeAcrossRebalance) { // NOLINT
+  int nranks;
+  MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+  int nelems = 4*nranks;
+  Ring ring{nelems};
+
+  const char* args[] = {"test", "--", "--lb", "debug"};
+  auto dc = allocate_context(MPI_COMM_WORLD, 4, const_cast<char**>(args));
+  auto cells = dc->make_collection<Cell>(nelems);
+  auto phase = dc->make_phase(nelems);
+  g_stale = 0;
+  //the second exchange reuses the graph, the third follows the migrations
+  for (int iter=0; iter < 3; ++iter){
+    if (iter == 2){
+      dc->rebalance(phase);
+      cells = dc->rebalance<MoveCell>(phase, std::move(cells));
+    }
+    std::tie(cells) = dc->create_phase_work<Step>(phase, nelems, std::move(cells));
+    cells = dc->exchange<Edge>(phase, std::move(cells), ring);
+    std::tie(cells) = dc->create_phase_work<CheckHalo>(phase, nelems, std::move(cells));
+  }
+  dc->flush();
+
+  MPI_Allreduce(MPI_IN_PLACE, &g_stale, 1, MPI_LONG, MPI_SUM, MPI_COMM_WORLD);
+  EXPECT_EQ(g_stale, 0);
+}
@@ -0,0 +1,118 @@
+#include <gtest/gtest.h>
+#include <mpi_backend.h>
+#include <hierarchy.h>
+#include <gather.h>
+#include <broadcast.h>
+
+//emulate nodes of two ranks so that oversubscribed runs exercise the leader step
+static const int g_ranks_per_node = 2;
+
+TEST(mpi_hierarchy_test, Topology) { // NOLINT
+  darma_backend::node_topology topo(MPI_COMM_WORLD, g_ranks_per_node);
+
+  int rank, nranks;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+
+  EXPECT_EQ(topo.rank, rank);
+  EXPECT_EQ(topo.size, nranks);
+  EXPECT_LE(topo.node_size, g_ranks_per_node);
+  EXPECT_EQ(topo.node_of_rank[rank], topo.node_id);
+  EXPECT_EQ(topo.node_rank_of[rank], topo.node_rank);
+
+  int total = 0;
+  for (int n : topo.node_sizes) total += n;
+  EXPECT_EQ(total, nranks);
+
+  std::vector<int> sorted = topo.node_order;
+  std::sort(sorted.begin(), sorted.end());
+  for (int r=0; r < nranks; ++r){
+    EXPECT_EQ(sorted[r], r);
+  }
+}
+
+TEST(mpi_hierarchy_test, Allreduce) { // NOLINT
+  darma_backend::node_topology topo(MPI_COMM_WORLD, g_ranks_per_node);
+
+  int rank, nranks;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+
+  //run twice to make sure the shared scratch space is reusable
+  for (int iter=0; iter < 2; ++iter){
+    std::vector<long> vals = {rank + 1L, 2L*rank, iter + 0L};
+    darma_backend::allreduce(vals.data(), 3, MPI_LONG, MPI_SUM, topo);
+    EXPECT_EQ(vals[0], nranks*(nranks+1L)/2);
+    EXPECT_EQ(vals[1], nranks*(nranks-1L));
+    EXPECT_EQ(vals[2], iter*long(nranks));
+
+    double max = rank;
+    darma_backend::allreduce(&max, 1, MPI_DOUBLE, MPI_MAX, topo);
+    EXPECT_EQ(max, nranks - 1);
+  }
+}
+
+TEST(mpi_hierarchy_test, GatherInternal) { // NOLINT
+  darma_backend::node_topology topo(MPI_COMM_WORLD, g_ranks_per_node);
+
+  int rank, nranks;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+
+  //give every rank a different sized contribution
+  std::vector<int> mine(rank + 1, rank);
+  auto buff = darma_backend::serializer::serialize(mine);
+
+  for (int root=0; root < nranks; ++root){
+    auto flat = darma_backend::detail::gather_internal(buff, root, MPI_COMM_WORLD);
+    auto hier = darma_backend::detail::gather_internal(buff, root, topo);
+    if (rank == root){
+      ASSERT_EQ(flat.capacity(), hier.capacity());
+      EXPECT_EQ(0, ::memcmp(flat.data(), hier.data(), flat.capacity()));
+    }
+  }
+}
+
+TEST(mpi_hierarchy_test, BroadcastInternal) { // NOLINT
+  darma_backend::node_topology topo(MPI_COMM_WORLD, g_ranks_per_node);
+
+  int rank, nranks;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+
+  for (int root=0; root < nranks; ++root){
+    const std::vector<int> element_vector = {root, 9, 3, 7};
+    auto buff = rank == root
+      ? darma_backend::serializer::serialize(element_vector)
+      : darma_backend::serialization_buffer{sizeof(std::size_t) + element_vector.size() * sizeof(int)};
+
+    darma_backend::detail::broadcast_internal(buff, root, topo);
+
+    auto retvec = darma_backend::serializer::deserialize<std::vector<int>>(buff);
+    EXPECT_EQ(retvec, element_vector);
+  }
+}
+
+TEST(mpi_hierarchy_test, GatherAsyncRef) { // NOLINT
+  darma_backend::node_topology topo(MPI_COMM_WORLD, g_ranks_per_node);
+
+  std::vector<int> element_vector = {5, 9, 3, 7, 11, 2, 1, 20};
+  collection<int, int> coll(static_cast< int >(element_vector.size()));
+
+  int rank, nranks;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+
+  int start, end;
+  std::tie(start, end) = detail::range_for_rank(rank, nranks, 0, static_cast<int>(element_vector.size()));
+  for (int i = start; i < end; ++i) {
+    coll.setElement(i, std::make_shared< int >( element_vector[i] ));
+  }
+
+  auto ref = async_ref<collection<int, int>, ReadOnly, None>::make(std::move(coll));
+  auto retref = darma_backend::gather(std::move(ref), 0, topo);
+
+  if (rank == 0) {
+    EXPECT_EQ(*retref, element_vector);
+  }
+}
@@ -0,0 +1,151 @@
+#include <gtest/gtest.h>
+#include <mpi_backend.h>
+#include <cstdlib>
+
+using Context = Frontend<MpiBackend>;
+
+struct Block {
+  int index = -1;
+  std::vector<char> data;
+};
+
+static char pattern(int index, uint64_t i){
+  return char((i*131 + index) & 0x7f);
+}
+
+//element 0 holds first_bytes, the others a few KB each
+static uint64_t block_bytes(int index, uint64_t first_bytes){
+  return index == 0 ? first_bytes : 4000 + 13*index;
+}
+
+struct FillBlock {
+  void operator()(Context* ctx, int index, uint64_t first_bytes, async_ref_mm<Block> b){
+    b->index = index;
+    b->data.resize(block_bytes(index, first_bytes));
+    for (uint64_t i=0; i < b->data.size(); ++i) b->data[i] = pattern(index, i);
+  }
+};
+
+//the number of blocks whose contents did not survive
+static long g_corrupt = 0;
+
+struct CheckBlock {
+  void operator()(Context* ctx, int index, uint64_t first_bytes, async_ref_mm<Block> b){
+    bool ok = b->index == index && b->data.size() == block_bytes(index, first_bytes);
+    //prime stride, so a huge block checks quickly but not only chunk boundaries
+    for (uint64_t i=0; ok && i < b->data.size(); i += 4093){
+      ok = b->data[i] == pattern(index, i);
+    }
+    if (ok && !b->data.empty()){
+      uint64_t last = b->data.size() - 1;
+      ok = b->data[last] == pattern(index, last);
+    }
+    if (!ok) ++g_corrupt;
+  }
+};
+
+struct MigrateBlock {
+  template <class Archive>
+  static void pack(Block& b, Archive& ar){
+    ar | b.index;
+    ar | b.data;
+  }
+
+  template <class Archive>
+  static void unpack(Block& b, Archive& ar){
+    pack(b, ar);
+  }
+
+  template <class Archive>
+  static void compute_size(Block& b, Archive& ar){
+    pack(b, ar);
+  }
+};
+
+//an active message bigger than the message chunk, filled for its target
+struct Payload {
+  template <class Archive>
+  static void pack(Block& b, Archive& ar, std::vector<char>& bytes){
+    ar | bytes;
+  }
+
+  template <class Archive>
+  static void compute_size(Block& b, Archive& ar, std::vector<char>& bytes){
+    pack(b, ar, bytes);
+  }
+
+  template <class Archive>
+  static void unpack(Context* ctx, async_ref_ii<Block> b, Archive& ar){
+    std::vector<char> bytes;
+    ar | bytes;
+    bool ok = bytes.size() == 5003;
+    for (uint64_t i=0; ok && i < bytes.size(); ++i){
+      ok = bytes[i] == pattern(b->index, i);
+    }
+    if (!ok) ++g_corrupt;
+  }
+};
+
+struct SendPayload {
+  void operator()(Context* ctx, int index, int nelems, async_ref_ii<Block> b){
+    int target = (index + 2) % nelems;
+    std::vector<char> bytes(5003);
+    for (uint64_t i=0; i < bytes.size(); ++i) bytes[i] = pattern(target, i);
+    ctx->put_task<Payload>(target, std::move(b), bytes);
+  }
+};
+
+static auto payload_task = recv_task_id<Payload,Block,int>();
+
+/**
+ * Fill the blocks, let the debug balancer swap one element between partner
+ * ranks, and check every block afterwards
+ */
+static void migrate_and_check(Context* dc, int nelems, uint64_t first_bytes){
+  auto blocks = dc->make_collection<Block>(nelems);
+  auto phase = dc->make_phase(nelems);
+  std::tie(blocks) = dc->create_phase_work<FillBlock>(phase, first_bytes, std::move(blocks));
+  dc->rebalance(phase);
+  blocks = dc->rebalance<MigrateBlock>(phase, std::move(blocks));
+  g_corrupt = 0;
+  std::tie(blocks) = dc->create_phase_work<CheckBlock>(phase, first_bytes, std::move(blocks));
+  dc->flush();
+  EXPECT_EQ(g_corrupt, 0);
+}
+
+//a tiny chunk sends every migration and message through the derived types
+TEST(mpi_large_message_test, ChunkedTransfers) { // NOLINT
+  int nranks;
+  MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+  int nelems = 2*nranks;
+
+  const char* args[] = {"test", "--", "--lb", "debug", "--message-chunk", "1000"};
+  auto dc = allocate_context(MPI_COMM_WORLD, 6, const_cast<char**>(args));
+  migrate_and_check(dc.get(), nelems, 12345);
+
+  auto blocks = dc->make_collection<Block>(nelems);
+  auto phase = dc->make_phase(nelems);
+  std::tie(blocks) = dc->create_phase_work<FillBlock>(phase, uint64_t(100), std::move(blocks));
+  g_corrupt = 0;
+  std::tie(blocks) = dc->create_phase_idempotent_work<SendPayload>(phase, nelems, std::move(blocks));
+  EXPECT_EQ(g_corrupt, 0);
+
+  dc->flush();
+}
+
+/**
+ * An element beyond what an int count can describe. This needs about 8 GiB
+ * between the two ranks, so it only runs with DARMA_TEST_LARGE_MESSAGES set.
+ */
+TEST(mpi_large_message_test, MigratesBeyondTwoGiB) { // NOLINT
+  int nranks;
+  MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+  if (nranks != 2 || !std::getenv("DARMA_TEST_LARGE_MESSAGES")){
+    GTEST_SKIP();
+  }
+
+  const char* args[] = {"test", "--", "--lb", "debug"};
+  auto dc = allocate_context(MPI_COMM_WORLD, 4, const_cast<char**>(args));
+  //one element per rank, so the big one trades places with the small one
+  migrate_and_check(dc.get(), 2, (uint64_t(2) << 30) + 4097);
+}
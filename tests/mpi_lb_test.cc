@@ -0,0 +1,457 @@
+#include <gtest/gtest.h>
+#include <mpi_backend.h>
+#include <algorithm>
+
+//every balancer must hand back exactly the elements it was given, each on one rank
+static void check_conserved(MpiBackend& be, int per_rank){
+  int rank, nranks;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+
+  std::vector<MpiBackend::pair64> config;
+  for (int i=0; i < per_rank; ++i){
+    uint64_t idx = uint64_t(rank)*per_rank + i;
+    config.emplace_back(1000*(idx + 1), idx);
+  }
+
+  auto newConfig = be.balance(std::move(config));
+
+  //no early return before the allreduce, or the other ranks would hang in it
+  std::vector<int> owned(nranks*per_rank, 0);
+  for (auto& pair : newConfig){
+    EXPECT_LT(pair.second, owned.size());
+    if (pair.second < owned.size()){
+      owned[pair.second] += 1;
+    }
+  }
+  MPI_Allreduce(MPI_IN_PLACE, owned.data(), owned.size(), MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+  for (int count : owned){
+    EXPECT_EQ(count, 1);
+  }
+}
+
+TEST(mpi_lb_test, Conserved) { // NOLINT
+  auto dc = allocate_context(MPI_COMM_WORLD, 0, nullptr);
+  for (auto& lb : MpiBackend::load_balancers()){
+    SCOPED_TRACE(lb);
+    dc->set_load_balancer(lb);
+    check_conserved(*dc, 8);
+  }
+}
+
+//the offline replay must put every element where the distributed balancer does
+TEST(mpi_lb_test, MatchesSimulator) { // NOLINT
+  int rank, nranks;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+  const int per_rank = 8;
+
+  darma_backend::lb::rank_configs configs(nranks);
+  for (uint64_t idx=0; idx < nranks*per_rank; ++idx){
+    configs[idx / per_rank].emplace_back(1000*((idx*7919) % 13 + 1), idx);
+  }
+
+  auto dc = allocate_context(MPI_COMM_WORLD, 0, nullptr);
+  for (std::string lb : {"commsplit", "hypercube", "debug"}){
+    SCOPED_TRACE(lb);
+    dc->set_load_balancer(lb);
+    auto newConfig = dc->balance(std::vector<MpiBackend::pair64>(configs[rank]));
+
+    darma_backend::lb::comm_split_params params;
+    auto expected = lb == "commsplit" ? darma_backend::lb::simulate_comm_split(configs, params)
+                  : lb == "hypercube" ? darma_backend::lb::simulate_hypercube(configs, params)
+                  : darma_backend::lb::simulate_debug(configs);
+
+    std::vector<uint64_t> mine, theirs;
+    for (auto& pair : newConfig) mine.push_back(pair.second);
+    for (auto& pair : expected[rank]) theirs.push_back(pair.second);
+    std::sort(mine.begin(), mine.end());
+    std::sort(theirs.begin(), theirs.end());
+    EXPECT_EQ(mine, theirs);
+  }
+}
+
+//swaps alone cannot move work off a rank when the others hold nothing,
+//dimension exchange spreads it in one sweep over the log2(P) dimensions
+TEST(mpi_lb_test, HypercubeSpreadsSkewedLoad) { // NOLINT
+  using namespace darma_backend::lb;
+  const int nranks = 16;
+  rank_configs configs(nranks);
+  for (uint64_t idx=0; idx < 4*nranks; ++idx){
+    configs[0].emplace_back(1000*((idx*7919) % 13 + 1), idx);
+  }
+
+  comm_split_params params;
+  params.maxNumTries = 1;
+  auto balanced = simulate_hypercube(configs, params);
+
+  uint64_t maxWork = 0, totalWork = 0, numElems = 0;
+  for (auto& config : balanced){
+    uint64_t work = 0;
+    for (auto& pair : config) work += pair.first;
+    maxWork = std::max(maxWork, work);
+    totalWork += work;
+    numElems += config.size();
+    EXPECT_FALSE(config.empty());
+  }
+  EXPECT_EQ(numElems, 4*nranks);
+  EXPECT_LT(maxWork, 1.5 * totalWork / nranks);
+}
+
+TEST(mpi_lb_test, LoadModels) { // NOLINT
+  using namespace darma_backend::lb;
+  load_model_params params;
+  load_history hist;
+  EXPECT_EQ(predict_load(hist, params), 0);
+
+  //a steady ramp with one outlier
+  uint64_t loads[] = {100, 200, 300, 10000, 500, 600};
+  for (uint64_t load : loads) record_load(hist, load, params);
+
+  params.type = LastPhase;
+  EXPECT_EQ(predict_load(hist, params), 600);
+
+  params.type = Median;
+  params.window = 5;
+  EXPECT_EQ(predict_load(hist, params), 500);
+
+  params.type = LinearTrend;
+  params.window = 2;
+  EXPECT_EQ(predict_load(hist, params), 700);
+
+  //a load falling fast enough to extrapolate below zero still has a weight
+  load_history falling;
+  for (uint64_t load : {900, 500, 100}) record_load(falling, load, params);
+  params.window = 3;
+  EXPECT_EQ(predict_load(falling, params), 1);
+
+  load_history smooth;
+  params.type = Ewma;
+  params.alpha = 0.5;
+  record_load(smooth, 100, params);
+  record_load(smooth, 300, params);
+  EXPECT_EQ(predict_load(smooth, params), 200);
+
+  //the ring buffer keeps only the newest samples
+  load_history full;
+  for (uint64_t i=0; i < 2*load_history::capacity; ++i) record_load(full, i, params);
+  EXPECT_EQ(full.count, load_history::capacity);
+  EXPECT_EQ(full.newest(0), 2*load_history::capacity - 1);
+  EXPECT_EQ(full.newest(load_history::capacity - 1), load_history::capacity);
+}
+
+static const uint64_t g_lb_spin_ns = 100000;
+
+struct lb_spin_task
+{
+  void operator()(Frontend<MpiBackend> *ctx, int index,
+                  async_ref< int, Modify, Modify > ref)
+  {
+    uint64_t stop = wall_ns() + (index + 1)*g_lb_spin_ns;
+    while (wall_ns() < stop);
+    *ref = index;
+  }
+};
+
+//the debug balancer moves elements, which must keep the loads they measured
+TEST(mpi_lb_test, HistoryFollowsMigration) { // NOLINT
+  int nranks;
+  MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+  int size = 2*nranks;
+
+  const char* args[] = {"test", "--", "--lb", "debug", "--lb-model", "ewma"};
+  auto dc = allocate_context(MPI_COMM_WORLD, 6, const_cast<char**>(args));
+
+  auto c = dc->make_collection<int>(size);
+  auto phase = dc->make_phase(size);
+  std::tie(c) = dc->create_phase_work<lb_spin_task>(phase, std::move(c));
+  dc->rebalance(phase);
+
+  for (const LocalIndex& lidx : phase->local()){
+    EXPECT_EQ(lidx.history.count, 1);
+    EXPECT_GE(lidx.history.newest(0), (lidx.index + 1)*g_lb_spin_ns);
+    EXPECT_EQ(lidx.counters.wallNs, 0);
+  }
+
+  dc->flush();
+}
+
+struct lb_falling_task
+{
+  void operator()(Frontend<MpiBackend> *ctx, int index, int step,
+                  async_ref< int, Modify, Modify > ref)
+  {
+    //900, 500 then 100 units, so the trend of the last phases points below zero
+    uint64_t units = 1 + 4*(2 - step);
+    uint64_t stop = wall_ns() + units*(index + 1)*g_lb_spin_ns;
+    while (wall_ns() < stop);
+    *ref = index;
+  }
+};
+
+struct MigrateInt {
+  template <class Archive>
+  static void pack(int& i, Archive& ar){
+    ar | i;
+  }
+
+  template <class Archive>
+  static void unpack(int& i, Archive& ar){
+    ar | i;
+  }
+
+  template <class Archive>
+  static void compute_size(int& i, Archive& ar){
+    ar | i;
+  }
+};
+
+//comm-split must accept the weights a falling trend predicts
+TEST(mpi_lb_test, TrendOfFallingLoads) { // NOLINT
+  int nranks;
+  MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+  int size = 2*nranks;
+
+  const char* args[] = {"test", "--", "--lb", "commsplit", "--lb-model", "trend"};
+  auto dc = allocate_context(MPI_COMM_WORLD, 6, const_cast<char**>(args));
+
+  auto c = dc->make_collection<int>(size);
+  auto phase = dc->make_phase(size);
+  for (int step=0; step < 3; ++step){
+    std::tie(c) = dc->create_phase_work<lb_falling_task>(phase, step, std::move(c));
+    dc->rebalance(phase);
+    c = dc->rebalance<MigrateInt>(phase, std::move(c));
+  }
+
+  int owned = phase->local().size();
+  MPI_Allreduce(MPI_IN_PLACE, &owned, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+  EXPECT_EQ(owned, size);
+
+  dc->flush();
+}
+
+TEST(mpi_lb_test, AutoPaysOff) { // NOLINT
+  darma_backend::lb::auto_lb_params params;
+  params.horizon = 10;
+  EXPECT_TRUE(darma_backend::lb::auto_lb_pays_off(params, 2000, 1000, 5000));
+  EXPECT_FALSE(darma_backend::lb::auto_lb_pays_off(params, 2000, 1000, 20000));
+  EXPECT_FALSE(darma_backend::lb::auto_lb_pays_off(params, 1000, 1000, 0));
+  EXPECT_FALSE(darma_backend::lb::auto_lb_pays_off(params, 1000, 1200, 0));
+}
+
+struct lb_even_task
+{
+  void operator()(Frontend<MpiBackend> *ctx, int index,
+                  async_ref< int, Modify, Modify > ref)
+  {
+    uint64_t stop = wall_ns() + g_lb_spin_ns;
+    while (wall_ns() < stop);
+    *ref = index;
+  }
+};
+
+//an even load must not be balanced, even by the debug balancer that always moves elements
+TEST(mpi_lb_test, AutoSkipsBalanced) { // NOLINT
+  int nranks;
+  MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+  int size = 2*nranks;
+
+  const char* args[] = {"test", "--", "--lb", "debug", "--lb-auto", "--lb-auto-threshold", "2"};
+  auto dc = allocate_context(MPI_COMM_WORLD, 7, const_cast<char**>(args));
+
+  auto c = dc->make_collection<int>(size);
+  auto phase = dc->make_phase(size);
+  std::vector<IndexInfo> before = phase.mapping();
+  std::tie(c) = dc->create_phase_work<lb_even_task>(phase, std::move(c));
+  EXPECT_FALSE(dc->rebalance(phase));
+
+  ASSERT_EQ(phase.mapping().size(), before.size());
+  for (int i=0; i < size; ++i){
+    EXPECT_EQ(phase.mapping()[i].rank, before[i].rank);
+  }
+  for (const LocalIndex& lidx : phase->local()){
+    EXPECT_EQ(lidx.history.count, 1);
+    EXPECT_EQ(lidx.counters.wallNs, 0);
+  }
+
+  dc->flush();
+}
+
+struct lb_skewed_task
+{
+  void operator()(Frontend<MpiBackend> *ctx, int index,
+                  async_ref< int, Modify, Modify > ref)
+  {
+    //the elements that start on rank 0 do sixteen times the work of the others
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    uint64_t units = rank == 0 ? 16 : 1;
+    uint64_t stop = wall_ns() + units*g_lb_spin_ns;
+    while (wall_ns() < stop);
+    *ref = index;
+  }
+};
+
+//elements that kept their value through the migration
+static int g_lb_intact = 0;
+
+struct lb_check_task
+{
+  void operator()(Frontend<MpiBackend> *ctx, int index,
+                  async_ref< int, Modify, Modify > ref)
+  {
+    if (*ref == index) ++g_lb_intact;
+  }
+};
+
+//a skewed load must pass the threshold, and the migration must keep every element and its load
+TEST(mpi_lb_test, AutoBalancesSkewed) { // NOLINT
+  int nranks;
+  MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+  if (nranks < 2){
+    //a single rank is never imbalanced
+    GTEST_SKIP();
+  }
+  int size = 2*nranks;
+
+  const char* args[] = {"test", "--", "--lb", "commsplit", "--lb-model", "ewma",
+                        "--lb-auto", "--lb-auto-threshold", "1.5"};
+  auto dc = allocate_context(MPI_COMM_WORLD, 9, const_cast<char**>(args));
+
+  auto c = dc->make_collection<int>(size);
+  auto phase = dc->make_phase(size);
+  std::vector<IndexInfo> before = phase.mapping();
+  std::tie(c) = dc->create_phase_work<lb_skewed_task>(phase, std::move(c));
+  dc->flush();
+
+  uint64_t work[2] = {0, 0};
+  for (const LocalIndex& lidx : phase->local()){
+    work[0] += lidx.counters.wallNs;
+  }
+
+  EXPECT_TRUE(dc->rebalance(phase));
+  c = dc->rebalance<MigrateInt>(phase, std::move(c));
+
+  int moved = 0;
+  for (int i=0; i < size; ++i){
+    if (phase.mapping()[i].rank != before[i].rank) ++moved;
+  }
+  EXPECT_GT(moved, 0);
+
+  //the measured loads travel with the elements, so none is lost or counted twice
+  int owned = phase->local().size();
+  for (const LocalIndex& lidx : phase->local()){
+    EXPECT_EQ(lidx.history.count, 1);
+    work[1] += lidx.history.newest(0);
+  }
+  MPI_Allreduce(MPI_IN_PLACE, work, 2, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+  MPI_Allreduce(MPI_IN_PLACE, &owned, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+  EXPECT_EQ(owned, size);
+  EXPECT_EQ(work[1], work[0]);
+
+  g_lb_intact = 0;
+  std::tie(c) = dc->create_phase_work<lb_check_task>(phase, std::move(c));
+  dc->flush();
+  MPI_Allreduce(MPI_IN_PLACE, &g_lb_intact, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+  EXPECT_EQ(g_lb_intact, size);
+}
+
+//trades must never push a rank's element memory past the cap
+TEST(mpi_lb_test, MemoryCap) { // NOLINT
+  int rank, nranks;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+  const int per_rank = 8;
+
+  //heavy elements are big and all start on rank 0
+  darma_backend::lb::rank_configs configs(nranks);
+  darma_backend::lb::object_sizes sizes;
+  uint64_t totalBytes = 0;
+  for (uint64_t idx=0; idx < nranks*per_rank; ++idx){
+    int owner = idx / per_rank;
+    uint64_t w = 1000*((idx*7919) % 13 + 1) * (owner == 0 ? 4 : 1);
+    configs[owner].emplace_back(w, idx);
+    sizes[idx] = w;
+    totalBytes += w;
+  }
+
+  darma_backend::lb::comm_split_params params;
+  params.memoryCap = totalBytes / nranks;
+
+  auto dc = allocate_context(MPI_COMM_WORLD, 0, nullptr);
+  dc->set_load_balancer("commsplit");
+  dc->set_comm_split_params(params);
+  auto newConfig = dc->balance(std::vector<MpiBackend::pair64>(configs[rank]), sizes);
+
+  uint64_t bytesBefore = 0, bytesAfter = 0;
+  for (auto& pair : configs[rank]) bytesBefore += sizes[pair.second];
+  for (auto& pair : newConfig) bytesAfter += sizes[pair.second];
+  EXPECT_LE(bytesAfter, std::max(bytesBefore, params.memoryCap));
+
+  auto expected = darma_backend::lb::simulate_comm_split(configs, params, sizes);
+  std::vector<uint64_t> mine, theirs;
+  for (auto& pair : newConfig) mine.push_back(pair.second);
+  for (auto& pair : expected[rank]) theirs.push_back(pair.second);
+  std::sort(mine.begin(), mine.end());
+  std::sort(theirs.begin(), theirs.end());
+  EXPECT_EQ(mine, theirs);
+}
+
+TEST(mpi_lb_test, PreferSmallObjects) { // NOLINT
+  using namespace darma_backend::lb;
+  std::vector<pair64> config = {{100, 0}, {1000, 1}, {1010, 2}, {1020, 3}, {5000, 4}};
+  object_sizes sizes = {{0, 10}, {1, 500}, {2, 50}, {3, 5}, {4, 10}};
+
+  //1020 is within 5% of 1000 and the smallest of the similar elements
+  std::vector<int> chosen = {1};
+  prefer_small_objects(config, chosen, sizes, 0.05);
+  EXPECT_EQ(chosen, std::vector<int>({3}));
+
+  //an element already chosen is never picked twice
+  chosen = {1, 3};
+  prefer_small_objects(config, chosen, sizes, 0.05);
+  EXPECT_EQ(chosen, std::vector<int>({2, 3}));
+
+  //nothing is close enough to the outliers
+  chosen = {0, 4};
+  prefer_small_objects(config, chosen, sizes, 0.05);
+  EXPECT_EQ(chosen, std::vector<int>({0, 4}));
+}
+
+//with equally loaded nodes, the hierarchical balancer must only trade inside a node
+TEST(mpi_lb_test, HierarchicalStaysOnNode) { // NOLINT
+  int rank, nranks;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+  if (nranks % 2 != 0){
+    GTEST_SKIP();
+  }
+  const int per_rank = 8;
+
+  const char* args[] = {"test", "--", "--lb", "hierarchical", "--ranks-per-node", "2"};
+  auto dc = allocate_context(MPI_COMM_WORLD, 6, const_cast<char**>(args));
+
+  //even ranks are heavy, odd ranks light, so every node of two has the same load
+  std::vector<MpiBackend::pair64> config;
+  uint64_t workBefore = 0;
+  for (int i=0; i < per_rank; ++i){
+    uint64_t idx = uint64_t(rank)*per_rank + i;
+    uint64_t w = 1000*(i + 1)*(rank % 2 == 0 ? 4 : 1);
+    config.emplace_back(w, idx);
+    workBefore += w;
+  }
+
+  auto newConfig = dc->balance(std::move(config));
+
+  uint64_t workAfter = 0;
+  for (auto& pair : newConfig){
+    int origin = pair.second / per_rank;
+    EXPECT_EQ(origin / 2, rank / 2);
+    workAfter += pair.first;
+  }
+
+  uint64_t maxBefore, maxAfter;
+  MPI_Allreduce(&workBefore, &maxBefore, 1, MPI_UINT64_T, MPI_MAX, MPI_COMM_WORLD);
+  MPI_Allreduce(&workAfter, &maxAfter, 1, MPI_UINT64_T, MPI_MAX, MPI_COMM_WORLD);
+  EXPECT_LT(maxAfter, maxBefore);
+}
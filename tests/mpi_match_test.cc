@@ -0,0 +1,71 @@
+#include <gtest/gtest.h>
+#include <match_table.h>
+#include <map>
+#include <list>
+#include <random>
+
+struct Msg {
+  int value = 0;
+  Msg* next = nullptr;
+};
+
+using table = darma_backend::match_table<Msg>;
+
+//the same tag from two sources must never match the other's receive
+TEST(mpi_match_test, SourcesStaySeparate) { // NOLINT
+  table t;
+  Msg* a = t.allocate(); a->value = 1;
+  Msg* b = t.allocate(); b->value = 2;
+  t.push_back(table::key(0, 77), a);
+  t.push_back(table::key(1, 77), b);
+  EXPECT_EQ(t.front(table::key(1, 77))->value, 2);
+  EXPECT_EQ(t.pop_front(table::key(0, 77))->value, 1);
+  EXPECT_EQ(t.front(table::key(0, 77)), nullptr);
+  EXPECT_EQ(t.pop_front(table::key(1, 77))->value, 2);
+  EXPECT_EQ(t.size(), 0);
+  EXPECT_EQ(t.keys(), 0);
+}
+
+//random traffic over many keys must behave like one FIFO queue per key,
+//through growth and through deletions in the middle of probe chains
+TEST(mpi_match_test, MatchesReferenceQueues) { // NOLINT
+  table t(8);
+  std::map<uint64_t,std::list<int>> ref;
+  std::mt19937 gen(11);
+  std::uniform_int_distribution<int> src(0, 15), tag(0, 63), op(0, 2);
+  int counter = 0;
+  for (int i=0; i < 20000; ++i){
+    uint64_t k = table::key(src(gen), tag(gen) << 10);
+    if (op(gen) != 0){
+      Msg* m = t.allocate();
+      m->value = ++counter;
+      t.push_back(k, m);
+      ref[k].push_back(counter);
+    } else {
+      Msg* m = t.pop_front(k);
+      auto iter = ref.find(k);
+      if (iter == ref.end()){
+        EXPECT_EQ(m, nullptr);
+      } else {
+        ASSERT_NE(m, nullptr);
+        EXPECT_EQ(m->value, iter->second.front());
+        iter->second.pop_front();
+        if (iter->second.empty()) ref.erase(iter);
+        t.release(m);
+      }
+    }
+  }
+  EXPECT_EQ(t.keys(), ref.size());
+  size_t queued = 0;
+  for (auto& pair : ref){
+    queued += pair.second.size();
+    for (int value : pair.second){
+      Msg* m = t.pop_front(pair.first);
+      ASSERT_NE(m, nullptr);
+      EXPECT_EQ(m->value, value);
+    }
+    EXPECT_EQ(t.front(pair.first), nullptr);
+  }
+  EXPECT_GT(queued, 0);
+  EXPECT_EQ(t.size(), 0);
+}
@@ -0,0 +1,142 @@
+#include <gtest/gtest.h>
+#include <mpi_backend.h>
+
+using Context = Frontend<MpiBackend>;
+
+//every element sends to the next fanout elements around the ring
+static const int fanout = 3;
+
+struct Node {
+  int index = -1;
+  //what arrived from index - 1 - slot
+  std::vector<int> from;
+  int hits = 0;
+};
+
+//payloads packed and unpacked on this rank
+static long g_packed = 0;
+static long g_unpacked = 0;
+
+static std::vector<int> payload(int index){
+  return std::vector<int>{index, 7*index + 1, -index};
+}
+
+struct Spread {
+  template <class Archive>
+  static void pack(Node& n, int local, Archive& ar){
+    ++g_packed;
+    ar | payload(local);
+  }
+
+  template <class Archive>
+  static void compute_size(Node& n, int local, Archive& ar){
+    ar | payload(local);
+  }
+
+  template <class Archive>
+  static void unpack(Context* ctx, Node& n, Archive& ar, int slot){
+    std::vector<int> data;
+    ar | data;
+    n.from[slot] = data == payload(data[0]) ? data[0] : -2;
+    ++g_unpacked;
+  }
+};
+
+struct SendMany {
+  void operator()(Context* ctx, int index, int nelems, async_ref_mm<Node> n){
+    n->index = index;
+    n->from.assign(fanout, -1);
+    std::vector<int> remotes;
+    for (int k=1; k <= fanout; ++k) remotes.push_back((index + k) % nelems);
+    auto sent = ctx->to_send(std::move(n));
+    sent = ctx->send_many<Spread>(index, remotes, std::move(sent));
+    auto recvd = ctx->to_recv(std::move(sent));
+    for (int k=1; k <= fanout; ++k){
+      recvd = ctx->recv<Spread>(index, (index - k + nelems) % nelems, std::move(recvd), k-1);
+    }
+  }
+};
+
+//elements whose neighbors' payloads did not all arrive intact
+static long g_wrong = 0;
+
+struct CheckFrom {
+  void operator()(Context* ctx, int index, int nelems, async_ref_mm<Node> n){
+    for (int k=1; k <= fanout; ++k){
+      if (n->from[k-1] != (index - k + nelems) % nelems){
+        ++g_wrong;
+        break;
+      }
+    }
+  }
+};
+
+TEST(mpi_multicast_test, SendManyPacksOnce) { // NOLINT
+  int nranks;
+  MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+  int nelems = 4*nranks;
+  auto dc = allocate_context(MPI_COMM_WORLD, 0, nullptr);
+  auto nodes = dc->make_collection<Node>(nelems);
+  auto phase = dc->make_phase(nelems);
+  g_packed = g_unpacked = g_wrong = 0;
+  std::tie(nodes) = dc->create_phase_work<SendMany>(phase, nelems, std::move(nodes));
+  std::tie(nodes) = dc->create_phase_work<CheckFrom>(phase, nelems, std::move(nodes));
+  dc->flush();
+
+  long counts[3] = {g_packed, g_unpacked, g_wrong};
+  MPI_Allreduce(MPI_IN_PLACE, counts, 3, MPI_LONG, MPI_SUM, MPI_COMM_WORLD);
+  EXPECT_EQ(counts[0], nelems);
+  EXPECT_EQ(counts[1], fanout*nelems);
+  EXPECT_EQ(counts[2], 0);
+}
+
+struct Ping {
+  template <class Archive>
+  static void pack(Node& n, Archive& ar, int from){
+    ++g_packed;
+    ar | payload(from);
+  }
+
+  template <class Archive>
+  static void compute_size(Node& n, Archive& ar, int from){
+    ar | payload(from);
+  }
+
+  template <class Archive>
+  static void unpack(Context* ctx, async_ref_ii<Node> n, Archive& ar){
+    std::vector<int> data;
+    ar | data;
+    if (data != payload(data[0])) ++g_wrong;
+    ++n->hits;
+    ++g_unpacked;
+  }
+};
+
+struct PingMany {
+  void operator()(Context* ctx, int index, int nelems, async_ref_ii<Node> n){
+    //targets on this rank and on others alike
+    std::vector<int> targets;
+    for (int k=1; k <= fanout; ++k) targets.push_back((index + k) % nelems);
+    ctx->put_task_many<Ping>(targets, std::move(n), index);
+  }
+};
+
+static auto ping_task = recv_task_id<Ping,Node,int>();
+
+TEST(mpi_multicast_test, PutTaskManyPacksOnce) { // NOLINT
+  int nranks;
+  MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+  int nelems = 4*nranks;
+  auto dc = allocate_context(MPI_COMM_WORLD, 0, nullptr);
+  auto nodes = dc->make_collection<Node>(nelems);
+  auto phase = dc->make_phase(nelems);
+  g_packed = g_unpacked = g_wrong = 0;
+  std::tie(nodes) = dc->create_phase_idempotent_work<PingMany>(phase, nelems, std::move(nodes));
+  dc->flush();
+
+  long counts[3] = {g_packed, g_unpacked, g_wrong};
+  MPI_Allreduce(MPI_IN_PLACE, counts, 3, MPI_LONG, MPI_SUM, MPI_COMM_WORLD);
+  EXPECT_EQ(counts[0], nelems);
+  EXPECT_EQ(counts[1], fanout*nelems);
+  EXPECT_EQ(counts[2], 0);
+}
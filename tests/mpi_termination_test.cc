@@ -0,0 +1,189 @@
+#include <gtest/gtest.h>
+#include <mpi_backend.h>
+
+using Context = Frontend<MpiBackend>;
+
+struct Relay {
+  int index = -1;
+  int nelems = 0;
+  int received = 0;
+};
+
+//the number of relay messages unpacked on this rank
+static long g_relayed = 0;
+
+//forward a message to the right until it has made all its hops
+struct Hop {
+  template <class Archive>
+  static void pack(Relay& r, Archive& ar, int hops){
+    ar | hops;
+  }
+
+  template <class Archive>
+  static void compute_size(Relay& r, Archive& ar, int hops){
+    pack(r, ar, hops);
+  }
+
+  template <class Archive>
+  static void unpack(Context* ctx, async_ref_ii<Relay> r, Archive& ar){
+    int hops;
+    ar | hops;
+    ++r->received;
+    ++g_relayed;
+    if (hops > 1){
+      int right = (r->index + 1) % r->nelems;
+      ctx->put_task<Hop>(right, std::move(r), hops - 1);
+    }
+  }
+};
+
+struct StartRelay {
+  void operator()(Context* ctx, int index, int nelems, async_ref_ii<Relay> r){
+    r->index = index;
+    r->nelems = nelems;
+    int right = (index + 1) % nelems;
+    //chains of different lengths, none of them known to the receivers
+    ctx->put_task<Hop>(right, std::move(r), 1 + index % 7);
+  }
+};
+
+//a message that knows which element it was sent to
+struct Knock {
+  template <class Archive>
+  static void pack(Relay& r, Archive& ar, int target){
+    ar | target;
+  }
+
+  template <class Archive>
+  static void compute_size(Relay& r, Archive& ar, int target){
+    pack(r, ar, target);
+  }
+
+  template <class Archive>
+  static void unpack(Context* ctx, async_ref_ii<Relay> r, Archive& ar){
+    int target;
+    ar | target;
+    EXPECT_EQ(r->index, target);
+    ++r->received;
+    ++g_relayed;
+  }
+};
+
+struct KnockRight {
+  void operator()(Context* ctx, int index, int nelems, async_ref_ii<Relay> r){
+    EXPECT_EQ(r->index, index);
+    int right = (index + 1) % nelems;
+    ctx->put_task<Knock>(right, std::move(r), right);
+  }
+};
+
+struct MigrateRelay {
+  template <class Archive>
+  static void pack(Relay& r, Archive& ar){
+    ar | r.index;
+    ar | r.nelems;
+    ar | r.received;
+  }
+
+  template <class Archive>
+  static void unpack(Relay& r, Archive& ar){
+    pack(r, ar);
+  }
+
+  template <class Archive>
+  static void compute_size(Relay& r, Archive& ar){
+    pack(r, ar);
+  }
+};
+
+static auto hop_task = recv_task_id<Hop,Relay,int>();
+static auto knock_task = recv_task_id<Knock,Relay,int>();
+
+//the phase must not return before every hop of every chain was delivered
+TEST(mpi_termination_test, IdempotentPhaseWaitsForChains) { // NOLINT
+  int nranks;
+  MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+  int nelems = 3*nranks;
+
+  long expectedPerPhase = 0;
+  for (int i=0; i < nelems; ++i) expectedPerPhase += 1 + i % 7;
+
+  auto dc = allocate_context(MPI_COMM_WORLD, 0, nullptr);
+  auto relays = dc->make_collection<Relay>(nelems);
+  auto phase = dc->make_phase(nelems);
+
+  g_relayed = 0;
+  for (int iter=1; iter <= 3; ++iter){
+    std::tie(relays) = dc->create_phase_idempotent_work<StartRelay>(phase, nelems, std::move(relays));
+    long total;
+    MPI_Allreduce(&g_relayed, &total, 1, MPI_LONG, MPI_SUM, MPI_COMM_WORLD);
+    EXPECT_EQ(total, iter*expectedPerPhase);
+  }
+  //every hop between two elements of the same rank skips MPI
+  long expectedLocal = 0;
+  for (int i=0; i < nelems; ++i){
+    for (int k=0; k < 1 + i % 7; ++k){
+      int from = (i + k) % nelems;
+      int to = (from + 1) % nelems;
+      if (phase.mapping()[from].rank == phase.mapping()[to].rank) ++expectedLocal;
+    }
+  }
+  long local = dc->num_local_active();
+  MPI_Allreduce(MPI_IN_PLACE, &local, 1, MPI_LONG, MPI_SUM, MPI_COMM_WORLD);
+  EXPECT_EQ(local, 3*expectedLocal);
+
+  dc->flush();
+}
+
+//migration renumbers the elements of a rank, messages must still find theirs
+TEST(mpi_termination_test, MessagesFollowMigration) { // NOLINT
+  int nranks;
+  MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+  int nelems = 3*nranks;
+
+  const char* args[] = {"test", "--", "--lb", "debug"};
+  auto dc = allocate_context(MPI_COMM_WORLD, 4, const_cast<char**>(args));
+  auto relays = dc->make_collection<Relay>(nelems);
+  auto phase = dc->make_phase(nelems);
+
+  g_relayed = 0;
+  std::tie(relays) = dc->create_phase_idempotent_work<StartRelay>(phase, nelems, std::move(relays));
+  dc->rebalance(phase);
+  relays = dc->rebalance<MigrateRelay>(phase, std::move(relays));
+  std::tie(relays) = dc->create_phase_idempotent_work<KnockRight>(phase, nelems, std::move(relays));
+
+  long total;
+  MPI_Allreduce(&g_relayed, &total, 1, MPI_LONG, MPI_SUM, MPI_COMM_WORLD);
+  long expected = nelems;
+  for (int i=0; i < nelems; ++i) expected += 1 + i % 7;
+  EXPECT_EQ(total, expected);
+
+  dc->flush();
+}
+
+//a collection handed over from MPI must be reachable by put_task like any other
+TEST(mpi_termination_test, PutTaskIntoMpiCollection) { // NOLINT
+  int rank, nranks;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+  int nelems = 3*nranks;
+
+  auto dc = allocate_context(MPI_COMM_WORLD, 0, nullptr);
+  auto phase = dc->make_phase(nelems);
+  auto mpi_relays = dc->make_local_collection<Relay>(nelems);
+  for (int i=0; i < 3; ++i){
+    Relay& r = mpi_relays->emplaceLocal(rank*3 + i);
+    r.index = rank*3 + i;
+    r.nelems = nelems;
+  }
+  auto relays = dc->from_mpi<MigrateRelay>(std::move(mpi_relays));
+
+  g_relayed = 0;
+  std::tie(relays) = dc->create_phase_idempotent_work<KnockRight>(phase, nelems, std::move(relays));
+
+  long total;
+  MPI_Allreduce(&g_relayed, &total, 1, MPI_LONG, MPI_SUM, MPI_COMM_WORLD);
+  EXPECT_EQ(total, nelems);
+
+  dc->flush();
+}
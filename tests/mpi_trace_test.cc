@@ -0,0 +1,51 @@
+#include <gtest/gtest.h>
+#include <mpi_backend.h>
+#include <trace.h>
+#include <cstdio>
+
+TEST(mpi_trace_test, Disabled) { // NOLINT
+  darma_backend::tracer trace;
+  EXPECT_FALSE(trace.enabled());
+
+  //nothing is kept and nothing breaks
+  trace.record(darma_backend::TraceTask, 0, 1);
+  trace.post(3, darma_backend::TraceSend, 1, 2, 3);
+  trace.complete(3);
+}
+
+TEST(mpi_trace_test, RingBuffer) { // NOLINT
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+  darma_backend::tracer trace;
+  trace.enable(4);
+  for (int i=0; i < 6; ++i){
+    trace.record(darma_backend::TraceTask, i, i+1, i);
+  }
+  trace.post(2, darma_backend::TraceSend, 1, 7, 128);
+  //a request that was never posted records nothing
+  trace.complete(1);
+  trace.complete(2);
+
+  std::string path = "mpi_trace_test." + std::to_string(rank) + ".bin";
+  trace.dump(path, rank);
+
+  darma_backend::trace_header header;
+  std::vector<darma_backend::trace_event> events;
+  ASSERT_TRUE(darma_backend::tracer::read(path, header, events));
+  std::remove(path.c_str());
+
+  EXPECT_EQ(header.rank, rank);
+  EXPECT_EQ(header.num_dropped, 3);
+  ASSERT_EQ(events.size(), 4);
+  //the oldest surviving events come first
+  for (int i=0; i < 3; ++i){
+    EXPECT_EQ(events[i].type, darma_backend::TraceTask);
+    EXPECT_EQ(events[i].arg0, i + 3);
+  }
+  EXPECT_EQ(events[3].type, darma_backend::TraceSend);
+  EXPECT_EQ(events[3].arg0, 1);
+  EXPECT_EQ(events[3].arg1, 7);
+  EXPECT_EQ(events[3].arg2, 128);
+  EXPECT_LE(events[3].start, events[3].stop);
+}
@@ -0,0 +1,92 @@
+#include <gtest/gtest.h>
+#include <mpi_backend.h>
+
+using Context = Frontend<MpiBackend>;
+
+static const int grid_rows = 17;
+static const int grid_cols = 8;
+static const int halo_cols = 3;
+
+struct Grid {
+  //row major, the rightmost halo_cols columns go to the right neighbor
+  std::vector<double> cells;
+  std::vector<double> ghost;
+};
+
+static double cell_value(int index, int row, int col){
+  return index * 1000.0 + row * grid_cols + col;
+}
+
+/**
+ * The rightmost columns go straight out of each row of the grid, and land
+ * in the ghost cells of the receiver without being unpacked
+ */
+struct Halo {
+  static void send_regions(Grid& g, int local, int remote, darma_backend::region_list& r){
+    for (int row=0; row < grid_rows; ++row){
+      r.add(&g.cells[row*grid_cols + grid_cols - halo_cols], halo_cols*sizeof(double));
+    }
+  }
+
+  static void recv_regions(Grid& g, int local, int remote, darma_backend::region_list& r){
+    r.add(g.ghost.data(), g.ghost.size()*sizeof(double));
+  }
+};
+
+struct Exchange {
+  void operator()(Context* ctx, int index, int nelems, async_ref_mm<Grid> g){
+    g->cells.resize(grid_rows*grid_cols);
+    g->ghost.assign(grid_rows*halo_cols, -1.0);
+    for (int row=0; row < grid_rows; ++row){
+      for (int col=0; col < grid_cols; ++col){
+        g->cells[row*grid_cols + col] = cell_value(index, row, col);
+      }
+    }
+    int left = (index - 1 + nelems) % nelems;
+    int right = (index + 1) % nelems;
+    auto sent = ctx->to_send(std::move(g));
+    sent = ctx->send<Halo>(index, right, std::move(sent));
+    auto recvd = ctx->to_recv(std::move(sent));
+    recvd = ctx->recv<Halo>(index, left, std::move(recvd));
+  }
+};
+
+//the number of ghost cells that do not hold the left neighbor's columns
+static long g_wrong = 0;
+
+struct CheckGhost {
+  void operator()(Context* ctx, int index, int nelems, async_ref_mm<Grid> g){
+    int left = (index - 1 + nelems) % nelems;
+    for (int row=0; row < grid_rows; ++row){
+      for (int c=0; c < halo_cols; ++c){
+        double expected = cell_value(left, row, grid_cols - halo_cols + c);
+        if (g->ghost[row*halo_cols + c] != expected) ++g_wrong;
+      }
+    }
+  }
+};
+
+static void exchange_and_check(Context* dc){
+  int nranks;
+  MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+  int nelems = 2*nranks;
+  auto grids = dc->make_collection<Grid>(nelems);
+  auto phase = dc->make_phase(nelems);
+  g_wrong = 0;
+  std::tie(grids) = dc->create_phase_work<Exchange>(phase, nelems, std::move(grids));
+  std::tie(grids) = dc->create_phase_work<CheckGhost>(phase, nelems, std::move(grids));
+  dc->flush();
+  EXPECT_EQ(g_wrong, 0);
+}
+
+TEST(mpi_zero_copy_test, HaloFromRegions) { // NOLINT
+  auto dc = allocate_context(MPI_COMM_WORLD, 0, nullptr);
+  exchange_and_check(dc.get());
+}
+
+//a chunk smaller than one row's columns splits every region into blocks
+TEST(mpi_zero_copy_test, HaloFromChunkedRegions) { // NOLINT
+  const char* args[] = {"test", "--", "--message-chunk", "16"};
+  auto dc = allocate_context(MPI_COMM_WORLD, 4, const_cast<char**>(args));
+  exchange_and_check(dc.get());
+}
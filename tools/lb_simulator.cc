@@ -0,0 +1,139 @@
+#include <lb_dump.h>
+#include <lb_kernels.h>
+#include <CLI/CLI.hpp>
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Replay the per-element loads recorded with --lb-dump <file> through the
+ * load balancers on simulated ranks, without MPI. The rank count and
+ * comm-split stopping rules can differ from the recorded run, e.g.
+ *   ./lb_simulator lb.dump --lb commsplit --ranks 64 --max-imbalance 1.05
+ * For every recorded phase it prints the imbalance before and after
+ * balancing, the number of elements that changed rank, their size, and
+ * the most element memory left on any rank.
+ */
+
+using darma_backend::lb_phase;
+using darma_backend::lb_record;
+using namespace darma_backend::lb;
+
+static double imbalance(const rank_configs& configs)
+{
+  uint64_t maxLoad = 0, totalLoad = 0;
+  for (auto& config : configs){
+    uint64_t load = 0;
+    for (auto& pair : config) load += pair.first;
+    maxLoad = std::max(maxLoad, load);
+    totalLoad += load;
+  }
+  if (totalLoad == 0) return 1.0;
+  return maxLoad / (double(totalLoad) / configs.size());
+}
+
+/**
+ * Place the records on the recorded ranks, or in contiguous blocks of
+ * the recorded rank order when simulating a different rank count
+ */
+static rank_configs initial_configs(const lb_phase& ph, int nranks)
+{
+  rank_configs configs(nranks);
+  if (nranks == ph.nranks){
+    for (auto& rec : ph.records){
+      configs[rec.rank].emplace_back(rec.load, rec.index);
+    }
+    return configs;
+  }
+
+  std::vector<lb_record> sorted = ph.records;
+  std::stable_sort(sorted.begin(), sorted.end(),
+    [](const lb_record& a, const lb_record& b){ return a.rank < b.rank; });
+  uint64_t n = sorted.size();
+  for (uint64_t i=0; i < n; ++i){
+    configs[i * nranks / n].emplace_back(sorted[i].load, sorted[i].index);
+  }
+  return configs;
+}
+
+int main(int argc, char** argv)
+{
+  CLI::App app{"Offline DARMA load balancer simulator"};
+  std::string path;
+  std::string lbName = "commsplit";
+  int nranks = 0;
+  comm_split_params params;
+  app.add_option("dump", path, "file written with --lb-dump")->required();
+  app.add_option("--lb", lbName, "load balancer to simulate: commsplit, hypercube, random or debug");
+  app.add_option("--ranks", nranks, "number of simulated ranks, defaults to the recorded count");
+  app.add_option("--tries", params.maxNumTries, "comm-split rounds of pairwise exchange");
+  app.add_option("--diff-cutoff", params.diffCutoff, "comm-split (max-min)/avg cutoff");
+  app.add_option("--min-improvement", params.minImprovement, "comm-split minimum improvement per round");
+  app.add_option("--max-imbalance", params.maxImbalance, "comm-split max/avg cutoff");
+  double memCapMB = 0;
+  app.add_option("--mem-cap", memCapMB, "comm-split per-rank element memory cap in MB, 0 for no cap");
+  app.add_option("--size-tolerance", params.sizeTolerance,
+                 "comm-split relative load difference within which the smaller element is traded");
+  CLI11_PARSE(app, argc, argv);
+  params.memoryCap = uint64_t(memCapMB * 1024 * 1024);
+
+  if (lbName != "commsplit" && lbName != "hypercube" && lbName != "random" && lbName != "debug"){
+    std::cerr << "Cannot simulate load balancer " << lbName << std::endl;
+    return 1;
+  }
+
+  std::vector<lb_phase> phases;
+  if (!darma_backend::lb_dump::read(path, phases)){
+    std::cerr << "Unable to read load balancer dump " << path << std::endl;
+    if (phases.empty()) return 1;
+    std::cerr << "Simulating the " << phases.size() << " complete phases" << std::endl;
+  }
+
+  std::cout << "phase,ranks,elements,imbalance_before,imbalance_after,migrated,bytes_moved,max_rank_bytes\n";
+  for (auto& ph : phases){
+    int simRanks = nranks > 0 ? nranks : ph.nranks;
+    rank_configs before = initial_configs(ph, simRanks);
+
+    object_sizes sizes;
+    for (auto& rec : ph.records){
+      if (rec.bytes) sizes[rec.index] = rec.bytes;
+    }
+
+    rank_configs after;
+    if (lbName == "commsplit"){
+      after = simulate_comm_split(before, params, sizes);
+    } else if (lbName == "hypercube"){
+      after = simulate_hypercube(before, params, sizes);
+    } else if (lbName == "random"){
+      after = simulate_random(before, ph.phase);
+    } else {
+      after = simulate_debug(before);
+    }
+
+    std::unordered_map<uint64_t,int> oldRank;
+    for (int r=0; r < simRanks; ++r){
+      for (auto& pair : before[r]) oldRank[pair.second] = r;
+    }
+
+    uint64_t migrated = 0, bytesMoved = 0, maxMemory = 0;
+    for (int r=0; r < simRanks; ++r){
+      uint64_t memory = 0;
+      for (auto& pair : after[r]){
+        uint64_t bytes = object_size(sizes, pair.second);
+        memory += bytes;
+        if (oldRank[pair.second] != r){
+          ++migrated;
+          bytesMoved += bytes;
+        }
+      }
+      maxMemory = std::max(maxMemory, memory);
+    }
+
+    std::cout << ph.phase << "," << simRanks << "," << ph.records.size() << ","
+              << imbalance(before) << "," << imbalance(after) << ","
+              << migrated << "," << bytesMoved << "," << maxMemory << "\n";
+  }
+  return 0;
+}
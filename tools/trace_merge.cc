@@ -0,0 +1,110 @@
+#include <trace.h>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/**
+ * Merge the per-rank binary traces written with --trace <prefix> into one
+ * Chrome trace (JSON) file, viewable in chrome://tracing or Perfetto.
+ * Each rank becomes a process, and messages get their own track so they
+ * can overlap the tasks they feed.
+ */
+
+using darma_backend::trace_event;
+using darma_backend::trace_header;
+using darma_backend::tracer;
+
+static void write_args(std::ostream& os, const trace_event& ev)
+{
+  switch(ev.type){
+    case darma_backend::TraceTask:
+      os << "{\"index\":" << ev.arg0 << "}";
+      break;
+    case darma_backend::TraceSend:
+    case darma_backend::TraceRecv:
+      os << "{\"peer\":" << ev.arg0 << ",\"tag\":" << ev.arg1
+         << ",\"bytes\":" << ev.arg2 << "}";
+      break;
+    case darma_backend::TraceLoadBalance:
+      os << "{\"local_before\":" << ev.arg0 << ",\"local_after\":" << ev.arg1 << "}";
+      break;
+    case darma_backend::TraceMigrate:
+      os << "{\"sends\":" << ev.arg0 << ",\"recvs\":" << ev.arg1
+         << ",\"bytes_sent\":" << ev.arg2 << "}";
+      break;
+    default:
+      os << "{}";
+  }
+}
+
+static int track(uint32_t type)
+{
+  switch(type){
+    case darma_backend::TraceSend: return 1;
+    case darma_backend::TraceRecv: return 2;
+    default: return 0;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  if (argc != 3){
+    std::cerr << "Usage: " << argv[0] << " <trace prefix> <output.json>\n";
+    return 1;
+  }
+
+  std::string prefix = argv[1];
+  std::ofstream out(argv[2]);
+  if (!out){
+    std::cerr << "Unable to open " << argv[2] << "\n";
+    return 1;
+  }
+
+  out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+  bool first = true;
+  int rank = 0;
+  for (;; ++rank){
+    trace_header header;
+    std::vector<trace_event> events;
+    std::string path = prefix + "." + std::to_string(rank) + ".bin";
+    if (!tracer::read(path, header, events)) break;
+
+    if (header.num_dropped){
+      std::cerr << "Rank " << rank << " dropped its " << header.num_dropped
+                << " oldest events\n";
+    }
+
+    const char* tracks[] = {"tasks", "sends", "recvs"};
+    for (int t=0; t < 3; ++t){
+      out << (first ? "" : ",\n")
+          << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":" << rank
+          << ",\"tid\":" << t << ",\"args\":{\"name\":\"" << tracks[t] << "\"}}";
+      first = false;
+    }
+    out << ",\n{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":" << rank
+        << ",\"args\":{\"name\":\"rank " << rank << "\"}}";
+
+    char ts[64];
+    for (const trace_event& ev : events){
+      //chrome traces are in microseconds
+      snprintf(ts, sizeof(ts), "\"ts\":%.3f,\"dur\":%.3f",
+               ev.start*1e-3, (ev.stop - ev.start)*1e-3);
+      out << ",\n{\"ph\":\"X\",\"name\":\"" << tracer::name(ev.type)
+          << "\",\"pid\":" << rank << ",\"tid\":" << track(ev.type)
+          << "," << ts << ",\"args\":";
+      write_args(out, ev);
+      out << "}";
+    }
+  }
+  out << "\n]}\n";
+
+  if (rank == 0){
+    std::cerr << "No trace files found for prefix " << prefix << "\n";
+    return 1;
+  }
+  std::cout << "Merged " << rank << " ranks into " << argv[2] << std::endl;
+  return 0;
+}